@@ -163,7 +163,7 @@ void EasyHttpConnection::connWriteFinished(
 	else
 	{
 		// Inform about the error.
-		dataDownloaded(0, result);
+		notifyError(result);
 	}
 }
 
@@ -181,7 +181,7 @@ void EasyHttpConnection::httpFinished(
 	if ( ! (200 == result || 201 == result) )
 	{
 		// There was an error.
-		dataDownloaded(0, result);
+		notifyError(result);
 		return;
 	}
 
@@ -219,7 +219,41 @@ void EasyHttpConnection::downloadError(int result)
 	close();
 	deleteReader();
 	deallocateData();
-	dataDownloaded(0, result);
+	notifyError(result);
+}
+
+/**
+ * Called by an EasyReader with each piece of data when streaming.
+ */
+bool EasyHttpConnection::chunkDownloaded(const char* data, int size)
+{
+	return dataChunkReceived(data, size);
+}
+
+/**
+ * Called by an EasyReader when all data has been passed to
+ * chunkDownloaded.
+ */
+void EasyHttpConnection::streamingSuccess()
+{
+	close();
+	deleteReader();
+	deallocateData();
+	dataStreamed(RES_OK);
+}
+
+bool EasyHttpConnection::isStreaming()
+{
+	return false;
+}
+
+bool EasyHttpConnection::dataChunkReceived(const char* data, int size)
+{
+	return true;
+}
+
+void EasyHttpConnection::dataStreamed(int result)
+{
 }
 
 /**
@@ -237,6 +271,22 @@ void EasyHttpConnection::deallocateData()
 {
 }
 
+/**
+ * Tell the subclass about an error, through dataStreamed when
+ * streaming and through dataDownloaded otherwise.
+ */
+void EasyHttpConnection::notifyError(int result)
+{
+	if (isStreaming())
+	{
+		dataStreamed(result);
+	}
+	else
+	{
+		dataDownloaded(0, result);
+	}
+}
+
 void EasyHttpConnection::deleteReader()
 {
 	if (mReader)
@@ -271,8 +321,13 @@ EasyReaderThatReadsChunks::EasyReaderThatReadsChunks(
 		EasyHttpConnection* connection)
 : EasyReader(connection),
   mDataChunkSize(2048),
-  mDataChunkOffset(0)
+  mDataChunkOffset(0),
+  mStreamBuffer(NULL)
 {
+	if (connection->isStreaming())
+	{
+		mStreamBuffer = new char[mDataChunkSize];
+	}
 }
 
 /**
@@ -292,6 +347,8 @@ EasyReaderThatReadsChunks::~EasyReaderThatReadsChunks()
 		// Remove chunk from list.
 		mDataChunks.remove(0);
 	}
+
+	delete[] mStreamBuffer;
 }
 
 /**
@@ -316,7 +373,14 @@ void EasyReaderThatReadsChunks::connRecvFinished(int result)
 	// If the connection is closed we have completed reading the data.
 	if (CONNERR_CLOSED == result)
 	{
-		finishedDownloadingChunkedData();
+		if (NULL != mStreamBuffer)
+		{
+			finishedStreamingChunkedData();
+		}
+		else
+		{
+			finishedDownloadingChunkedData();
+		}
 		return;
 	}
 
@@ -339,6 +403,18 @@ void EasyReaderThatReadsChunks::connRecvFinished(int result)
 		MAHandle chunk = mDataChunks[currentChunkIndex];
 		mConnection->recvToData(chunk, mDataChunkOffset, leftToRead);
 	}
+	else if (NULL != mStreamBuffer)
+	{
+		// Pass the full chunk on and read into it again.
+		if (!streamCurrentChunk())
+		{
+			mConnection->downloadError(CONNERR_GENERIC);
+			return;
+		}
+		mDataChunkOffset = 0;
+		MAHandle chunk = mDataChunks[0];
+		mConnection->recvToData(chunk, mDataChunkOffset, mDataChunkSize);
+	}
 	else
 	{
 		// Read next chunk.
@@ -350,6 +426,22 @@ void EasyReaderThatReadsChunks::connRecvFinished(int result)
 	}
 }
 
+/**
+ * Pass the data read so far into the current chunk to the connection.
+ * \return false if the connection wants to abort the download.
+ */
+bool EasyReaderThatReadsChunks::streamCurrentChunk()
+{
+	if (0 == mDataChunkOffset)
+	{
+		return true;
+	}
+
+	MAHandle chunk = mDataChunks[mDataChunks.size() - 1];
+	maReadData(chunk, mStreamBuffer, 0, mDataChunkOffset);
+	return mConnection->chunkDownloaded(mStreamBuffer, mDataChunkOffset);
+}
+
 bool EasyReaderThatReadsChunks::readNextChunk()
 {
 	// Allocate new a chunk of data.
@@ -415,4 +507,17 @@ void EasyReaderThatReadsChunks::finishedDownloadingChunkedData()
 	mConnection->downloadSuccess(dataHandle);
 }
 
+void EasyReaderThatReadsChunks::finishedStreamingChunkedData()
+{
+	// The last chunk is only partially written.
+	if (!streamCurrentChunk())
+	{
+		mConnection->downloadError(CONNERR_GENERIC);
+		return;
+	}
+
+	// Download is finished! Tell the connection about this.
+	mConnection->streamingSuccess();
+}
+
 } // namespace
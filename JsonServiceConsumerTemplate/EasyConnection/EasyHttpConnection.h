@@ -88,6 +88,10 @@ protected:
  * \brief Class that handles download when content-length is NOT known.
  * Here we read in chunks until we get result CONNERR_CLOSED in
  * connRecvFinished.
+ *
+ * If the connection is streaming (see EasyHttpConnection::isStreaming),
+ * each chunk is handed to the connection as soon as it is full and the
+ * chunk is then reused, so the complete response is never buffered.
  */
 class EasyReaderThatReadsChunks : public EasyReader
 {
@@ -115,6 +119,8 @@ public:
 protected:
 	bool readNextChunk();
 	void finishedDownloadingChunkedData();
+	bool streamCurrentChunk();
+	void finishedStreamingChunkedData();
 
 protected:
 	/**
@@ -131,6 +137,12 @@ protected:
 	 * Current location (write offset) in the current chunk.
 	 */
 	int mDataChunkOffset;
+
+	/**
+	 * Buffer used to pass chunk data to the connection when
+	 * streaming, NULL otherwise.
+	 */
+	char* mStreamBuffer;
 };
 
 /**
@@ -168,7 +180,44 @@ public:
 	 */
 	void downloadError(int result);
 
+	/**
+	 * Called by an EasyReader with each piece of data when streaming.
+	 * \return false if the download should be aborted.
+	 */
+	bool chunkDownloaded(const char* data, int size);
+
+	/**
+	 * Called by an EasyReader when all data has been passed to
+	 * chunkDownloaded.
+	 */
+	void streamingSuccess();
+
+	/**
+	 * Override and return true to get the downloaded data piece by
+	 * piece in dataChunkReceived, followed by a call to dataStreamed,
+	 * instead of in one data handle passed to dataDownloaded.
+	 * Default is false.
+	 */
+	virtual bool isStreaming();
+
 protected:
+	/**
+	 * Override this method when streaming.
+	 * Called with each piece of downloaded data, in order.
+	 * \param data The data. Only valid during the call.
+	 * \param size Size of the data in bytes.
+	 * \return true to continue the download, false to abort it.
+	 */
+	virtual bool dataChunkReceived(const char* data, int size);
+
+	/**
+	 * Override this method when streaming.
+	 * Called when the download is finished.
+	 * \param result RES_OK if all data was passed to dataChunkReceived,
+	 * otherwise an HTTP or connection error code.
+	 */
+	virtual void dataStreamed(int result);
+
 	/**
 	 * Implement this method in a subclass of this class.
 	 * Called when the HTTP connection has finished downloading data.
@@ -176,6 +225,7 @@ protected:
 	 * \param result Result code, RES_OK on success, otherwise an HTTP error code.
 	 * The subclass takes ownership of this data and has the responsibility
 	 * of deallocating the data.
+	 * Not called when streaming.
 	 */
 	virtual void dataDownloaded(MAHandle data, int result) = 0;
 
@@ -194,6 +244,12 @@ protected:
 
 	void deallocateData();
 
+	/**
+	 * Tell the subclass about an error, through dataStreamed when
+	 * streaming and through dataDownloaded otherwise.
+	 */
+	void notifyError(int result);
+
 	/**
 	 * Delete the reader object (this is the object that
 	 * performs the download).
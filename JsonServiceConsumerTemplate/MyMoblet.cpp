@@ -78,32 +78,85 @@ void TestParseJson()
 			firstName->toString().c_str());
 	}
 
+	// Parse the data again into a document, one byte at a time as if
+	// it was downloaded, and check that the tree is the same.
+	Document document;
+	Parser parser(document);
+	for (int i = 0; i < jsonData.size(); ++i)
+	{
+		parser.feed((const unsigned char*)jsonData.c_str() + i, 1);
+	}
+	Value* streamed = parser.finish();
+	BufferWriter expected;
+	BufferWriter actual;
+	serialize(root, expected);
+	serialize(streamed, actual);
+	if (NULL == streamed
+		|| expected.getLength() != actual.getLength()
+		|| 0 != memcmp(expected.getData(), actual.getData(),
+			expected.getLength()))
+	{
+		LOG("Streamed tree is not the same\n");
+	}
+
 	// Delete Json tree.
 	YAJLDom::deleteValue(root);
 }
 
 /**
  * Connection class for downloading data. Used for downloding Json data.
- * The downloaded data is passed on to the moblet. 
+ * The data is streamed into a Json parser as it arrives, and the
+ * parsed document is passed on to the moblet.
  */
 class JsonServiceConnection : public EasyHttpConnection
 {
 public:
 	JsonServiceConnection(MyMoblet* moblet)
-		: EasyHttpConnection()
+		: EasyHttpConnection(),
+		  mParser(moblet->getJsonDocument())
 	{
 		mMoblet = moblet;
 	}
 
 	/**
-	 * Called when the HTTP connection has finished downloading data.
-	 * \param data Handle to the data, will be 0 on error, > 0 on success.
-	 * \param result Result code, RES_OK on success, otherwise an HTTP 
+	 * We want the data in chunks, to parse it while downloading.
+	 */
+	bool isStreaming()
+	{
+		return true;
+	}
+
+	/**
+	 * Called with each chunk of downloaded data.
+	 * \return false to abort the download if the data is not valid Json.
+	 */
+	bool dataChunkReceived(const char* data, int size)
+	{
+		return mParser.feed((const unsigned char*)data, size);
+	}
+
+	/**
+	 * Called when the download is finished.
+	 * \param result RES_OK on success, otherwise an HTTP or connection
 	 * error code.
 	 */
+	void dataStreamed(int result)
+	{
+		// Always finish, to release a partially parsed document.
+		Value* root = mParser.finish();
+		if (RES_OK != result)
+		{
+			mMoblet->getJsonDocument().clear();
+			root = NULL;
+		}
+		mMoblet->jsonDataReceived(root, result);
+	}
+
+	/**
+	 * Not used since we are streaming.
+	 */
 	void dataDownloaded(MAHandle data, int result)
 	{
-		mMoblet->dataDownloaded(data, result);
 	}
 
 private:
@@ -111,8 +164,13 @@ private:
 	 * Pointer to the moblet.
 	  */
 	MyMoblet* mMoblet;
-};
 
+	/**
+	 * Parser that builds the Json tree in the document of the
+	 * moblet while downloading.
+	 */
+	Parser mParser;
+};
 
 /**
  * Initialize the application in the constructor.
@@ -123,6 +181,9 @@ MyMoblet::MyMoblet()
 	LOG("Touch screen to start download\n");
 	TestParseJson();
 
+	// Share the keys between all downloaded documents.
+	mJsonDocument.setKeyTable(&mJsonKeys);
+
 	if (NULL == SERVICE_URL)
 	{
 		maPanic(0, "You must edit MyMoblet.h and add a service url");
@@ -206,41 +267,32 @@ int MyMoblet::startDownloadJsonData()
 }
 
 /**
- * Called when download of Json data is complete.
+ * Called when download and parsing of Json data is complete.
  */
-void MyMoblet::dataDownloaded(MAHandle data, int result)
+void MyMoblet::jsonDataReceived(Value* root, int result)
 {
 	// Delete the connection.
 	deleteConnection();
 
-	// Check that we have a valid data handle.
-	if (data <= 0)
+	// Check that we have a valid document.
+	if (NULL == root)
 	{
-		LOG("Failed to download data - result: %d\n", result);
+		LOG("Failed to download or parse data - result: %d\n", result);
 		return;
 	}
 
-	// Get the Json data as a string.
-	String jsonData;
-	bool success = HandleToString(data, jsonData);
-	if (!success)
-	{
-		LOG("Failed to get string data\n");
-		return;
-	}
-
-	LOG("Data downloaded size: %d\n", jsonData.size());
-
-	// Parse Json data.
-	Value* root = YAJLDom::parse(
-		(const unsigned char*)jsonData.c_str(),
-		jsonData.size());
-
 	// Traverse the Json tree and print data.
 	traverseJsonTree(root);
 
-	// Delete Json tree.
-	deleteValue(root);
+	// The tree is kept in mJsonDocument until the next download.
+}
+
+/**
+ * The document that downloaded Json data is parsed into.
+ */
+Document& MyMoblet::getJsonDocument()
+{
+	return mJsonDocument;
 }
 
 /**
@@ -272,15 +324,20 @@ int MyMoblet::traverseJsonTree(Value* root)
 		return ERROR;
 	}
 
+	// Keys looked up in every person. The people share the same keys,
+	// so the lookups after the first one are not searched.
+	static const CachedKey nameKey("name");
+	static const CachedKey companyKey("company");
+
 	// Iterate over the people array and print data.
 	for (int i = 0; i < people->getNumChildValues(); ++i)
 	{
 		Value* person = people->getValueByIndex(i);
-		Value* name = person->getValueForKey("name");
-		Value* company = person->getValueForKey("company");
+		Value* name = person->getValueForKey(nameKey);
+		Value* company = person->getValueForKey(companyKey);
 		LOG("name: %s company: %s\n",
-			name->toString().c_str(),
-			company->toString().c_str());
+			name->getString(),
+			company->getString());
 	}
 }
 
@@ -70,9 +70,17 @@ public:
 	void pointerPressEvent(MAPoint2d point);
 
 	/**
-	 * Called when download of Json data is complete.
+	 * Called when download and parsing of Json data is complete.
+	 * \param root The root of the parsed document, NULL on error.
+	 * Owned by the Json document of the moblet.
+	 * \param result RES_OK on success, otherwise an error code.
 	 */
-	void dataDownloaded(MAHandle data, int result);
+	void jsonDataReceived(MAUtil::YAJLDom::Value* root, int result);
+
+	/**
+	 * \return The document that downloaded Json data is parsed into.
+	 */
+	MAUtil::YAJLDom::Document& getJsonDocument();
 
 private:
 	/**
@@ -100,6 +108,18 @@ private:
 	 * can be active at a time. If needed this can be changed.
 	 */
 	EasyConnection::EasyHttpConnection* mConnection;
+
+	/**
+	 * Interns the keys of the downloaded documents. It is kept
+	 * between downloads, since the service returns the same keys
+	 * every time.
+	 */
+	MAUtil::YAJLDom::KeyTable mJsonKeys;
+
+	/**
+	 * Holds the last downloaded Json data.
+	 */
+	MAUtil::YAJLDom::Document mJsonDocument;
 };
 
 #endif
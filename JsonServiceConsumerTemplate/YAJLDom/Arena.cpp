@@ -0,0 +1,263 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Arena.cpp
+ *
+ *  Bump allocator used for YAJLDom documents.
+ */
+
+#include "Arena.h"
+#include <ma.h>
+#include <maheap.h>
+#include <mastring.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+// All allocations are rounded up to this, which suits doubles and
+// pointers on all targets.
+#define ARENA_ALIGN 8
+#define ARENA_ROUND(size) (((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+// Blocks stop doubling at this size. Larger allocations still get a
+// block of their own.
+#define ARENA_MAX_BLOCK_SIZE (256 * 1024)
+
+#define ARENA_HEADER_SIZE ARENA_ROUND((int) sizeof(Block))
+
+Arena::Arena(int blockSize) :
+	mBlocks(NULL), mFreeBlocks(NULL), mLast(NULL),
+	mNextBlockSize(blockSize), mBytesUsed(0), mBytesReserved(0)
+#ifdef YAJLDOM_STATS
+	, mAllocationCount(0), mBytesAllocated(0)
+#endif
+	{
+}
+
+Arena::~Arena() {
+	release();
+}
+
+Arena::Block* Arena::newBlock(int minSize) {
+	// Reuse the first kept block that is large enough.
+	Block** link = &mFreeBlocks;
+	while (*link) {
+		Block* block = *link;
+		if (block->size >= minSize) {
+			*link = block->next;
+			block->used = 0;
+			return block;
+		}
+		link = &block->next;
+	}
+
+	int size = mNextBlockSize;
+	while (size < minSize)
+		size *= 2;
+	if (mNextBlockSize < ARENA_MAX_BLOCK_SIZE)
+		mNextBlockSize *= 2;
+
+	Block* block = (Block*) malloc(ARENA_HEADER_SIZE + size);
+	if (!block)
+		maPanic(1, "YAJLDom::Arena, out of memory.");
+	block->size = size;
+	block->used = 0;
+	mBytesReserved += size;
+	return block;
+}
+
+void* Arena::allocate(int size) {
+	size = ARENA_ROUND(size);
+
+	Block* block = mBlocks;
+	if (!block || block->size - block->used < size) {
+		block = newBlock(size);
+		// Keep using the old block if the new one is a one-off
+		// for a large allocation and the old one still has room.
+		if (mBlocks && size > mBlocks->size - mBlocks->used
+				&& block->size - size < mBlocks->size - mBlocks->used) {
+			block->next = mBlocks->next;
+			mBlocks->next = block;
+		} else {
+			block->next = mBlocks;
+			mBlocks = block;
+		}
+	}
+
+	char* ptr = (char*) block + ARENA_HEADER_SIZE + block->used;
+	block->used += size;
+	mBytesUsed += size;
+	if (block == mBlocks)
+		mLast = ptr;
+#ifdef YAJLDOM_STATS
+	mAllocationCount++;
+	mBytesAllocated += size;
+#endif
+	return ptr;
+}
+
+void* Arena::reallocate(void* ptr, int oldSize, int newSize) {
+	if (!ptr)
+		return allocate(newSize);
+
+	oldSize = ARENA_ROUND(oldSize);
+	int roundedSize = ARENA_ROUND(newSize);
+
+	// Resize the latest allocation in place.
+	if (ptr == mLast) {
+		Block* block = mBlocks;
+		int available = block->size - block->used + oldSize;
+		if (roundedSize <= available) {
+			block->used += roundedSize - oldSize;
+			mBytesUsed += roundedSize - oldSize;
+#ifdef YAJLDOM_STATS
+			if (roundedSize > oldSize)
+				mBytesAllocated += roundedSize - oldSize;
+#endif
+			return ptr;
+		}
+	}
+
+	if (roundedSize <= oldSize)
+		return ptr;
+
+	void* newPtr = allocate(newSize);
+	memcpy(newPtr, ptr, oldSize);
+	return newPtr;
+}
+
+char* Arena::copyString(const char* str, int length) {
+	char* copy = (char*) allocate(length + 1);
+	memcpy(copy, str, length);
+	copy[length] = 0;
+	return copy;
+}
+
+void Arena::reserve(int size) {
+	size = ARENA_ROUND(size);
+	if (mBlocks && mBlocks->size - mBlocks->used >= size)
+		return;
+	Block* block = newBlock(size);
+	block->next = mBlocks;
+	mBlocks = block;
+	mLast = NULL;
+}
+
+void Arena::adopt(Arena& other) {
+	if (!other.mBlocks)
+		return;
+
+	int reserved = 0;
+	Block* last = other.mBlocks;
+	for (;;) {
+		reserved += last->size;
+		if (!last->next)
+			break;
+		last = last->next;
+	}
+
+	// The current block stays first, so allocations continue in it.
+	if (mBlocks) {
+		last->next = mBlocks->next;
+		mBlocks->next = other.mBlocks;
+	} else {
+		mBlocks = other.mBlocks;
+		mLast = NULL;
+	}
+	mBytesUsed += other.mBytesUsed;
+	mBytesReserved += reserved;
+
+	other.mBlocks = NULL;
+	other.mLast = NULL;
+	other.mBytesUsed = 0;
+	other.mBytesReserved -= reserved;
+}
+
+void Arena::reset() {
+	while (mBlocks) {
+		Block* block = mBlocks;
+		mBlocks = block->next;
+		block->next = mFreeBlocks;
+		mFreeBlocks = block;
+	}
+	mLast = NULL;
+	mBytesUsed = 0;
+}
+
+Arena::Mark Arena::getMark() const {
+	Mark mark;
+	mark.block = mBlocks;
+	mark.next = mBlocks ? mBlocks->next : NULL;
+	mark.used = mBlocks ? mBlocks->used : 0;
+	mark.bytesUsed = mBytesUsed;
+	return mark;
+}
+
+void Arena::rewind(const Mark& mark) {
+	// Newer blocks are in front of the block of the mark, except for
+	// blocks of large allocations and adopted blocks, which are put
+	// right behind the current block, see allocate().
+	while (mBlocks && mBlocks != mark.block) {
+		Block* block = mBlocks;
+		mBlocks = block->next;
+		block->next = mFreeBlocks;
+		mFreeBlocks = block;
+	}
+	if (mBlocks) {
+		while (mBlocks->next != mark.next) {
+			Block* block = mBlocks->next;
+			mBlocks->next = block->next;
+			block->next = mFreeBlocks;
+			mFreeBlocks = block;
+		}
+		mBlocks->used = mark.used;
+	}
+	mLast = NULL;
+	mBytesUsed = mark.bytesUsed;
+}
+
+void Arena::release() {
+	reset();
+	while (mFreeBlocks) {
+		Block* block = mFreeBlocks;
+		mFreeBlocks = block->next;
+		free(block);
+	}
+	mBytesReserved = 0;
+}
+
+int Arena::getBytesUsed() const {
+	return mBytesUsed;
+}
+
+int Arena::getBytesReserved() const {
+	return mBytesReserved;
+}
+
+#ifdef YAJLDOM_STATS
+int Arena::getAllocationCount() const {
+	return mAllocationCount;
+}
+
+int Arena::getBytesAllocated() const {
+	return mBytesAllocated;
+}
+#endif
+
+} // namespace YAJLDom
+} // namespace MAUtil
@@ -0,0 +1,178 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Arena.h
+ *
+ *  Bump allocator used for YAJLDom documents.
+ */
+
+#ifndef _YAJL_DOM_ARENA_H_
+#define _YAJL_DOM_ARENA_H_
+
+#include <stddef.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Allocates memory by bumping a pointer through large blocks.
+ *
+ * Individual allocations are never freed. All memory is given back at
+ * once with reset(), which keeps the blocks for the next use, or with
+ * release(), which frees them. Blocks grow geometrically, so a large
+ * document ends up in a few large blocks.
+ *
+ * An Arena is not thread safe.
+ */
+class Arena {
+	struct Block;
+
+public:
+	/**
+	 * A position in the arena, see rewind().
+	 */
+	struct Mark {
+		Block* block;
+		Block* next;
+		int used;
+		int bytesUsed;
+	};
+
+	/**
+	 * \param blockSize Size of the first block. Later blocks double
+	 * in size up to a limit.
+	 */
+	Arena(int blockSize = 4096);
+	~Arena();
+
+	/**
+	 * Allocate size bytes, aligned for any scalar type.
+	 * Calls maPanic if out of memory.
+	 */
+	void* allocate(int size);
+
+	/**
+	 * Grow or shrink an allocation. Done in place if ptr is the latest
+	 * allocation and there is room, otherwise the data is copied to
+	 * a new allocation.
+	 */
+	void* reallocate(void* ptr, int oldSize, int newSize);
+
+	/**
+	 * Copy length bytes of str into the arena and null terminate them.
+	 */
+	char* copyString(const char* str, int length);
+
+	/**
+	 * Make sure at least size bytes can be allocated without asking
+	 * the system for more memory.
+	 */
+	void reserve(int size);
+
+	/**
+	 * Take over the allocations of other, which is left empty. Its
+	 * blocks in use are moved to this arena and released with it,
+	 * blocks kept for reuse stay with other. Nothing is copied.
+	 */
+	void adopt(Arena& other);
+
+	/**
+	 * Forget all allocations, but keep the blocks for reuse.
+	 */
+	void reset();
+
+	/**
+	 * \return The current position, to rewind to later.
+	 */
+	Mark getMark() const;
+
+	/**
+	 * Forget the allocations made since mark was taken, and keep the
+	 * blocks they used for reuse. Allocations are then freed in the
+	 * reverse order they were made in, like a stack.
+	 * \param mark Taken after the last reset().
+	 */
+	void rewind(const Mark& mark);
+
+	/**
+	 * Forget all allocations and free all blocks.
+	 */
+	void release();
+
+	/**
+	 * \return The number of bytes handed out since the last reset.
+	 */
+	int getBytesUsed() const;
+
+	/**
+	 * \return The number of bytes held in blocks, used or not.
+	 */
+	int getBytesReserved() const;
+
+#ifdef YAJLDOM_STATS
+	/**
+	 * \return The number of allocations, and the bytes they and the
+	 * allocations that grew in place took, since the arena was
+	 * created. Not changed by reset().
+	 */
+	int getAllocationCount() const;
+	int getBytesAllocated() const;
+#endif
+
+private:
+	struct Block {
+		Block* next;
+		int size;
+		int used;
+	};
+
+	Block* newBlock(int minSize);
+
+	// Never copied.
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	/**
+	 * Blocks in use, the current one first.
+	 */
+	Block* mBlocks;
+
+	/**
+	 * Blocks kept by reset(), waiting for reuse.
+	 */
+	Block* mFreeBlocks;
+
+	/**
+	 * Start of the latest allocation, for reallocate().
+	 */
+	char* mLast;
+
+	int mNextBlockSize;
+	int mBytesUsed;
+	int mBytesReserved;
+
+#ifdef YAJLDOM_STATS
+	int mAllocationCount;
+	int mBytesAllocated;
+#endif
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_ARENA_H_
@@ -0,0 +1,120 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * BatchParser.cpp
+ *
+ *  Parses many small Json documents at a time, with one long-lived
+ *  Parser for each worker.
+ */
+
+#include "BatchParser.h"
+#include "MemoryMgr.h"
+
+using namespace YAJLDomUtil;
+
+namespace MAUtil {
+namespace YAJLDom {
+
+BatchParser::BatchParser() :
+	mRunner(NULL), mWorkerCount(1), mZeroCopy(false), mTexts(NULL),
+	mLengths(NULL), mCount(0) {
+}
+
+BatchParser::~BatchParser() {
+	// The parsers refer to the documents.
+	for (int i = 0; i < mParsers.size(); i++)
+		deleteobject(mParsers[i]);
+	for (int i = 0; i < mDocuments.size(); i++)
+		deleteobject(mDocuments[i]);
+}
+
+void BatchParser::setTaskRunner(TaskRunner* runner, int workers) {
+	mRunner = runner;
+	mWorkerCount = workers > 1 ? workers : 1;
+}
+
+void BatchParser::setZeroCopy(bool zeroCopy) {
+	mZeroCopy = zeroCopy;
+}
+
+int BatchParser::getDocumentCount() const {
+	return mCount;
+}
+
+Document& BatchParser::getDocument(int index) {
+	if (index < 0 || index >= mCount)
+		maPanic(1, "YAJLDom::BatchParser::getDocument, index out of range.");
+	return *mDocuments[index];
+}
+
+int BatchParser::parse(const unsigned char* const* texts,
+		const size_t* lengths, int count) {
+	mTexts = texts;
+	mLengths = lengths;
+	mCount = count > 0 ? count : 0;
+
+	while (mDocuments.size() < mCount)
+		mDocuments.add(newobject(Document, new Document()));
+	for (int i = mCount; i < mDocuments.size(); i++)
+		mDocuments[i]->clear();
+
+	int workers = mWorkerCount < mCount ? mWorkerCount : mCount;
+	while (mParsers.size() < workers)
+		mParsers.add(newobject(Parser, new Parser(*mDocuments[0])));
+
+	// Every worker takes every workers:th text, which evens out runs
+	// of long texts.
+	Vector<Work> work;
+	work.resize(workers);
+	Vector<void*> tasks;
+	for (int i = 0; i < workers; i++) {
+		work[i].batch = this;
+		work[i].first = i;
+		work[i].step = workers;
+		work[i].parser = mParsers[i];
+		work[i].parsed = 0;
+		mParsers[i]->setZeroCopy(mZeroCopy);
+		tasks.add(&work[i]);
+	}
+
+	if (mRunner) {
+		mRunner->run(parseTexts, tasks.pointer(), tasks.size());
+	} else {
+		for (int i = 0; i < tasks.size(); i++)
+			parseTexts(tasks[i]);
+	}
+
+	int parsed = 0;
+	for (int i = 0; i < workers; i++)
+		parsed += work[i].parsed;
+	return parsed;
+}
+
+void BatchParser::parseTexts(void* data) {
+	Work* work = (Work*) data;
+	BatchParser* batch = work->batch;
+	Parser* parser = work->parser;
+	for (int i = work->first; i < batch->mCount; i += work->step) {
+		parser->setDocument(*batch->mDocuments[i]);
+		if (parser->parse(batch->mTexts[i], batch->mLengths[i]))
+			work->parsed++;
+	}
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
@@ -0,0 +1,135 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * BatchParser.h
+ *
+ *  Parses many small Json documents at a time, with one long-lived
+ *  Parser for each worker.
+ */
+
+#ifndef _YAJL_DOM_BATCH_PARSER_H_
+#define _YAJL_DOM_BATCH_PARSER_H_
+
+#include <MAUtil/Vector.h>
+
+#include "YAJLDom.h"
+#include "ParallelParser.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Parses a batch of Json texts into one document each:
+ *
+ *   BatchParser batch;
+ *   batch.setTaskRunner(&threads, 4);
+ *   int parsed = batch.parse(texts, lengths, count);
+ *   for (int i = 0; i < count; i++)
+ *       handle(batch.getDocument(i).getRoot());
+ *
+ * The texts are shared out between the workers, and each worker parses
+ * its texts one after the other with a Parser of its own. The parsers
+ * and the documents are kept for the next batch, so the yajl parsers,
+ * the parse stacks and the blocks of the documents are allocated once
+ * and then reused. For small documents that setup costs more than the
+ * parse itself.
+ */
+class BatchParser {
+public:
+	BatchParser();
+	~BatchParser();
+
+	/**
+	 * \param runner Runs the workers, or NULL to run them one after the
+	 * other on the calling thread, which is the default. Not copied.
+	 * \param workers The number of workers, typically the number of
+	 * threads.
+	 */
+	void setTaskRunner(TaskRunner* runner, int workers);
+
+	/**
+	 * Let strings and keys refer to the texts instead of copying them,
+	 * see Document::ZERO_COPY. The texts must then be kept unchanged
+	 * until the next batch. Default is false.
+	 */
+	void setZeroCopy(bool zeroCopy);
+
+	/**
+	 * Parse a batch of Json texts, replacing the documents of the last
+	 * batch.
+	 * \param texts The texts, UTF8 or ASCII.
+	 * \param lengths The length of each text.
+	 * \param count The number of texts.
+	 * \return The number of texts that were valid Json. The document
+	 * of a text that was not is empty.
+	 */
+	int parse(const unsigned char* const* texts, const size_t* lengths,
+			int count);
+
+	/**
+	 * \return The number of documents of the last batch.
+	 */
+	int getDocumentCount() const;
+
+	/**
+	 * \return The document parsed from the text at index in the last
+	 * batch. Owned by the batch parser, and cleared by the next batch.
+	 */
+	Document& getDocument(int index);
+
+private:
+	/**
+	 * The texts parsed by one task: first, first + step, and so on.
+	 */
+	struct Work {
+		BatchParser* batch;
+		int first;
+		int step;
+		Parser* parser;
+		int parsed;
+	};
+
+	static void parseTexts(void* data);
+
+	// Never copied.
+	BatchParser(const BatchParser&);
+	BatchParser& operator=(const BatchParser&);
+
+	TaskRunner* mRunner;
+	int mWorkerCount;
+	bool mZeroCopy;
+
+	/**
+	 * The batch being parsed.
+	 */
+	const unsigned char* const* mTexts;
+	const size_t* mLengths;
+	int mCount;
+
+	/**
+	 * One document for each text, and one parser for each worker, kept
+	 * for the next batch.
+	 */
+	MAUtil::Vector<Document*> mDocuments;
+	MAUtil::Vector<Parser*> mParsers;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_BATCH_PARSER_H_
@@ -0,0 +1,378 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Binding.cpp
+ *
+ *  Parses Json directly into C++ structs, without building a document.
+ */
+
+#include "Binding.h"
+#include "Number.h"
+#include <maheap.h>
+#include <yajl/yajl_parse.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Seeds tried for each table size before the table is made larger.
+ */
+static const unsigned int MAX_SEEDS = 64;
+
+/**
+ * Larger tables are not tried, only repeated names should get here.
+ */
+static const int MAX_TABLE_SIZE = 1 << 16;
+
+static unsigned int hashName(const char* name, int length, unsigned int seed) {
+	unsigned int h = 2166136261u ^ (seed * 2654435761u);
+	for (int i = 0; i < length; i++)
+		h = (h ^ (unsigned char) name[i]) * 16777619u;
+	// Mix the high bits into the low bits that index the table.
+	h ^= h >> 16;
+	h *= 0x45d9f3bu;
+	h ^= h >> 16;
+	return h;
+}
+
+FieldBinding makeField(const char* name, int type, int elementType,
+		const Binding* binding, void* (*addElement)(void*)) {
+	FieldBinding field;
+	field.name = name;
+	field.nameLength = strlen(name);
+	field.type = type;
+	field.elementType = elementType;
+	memset(field.member, 0, sizeof(field.member));
+	field.getMember = NULL;
+	field.binding = binding;
+	field.addElement = addElement;
+	return field;
+}
+
+Binding::Binding(const FieldBinding* fields, int count) :
+	mFields(fields), mCount(count), mTable(NULL), mTableSize(0), mSeed(0) {
+	for (int i = 0; i < count; i++)
+		for (int j = i + 1; j < count; j++)
+			if (fields[i].nameLength == fields[j].nameLength
+					&& memcmp(fields[i].name, fields[j].name,
+							fields[i].nameLength) == 0)
+				maPanic(1, "YAJLDom::Binding, repeated field name.");
+
+	// Find a table size and seed where no names collide.
+	mTableSize = 4;
+	while (mTableSize < count * 2)
+		mTableSize *= 2;
+	for (;;) {
+		mTable = (int*) realloc(mTable, mTableSize * sizeof(int));
+		for (unsigned int seed = 0; seed < MAX_SEEDS; seed++)
+			if (buildTable(seed))
+				return;
+		mTableSize *= 2;
+		if (mTableSize > MAX_TABLE_SIZE)
+			maPanic(1, "YAJLDom::Binding, no perfect hash found.");
+	}
+}
+
+Binding::~Binding() {
+	free(mTable);
+}
+
+/**
+ * \return false if two names get the same slot with seed.
+ */
+bool Binding::buildTable(unsigned int seed) {
+	memset(mTable, 0, mTableSize * sizeof(int));
+	int mask = mTableSize - 1;
+	for (int i = 0; i < mCount; i++) {
+		int slot = hashName(mFields[i].name, mFields[i].nameLength, seed)
+				& mask;
+		if (mTable[slot])
+			return false;
+		mTable[slot] = i + 1;
+	}
+	mSeed = seed;
+	return true;
+}
+
+const FieldBinding* Binding::findField(const char* key, int keyLength) const {
+	int i = mTable[hashName(key, keyLength, mSeed) & (mTableSize - 1)];
+	if (!i)
+		return NULL;
+	const FieldBinding* field = &mFields[i - 1];
+	if (field->nameLength != keyLength
+			|| memcmp(field->name, key, keyLength) != 0)
+		return NULL;
+	return field;
+}
+
+BindingParser::BindingParser() :
+	mBinding(NULL), mObject(NULL), mArrayField(NULL), mHandle(NULL),
+	mSkipDepth(0), mStarted(false) {
+}
+
+BindingParser::~BindingParser() {
+	if (mHandle)
+		yajl_free(mHandle);
+}
+
+/**
+ * \return true if a Json value of jsonType, which is BOOLEAN, DOUBLE
+ * for numbers or STRING, can be stored in a member of memberType.
+ */
+static bool accepts(int jsonType, int memberType) {
+	if (jsonType == FieldBinding::DOUBLE)
+		return memberType == FieldBinding::INT
+				|| memberType == FieldBinding::INT64
+				|| memberType == FieldBinding::DOUBLE;
+	return jsonType == memberType;
+}
+
+/**
+ * \return Where the next value goes, or NULL if it is skipped.
+ * \param memberType Set to the type of the member.
+ */
+void* BindingParser::target(int jsonType, int* memberType) {
+	if (mFrames.size() == 0)
+		return NULL;
+	Frame& frame = mFrames.peek();
+	const FieldBinding* field = frame.field;
+	if (!field)
+		return NULL;
+
+	if (!frame.isArray) {
+		if (!accepts(jsonType, field->type))
+			return NULL;
+		*memberType = field->type;
+		return field->getMember(*field, frame.object);
+	}
+
+	if (!accepts(jsonType, field->elementType))
+		return NULL;
+	*memberType = field->elementType;
+	return field->addElement(frame.object);
+}
+
+static long long toInteger(const char* str, int length) {
+	long long integer;
+	if (parseInteger(str, length, &integer))
+		return integer;
+
+	// Out of range doubles are clamped.
+	double value = parseDouble(str, length);
+	if (value >= 9223372036854775807.0)
+		return 0x7fffffffffffffffLL;
+	if (value <= -9223372036854775808.0)
+		return -0x7fffffffffffffffLL - 1;
+	if (value != value)
+		return 0;
+	return (long long) value;
+}
+
+/**
+ * The yajl callbacks. The context pointer is the BindingParser.
+ */
+struct BindingCallbacks {
+
+	static int parse_boolean(void * ctx, int boolean) {
+		BindingParser* p = (BindingParser*) ctx;
+		int type;
+		bool* member = (bool*) p->target(FieldBinding::BOOLEAN, &type);
+		if (member)
+			*member = boolean != 0;
+		return 1;
+	}
+
+	static int parse_number(void * ctx, const char * s, unsigned int l) {
+		BindingParser* p = (BindingParser*) ctx;
+		int type;
+		void* member = p->target(FieldBinding::DOUBLE, &type);
+		if (!member)
+			return 1;
+		switch (type) {
+			case FieldBinding::INT:
+				*(int*) member = (int) toInteger(s, l);
+				break;
+			case FieldBinding::INT64:
+				*(long long*) member = toInteger(s, l);
+				break;
+			default:
+				*(double*) member = parseDouble(s, l);
+				break;
+		}
+		return 1;
+	}
+
+	static int parse_string(void * ctx, const unsigned char * stringVal,
+			unsigned int stringLen) {
+		BindingParser* p = (BindingParser*) ctx;
+		int type;
+		String* member = (String*) p->target(FieldBinding::STRING, &type);
+		if (member)
+			*member = String((const char*) stringVal, stringLen);
+		return 1;
+	}
+
+	static int parse_map_key(void * ctx, const unsigned char * stringVal,
+			unsigned int stringLen) {
+		BindingParser* p = (BindingParser*) ctx;
+		BindingParser::Frame& frame = p->mFrames.peek();
+		frame.field = frame.binding->findField((const char*) stringVal,
+				stringLen);
+		return 1;
+	}
+
+	static int parse_start_map(void * ctx) {
+		BindingParser* p = (BindingParser*) ctx;
+		if (p->mFrames.size() == 0) {
+			if (p->mArrayField) {
+				p->skip();
+				return 1;
+			}
+			p->mStarted = true;
+			p->mFrames.push(BindingParser::Frame(p->mBinding, p->mObject,
+					NULL, false));
+			return 1;
+		}
+
+		const BindingParser::Frame& frame = p->mFrames.peek();
+		const FieldBinding* field = frame.field;
+		if (!field || !field->binding) {
+			p->skip();
+			return 1;
+		}
+		void* object;
+		if (frame.isArray)
+			object = field->addElement(frame.object);
+		else if (field->type == FieldBinding::OBJECT)
+			object = field->getMember(*field, frame.object);
+		else {
+			p->skip();
+			return 1;
+		}
+		p->mFrames.push(BindingParser::Frame(field->binding, object, NULL,
+				false));
+		return 1;
+	}
+
+	static int parse_start_array(void * ctx) {
+		BindingParser* p = (BindingParser*) ctx;
+		if (p->mFrames.size() == 0) {
+			if (!p->mArrayField) {
+				p->skip();
+				return 1;
+			}
+			p->mStarted = true;
+			p->mFrames.push(BindingParser::Frame(NULL, p->mObject,
+					p->mArrayField, true));
+			return 1;
+		}
+
+		const BindingParser::Frame& frame = p->mFrames.peek();
+		const FieldBinding* field = frame.field;
+		if (frame.isArray || !field || field->type != FieldBinding::ARRAY) {
+			p->skip();
+			return 1;
+		}
+		p->mFrames.push(BindingParser::Frame(NULL,
+				field->getMember(*field, frame.object), field, true));
+		return 1;
+	}
+
+	static int parse_end(void * ctx) {
+		((BindingParser*) ctx)->mFrames.pop();
+		return 1;
+	}
+
+	// Callbacks while a map or array is skipped, they only follow the
+	// depth.
+
+	static int skip_start(void * ctx) {
+		((BindingParser*) ctx)->mSkipDepth++;
+		return 1;
+	}
+
+	static int skip_end(void * ctx);
+};
+
+// Nulls leave the member unchanged and need no callback.
+static const yajl_callbacks bindingCallbacks = { NULL,
+		BindingCallbacks::parse_boolean, NULL, NULL,
+		BindingCallbacks::parse_number, BindingCallbacks::parse_string,
+		BindingCallbacks::parse_start_map, BindingCallbacks::parse_map_key,
+		BindingCallbacks::parse_end, BindingCallbacks::parse_start_array,
+		BindingCallbacks::parse_end };
+
+// Without string and key callbacks, yajl does not decode the strings
+// of skipped values.
+static const yajl_callbacks skipCallbacks = { NULL, NULL, NULL, NULL, NULL,
+		NULL, BindingCallbacks::skip_start, NULL, BindingCallbacks::skip_end,
+		BindingCallbacks::skip_start, BindingCallbacks::skip_end };
+
+int BindingCallbacks::skip_end(void * ctx) {
+	BindingParser* p = (BindingParser*) ctx;
+	if (--p->mSkipDepth == 0)
+		yajl_set_callbacks(p->mHandle, &bindingCallbacks);
+	return 1;
+}
+
+void BindingParser::skip() {
+	mSkipDepth = 1;
+	yajl_set_callbacks(mHandle, &skipCallbacks);
+}
+
+bool Binding::parse(const unsigned char* jsonText, size_t jsonTextLength,
+		void* object) const {
+	BindingParser parser;
+	return parser.run(this, jsonText, jsonTextLength, object, NULL);
+}
+
+bool Binding::parseArray(const unsigned char* jsonText,
+		size_t jsonTextLength, void* vector, void* (*addElement)(void*)) const {
+	FieldBinding field = makeField("", FieldBinding::ARRAY,
+			FieldBinding::OBJECT, this, addElement);
+	BindingParser parser;
+	return parser.run(this, jsonText, jsonTextLength, vector, &field);
+}
+
+bool BindingParser::run(const Binding* binding,
+		const unsigned char* jsonText, size_t jsonTextLength, void* object,
+		const FieldBinding* arrayField) {
+	mBinding = binding;
+	mObject = object;
+	mArrayField = arrayField;
+	mFrames.clear();
+	mSkipDepth = 0;
+	mStarted = false;
+
+	// The handle and its buffers are kept from the last document.
+	if (mHandle) {
+		yajl_reset(mHandle);
+		yajl_set_callbacks(mHandle, &bindingCallbacks);
+	} else {
+		yajl_parser_config cfg = { 1, 1 };
+		mHandle = yajl_alloc(&bindingCallbacks, &cfg, NULL, this);
+	}
+
+	yajl_status stat = yajl_parse(mHandle, jsonText, jsonTextLength);
+	if (stat == yajl_status_ok || stat == yajl_status_insufficient_data)
+		stat = yajl_parse_complete(mHandle);
+	return stat == yajl_status_ok && mStarted;
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
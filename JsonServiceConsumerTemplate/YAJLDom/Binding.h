@@ -0,0 +1,406 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Binding.h
+ *
+ *  Parses Json directly into C++ structs, without building a document.
+ *
+ *  struct Person {
+ *      MAUtil::String name;
+ *      MAUtil::String company;
+ *  };
+ *
+ *  struct People {
+ *      MAUtil::Vector<Person> people;
+ *  };
+ *
+ *  static const FieldBinding personFields[] = {
+ *      bindField("name", &Person::name),
+ *      bindField("company", &Person::company)
+ *  };
+ *  static const StructBinding<Person> personBinding(personFields);
+ *
+ *  static const FieldBinding peopleFields[] = {
+ *      bindField("people", &People::people, personBinding)
+ *  };
+ *  static const StructBinding<People> peopleBinding(peopleFields);
+ *
+ *  People result;
+ *  peopleBinding.parse(jsonText, jsonTextLength, result);
+ *
+ *  The fields are a table read when parsing, not code generated for
+ *  each struct: bindField() generates the access to each member, and a
+ *  perfect hash of the names, built when the binding is created, finds
+ *  the field of a key. The yajl callbacks are shared by all bindings.
+ *  To parse many documents, keep a BindingParser, which reuses its yajl
+ *  handle:
+ *
+ *  BindingParser parser;
+ *  parser.parse(peopleBinding, jsonText, jsonTextLength, result);
+ */
+
+#ifndef _YAJL_DOM_BINDING_H_
+#define _YAJL_DOM_BINDING_H_
+
+#include <ma.h>
+#include <mastring.h>
+#include <MAUtil/String.h>
+#include <MAUtil/Vector.h>
+#include <MAUtil/Stack.h>
+
+struct yajl_handle_t;
+
+namespace MAUtil {
+namespace YAJLDom {
+
+class Binding;
+
+/**
+ * Any struct, for the size of a pointer to a data member, which is the
+ * same for all structs without virtual bases.
+ */
+struct AnyStruct;
+typedef int AnyStruct::*AnyMemberPointer;
+
+/**
+ * A member of a struct that is set from a key of a Json map.
+ * Created with bindField().
+ */
+struct FieldBinding {
+	enum Type {
+		BOOLEAN,
+		INT,
+		INT64,
+		DOUBLE,
+		STRING,
+		OBJECT,
+		ARRAY
+	};
+
+	const char* name;
+	int nameLength;
+	int type;
+
+	/**
+	 * The type of the elements of an ARRAY member. OBJECT for
+	 * elements that are structs.
+	 */
+	int elementType;
+
+	/**
+	 * The pointer to the member, stored by bindField(), and the
+	 * function generated for its struct and type that applies it.
+	 * \return The member in object.
+	 */
+	char member[sizeof(AnyMemberPointer)];
+	void* (*getMember)(const FieldBinding& field, void* object);
+
+	/**
+	 * The binding of an OBJECT member, or of the elements of an ARRAY
+	 * member that are structs.
+	 */
+	const Binding* binding;
+
+	/**
+	 * Add an element at the end of an ARRAY member.
+	 * \return The new element.
+	 */
+	void* (*addElement)(void* vector);
+};
+
+/**
+ * The FieldBinding type of a member type. Members of other types do
+ * not compile.
+ */
+template<class M> struct FieldType;
+template<> struct FieldType<bool> { enum { TYPE = FieldBinding::BOOLEAN }; };
+template<> struct FieldType<int> { enum { TYPE = FieldBinding::INT }; };
+template<> struct FieldType<long long> { enum { TYPE = FieldBinding::INT64 }; };
+template<> struct FieldType<double> { enum { TYPE = FieldBinding::DOUBLE }; };
+template<> struct FieldType<MAUtil::String> { enum { TYPE = FieldBinding::STRING }; };
+
+FieldBinding makeField(const char* name, int type, int elementType,
+		const Binding* binding, void* (*addElement)(void*));
+
+template<class T, class M>
+void* getMember(const FieldBinding& field, void* object) {
+	M T::*member;
+	memcpy(&member, field.member, sizeof(member));
+	return &(static_cast<T*>(object)->*member);
+}
+
+/**
+ * Store the pointer to the member in field.
+ */
+template<class T, class M>
+FieldBinding bindMember(FieldBinding field, M T::*member) {
+	// Does not compile for structs with larger member pointers.
+	(void) sizeof(char[sizeof(member) == sizeof(field.member) ? 1 : -1]);
+	memcpy(field.member, &member, sizeof(member));
+	field.getMember = getMember<T, M>;
+	return field;
+}
+
+template<class M>
+void* addVectorElement(void* vector) {
+	MAUtil::Vector<M>& elements = *(MAUtil::Vector<M>*) vector;
+	elements.add(M());
+	return &elements[elements.size() - 1];
+}
+
+/**
+ * Parses Json maps into structs of one type, described by a table of
+ * fields. Each key is looked up with a perfect hash of the field names,
+ * so it is hashed once and compared with one name. Keys without a
+ * field, nulls and values of the wrong type are skipped, and leave the
+ * member unchanged. Strings inside skipped maps and arrays are not
+ * decoded. No Values are created.
+ *
+ * Parsing does not change the binding, so one binding can be used by
+ * several threads at the same time. Use StructBinding, which checks
+ * the type of the objects.
+ *
+ * parse() and parseArray() allocate a yajl handle for each call, use
+ * a BindingParser to parse many documents.
+ */
+class Binding {
+public:
+	/**
+	 * \param fields The members of the struct. Not copied, a static
+	 * table is typical. Calls maPanic if a name is repeated.
+	 * \param count The number of fields.
+	 */
+	Binding(const FieldBinding* fields, int count);
+	~Binding();
+
+	/**
+	 * Parse a Json map into a struct.
+	 * \param object A struct of the bound type.
+	 * \return false if the text is not valid Json or not a map.
+	 * Members are set as their keys are read, so the object can be
+	 * partly set after a failure.
+	 */
+	bool parse(const unsigned char* jsonText, size_t jsonTextLength,
+			void* object) const;
+
+	/**
+	 * Parse a Json array of maps into a vector of structs.
+	 * \param addElement Adds a struct at the end of vector.
+	 * \return false if the text is not valid Json or not an array.
+	 * Values in the array that are not maps are skipped.
+	 */
+	bool parseArray(const unsigned char* jsonText, size_t jsonTextLength,
+			void* vector, void* (*addElement)(void*)) const;
+
+	/**
+	 * \return The field for a key, or NULL if there is none.
+	 */
+	const FieldBinding* findField(const char* key, int keyLength) const;
+
+private:
+	bool buildTable(unsigned int seed);
+
+	// Never copied.
+	Binding(const Binding&);
+	Binding& operator=(const Binding&);
+
+	const FieldBinding* mFields;
+	int mCount;
+
+	/**
+	 * Perfect hash table of the field names. Holds the field index
+	 * plus one, 0 for empty slots. The size is a power of two.
+	 */
+	int* mTable;
+	int mTableSize;
+	unsigned int mSeed;
+};
+
+/**
+ * A Binding for structs of type T.
+ */
+template<class T>
+class StructBinding : public Binding {
+public:
+	StructBinding(const FieldBinding* fields, int count) :
+		Binding(fields, count) {
+	}
+
+	template<int N>
+	StructBinding(const FieldBinding (&fields)[N]) :
+		Binding(fields, N) {
+	}
+
+	/**
+	 * Parse a Json map into object, see Binding::parse().
+	 */
+	bool parse(const unsigned char* jsonText, size_t jsonTextLength,
+			T& object) const {
+		return Binding::parse(jsonText, jsonTextLength, &object);
+	}
+
+	/**
+	 * Parse a Json array of maps, adding a T to objects for each map.
+	 * See Binding::parseArray().
+	 */
+	bool parse(const unsigned char* jsonText, size_t jsonTextLength,
+			MAUtil::Vector<T>& objects) const {
+		return parseArray(jsonText, jsonTextLength, &objects,
+				addVectorElement<T>);
+	}
+};
+
+/**
+ * Parses Json with bindings, and keeps the yajl handle and its buffers
+ * from one document to the next. Like a Parser, a BindingParser is used
+ * by one thread at a time; the bindings can be shared.
+ */
+class BindingParser {
+public:
+	BindingParser();
+	~BindingParser();
+
+	/**
+	 * Parse a Json map into object, see Binding::parse().
+	 */
+	template<class T>
+	bool parse(const StructBinding<T>& binding,
+			const unsigned char* jsonText, size_t jsonTextLength,
+			T& object) {
+		return run(&binding, jsonText, jsonTextLength, &object, NULL);
+	}
+
+	/**
+	 * Parse a Json array of maps, adding a T to objects for each map.
+	 * See Binding::parseArray().
+	 */
+	template<class T>
+	bool parse(const StructBinding<T>& binding,
+			const unsigned char* jsonText, size_t jsonTextLength,
+			MAUtil::Vector<T>& objects) {
+		FieldBinding field = makeField("", FieldBinding::ARRAY,
+				FieldBinding::OBJECT, &binding, addVectorElement<T>);
+		return run(&binding, jsonText, jsonTextLength, &objects, &field);
+	}
+
+private:
+	friend class Binding;
+	friend struct BindingCallbacks;
+
+	/**
+	 * An open map or array that values are stored in.
+	 */
+	struct Frame {
+		Frame() {}
+		Frame(const Binding* binding, void* object,
+				const FieldBinding* field, bool isArray) :
+			binding(binding), object(object), field(field),
+			isArray(isArray) {
+		}
+
+		/**
+		 * The binding of the struct a map is stored in, NULL for
+		 * arrays.
+		 */
+		const Binding* binding;
+
+		/**
+		 * The struct or the vector.
+		 */
+		void* object;
+
+		/**
+		 * The field of the current key of a map, NULL if the value is
+		 * skipped. The field of the member an array is stored in.
+		 */
+		const FieldBinding* field;
+
+		bool isArray;
+	};
+
+	bool run(const Binding* binding, const unsigned char* jsonText,
+			size_t jsonTextLength, void* object,
+			const FieldBinding* arrayField);
+	void* target(int jsonType, int* memberType);
+	void skip();
+
+	// Never copied.
+	BindingParser(const BindingParser&);
+	BindingParser& operator=(const BindingParser&);
+
+	const Binding* mBinding;
+	void* mObject;
+
+	/**
+	 * Describes the vector of a parseArray(), NULL for parse().
+	 */
+	const FieldBinding* mArrayField;
+
+	struct yajl_handle_t* mHandle;
+	MAUtil::Stack<Frame> mFrames;
+	int mSkipDepth;
+
+	/**
+	 * The root had the expected type.
+	 */
+	bool mStarted;
+};
+
+/**
+ * Bind a member of type bool, int, long long, double or String.
+ */
+template<class T, class M>
+FieldBinding bindField(const char* name, M T::*member) {
+	return bindMember(makeField(name, FieldType<M>::TYPE, 0, NULL, NULL),
+			member);
+}
+
+/**
+ * Bind a member that is a struct, set from a Json map.
+ */
+template<class T, class M>
+FieldBinding bindField(const char* name, M T::*member,
+		const StructBinding<M>& binding) {
+	return bindMember(makeField(name, FieldBinding::OBJECT, 0, &binding,
+			NULL), member);
+}
+
+/**
+ * Bind a vector of bool, int, long long, double or String, set from a
+ * Json array.
+ */
+template<class T, class M>
+FieldBinding bindField(const char* name, MAUtil::Vector<M> T::*member) {
+	return bindMember(makeField(name, FieldBinding::ARRAY,
+			FieldType<M>::TYPE, NULL, addVectorElement<M>), member);
+}
+
+/**
+ * Bind a vector of structs, set from a Json array of maps.
+ */
+template<class T, class M>
+FieldBinding bindField(const char* name, MAUtil::Vector<M> T::*member,
+		const StructBinding<M>& binding) {
+	return bindMember(makeField(name, FieldBinding::ARRAY,
+			FieldBinding::OBJECT, &binding, addVectorElement<M>), member);
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_BINDING_H_
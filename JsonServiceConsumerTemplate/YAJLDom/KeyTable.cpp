@@ -0,0 +1,143 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * KeyTable.cpp
+ *
+ *  Interning table for map keys and short string values.
+ */
+
+#include "KeyTable.h"
+#include <ma.h>
+#include <maheap.h>
+#include <mastring.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+KeyTable::KeyTable() :
+	mSlots(NULL), mCapacity(0), mSize(0), mMaxStringLength(0),
+	mMaxStringCount(0), mStringCount(0), mArena(1024) {
+}
+
+KeyTable::~KeyTable() {
+	free(mSlots);
+}
+
+unsigned int KeyTable::hash(const char* str, int length) {
+	// FNV-1a
+	unsigned int h = 2166136261u;
+	for (int i = 0; i < length; i++) {
+		h ^= (unsigned char) str[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+int KeyTable::findSlot(const char* str, int length, unsigned int h) const {
+	int mask = mCapacity - 1;
+	int i = h & mask;
+	while (mSlots[i].text) {
+		const Slot& slot = mSlots[i];
+		if (slot.hash == h && slot.length == length
+				&& memcmp(slot.text, str, length) == 0)
+			return i;
+		i = (i + 1) & mask;
+	}
+	// The empty slot where str would go.
+	return i;
+}
+
+void KeyTable::grow() {
+	Slot* oldSlots = mSlots;
+	int oldCapacity = mCapacity;
+
+	mCapacity = mCapacity ? mCapacity * 2 : 64;
+	mSlots = (Slot*) malloc(mCapacity * sizeof(Slot));
+	if (!mSlots)
+		maPanic(1, "YAJLDom::KeyTable, out of memory.");
+	memset(mSlots, 0, mCapacity * sizeof(Slot));
+
+	for (int i = 0; i < oldCapacity; i++) {
+		const Slot& slot = oldSlots[i];
+		if (slot.text)
+			mSlots[findSlot(slot.text, slot.length, slot.hash)] = slot;
+	}
+	free(oldSlots);
+}
+
+const char* KeyTable::intern(const char* str, int length) {
+	// Keep the load factor at or below one half.
+	if ((mSize + 1) * 2 > mCapacity)
+		grow();
+
+	unsigned int h = hash(str, length);
+	Slot& slot = mSlots[findSlot(str, length, h)];
+	if (!slot.text) {
+		slot.text = mArena.copyString(str, length);
+		slot.length = length;
+		slot.hash = h;
+		mSize++;
+	}
+	return slot.text;
+}
+
+const char* KeyTable::find(const char* str, int length) const {
+	if (mSize == 0)
+		return NULL;
+	return mSlots[findSlot(str, length, hash(str, length))].text;
+}
+
+const char* KeyTable::find(const char* str, int length,
+		unsigned int h) const {
+	if (mSize == 0)
+		return NULL;
+	return mSlots[findSlot(str, length, h)].text;
+}
+
+void KeyTable::setStringInterning(int maxLength, int maxCount) {
+	mMaxStringLength = maxLength;
+	mMaxStringCount = maxCount;
+}
+
+const char* KeyTable::internString(const char* str, int length) {
+	if (length > mMaxStringLength)
+		return NULL;
+	if (mStringCount < mMaxStringCount) {
+		int size = mSize;
+		const char* text = intern(str, length);
+		if (mSize != size)
+			mStringCount++;
+		return text;
+	}
+	return find(str, length);
+}
+
+int KeyTable::size() const {
+	return mSize;
+}
+
+void KeyTable::clear() {
+	if (mSlots)
+		memset(mSlots, 0, mCapacity * sizeof(Slot));
+	mSize = 0;
+	mStringCount = 0;
+	mArena.reset();
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
@@ -0,0 +1,135 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * KeyTable.h
+ *
+ *  Interning table for map keys and short string values.
+ */
+
+#ifndef _YAJL_DOM_KEY_TABLE_H_
+#define _YAJL_DOM_KEY_TABLE_H_
+
+#include "Arena.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Maps each distinct string to one shared, null terminated copy.
+ *
+ * Documents that use a KeyTable store their map keys in the table, so
+ * the text of a key that is repeated in many objects is stored once,
+ * and two interned keys are equal only if their pointers are equal.
+ * A table can be shared by several documents and kept between parses
+ * of the same service, so that the keys are only added once. The
+ * table must outlive the documents that use it.
+ *
+ * Short string values can be interned as well, which saves memory for
+ * values that repeat a lot, such as enumerations or company names.
+ *
+ * Lookups with find() do not change the table and can be made from
+ * several threads at the same time, but not while a document that uses
+ * the table is being parsed or modified.
+ */
+class KeyTable {
+public:
+	KeyTable();
+	~KeyTable();
+
+	/**
+	 * \return The shared copy of str, which is added if needed.
+	 */
+	const char* intern(const char* str, int length);
+
+	/**
+	 * \return The shared copy of str, or NULL if it is not in the table.
+	 */
+	const char* find(const char* str, int length) const;
+
+	/**
+	 * Like find(str, length), for callers that keep the hash of str.
+	 * \param h The value of hash(str, length).
+	 */
+	const char* find(const char* str, int length, unsigned int h) const;
+
+	/**
+	 * Intern string values of up to maxLength bytes, in addition to
+	 * keys. At most maxCount string values are added, after which only
+	 * values that are already in the table are shared. This keeps the
+	 * table small when the values turn out to be unique.
+	 * Default is 0, no string values are interned.
+	 */
+	void setStringInterning(int maxLength, int maxCount = 1024);
+
+	/**
+	 * \return The shared copy of a string value, or NULL if it should
+	 * not be interned according to setStringInterning().
+	 */
+	const char* internString(const char* str, int length);
+
+	/**
+	 * \return The number of strings in the table.
+	 */
+	int size() const;
+
+	/**
+	 * Remove all strings. Documents that use the table must be
+	 * cleared first.
+	 */
+	void clear();
+
+	/**
+	 * \return The hash value the table uses for str.
+	 */
+	static unsigned int hash(const char* str, int length);
+
+private:
+	struct Slot {
+		const char* text;
+		int length;
+		unsigned int hash;
+	};
+
+	int findSlot(const char* str, int length, unsigned int hash) const;
+	void grow();
+
+	// Never copied.
+	KeyTable(const KeyTable&);
+	KeyTable& operator=(const KeyTable&);
+
+	/**
+	 * Open addressed hash table, the size is a power of two.
+	 */
+	Slot* mSlots;
+	int mCapacity;
+	int mSize;
+
+	int mMaxStringLength;
+	int mMaxStringCount;
+	int mStringCount;
+
+	/**
+	 * Holds the text of the strings.
+	 */
+	Arena mArena;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_KEY_TABLE_H_
@@ -16,11 +16,232 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 */
 
 #include "MemoryMgr.h"
+#include <mastring.h>
 
-namespace MAPUtil
+namespace YAJLDomUtil
 {
 	#ifdef TRACKOBJECTS
-	Vector<void*> MemoryMgr::mKeys;
-	Vector<Trace> MemoryMgr::mValues;
+	MemoryMgr::Entry* MemoryMgr::mEntries = NULL;
+	int MemoryMgr::mCapacity = 0;
+	int MemoryMgr::mCount = 0;
+	MemoryStats MemoryMgr::mTotal( "total" );
+	Vector<MemoryStats> MemoryMgr::mLabels;
+
+	//
+	// The first size of the table. It grows to keep at most half of
+	// the slots in use, which keeps the probe sequences short.
+	//
+	static const int MIN_CAPACITY = 256;
+
+	static unsigned int hashPointer( void* p )
+	{
+		// The low bits are the same for all aligned pointers.
+		return ( (unsigned int) (size_t) p >> 3 ) * 2654435761u;
+	}
+
+	void MemoryMgr::update( MemoryStats& stats, int objects, int bytes )
+	{
+		stats.objects += objects;
+		stats.bytes += bytes;
+		if ( objects > 0 )
+			stats.created += objects;
+		if ( stats.objects > stats.peakObjects )
+			stats.peakObjects = stats.objects;
+		if ( stats.bytes > stats.peakBytes )
+			stats.peakBytes = stats.bytes;
+	}
+
+	int MemoryMgr::findLabel( const char* label )
+	{
+		// There are few labels, and the same literal is usually passed
+		// for a label, so the pointers are compared first.
+		for ( int i = 0; i < mLabels.size( ); i++ )
+		{
+			if ( mLabels[i].label == label )
+				return i;
+		}
+		for ( int i = 0; i < mLabels.size( ); i++ )
+		{
+			if ( strcmp( mLabels[i].label, label ) == 0 )
+				return i;
+		}
+		mLabels.add( MemoryStats( label ) );
+		return mLabels.size( ) - 1;
+	}
+
+	void MemoryMgr::grow( )
+	{
+		Entry* old = mEntries;
+		int oldCapacity = mCapacity;
+		mCapacity = mCapacity ? mCapacity * 2 : MIN_CAPACITY;
+		mEntries = (Entry*) malloc( mCapacity * sizeof( Entry ) );
+		if ( !mEntries )
+			maPanic( 1, "MemoryMgr, out of memory." );
+		memset( mEntries, 0, mCapacity * sizeof( Entry ) );
+
+		unsigned int mask = mCapacity - 1;
+		for ( int i = 0; i < oldCapacity; i++ )
+		{
+			if ( !old[i].pointer )
+				continue;
+			unsigned int slot = hashPointer( old[i].pointer ) & mask;
+			while ( mEntries[slot].pointer )
+				slot = ( slot + 1 ) & mask;
+			mEntries[slot] = old[i];
+		}
+		free( old );
+	}
+
+	void MemoryMgr::add( void* p, int size, const char* label, int line )
+	{
+		if ( !p )
+			return;
+		if ( ( mCount + 1 ) * 2 > mCapacity )
+			grow( );
+
+		unsigned int mask = mCapacity - 1;
+		unsigned int slot = hashPointer( p ) & mask;
+		while ( mEntries[slot].pointer )
+		{
+			// Memory that was freed without deleteobject can come back.
+			if ( mEntries[slot].pointer == p )
+			{
+				remove( p );
+				add( p, size, label, line );
+				return;
+			}
+			slot = ( slot + 1 ) & mask;
+		}
+
+		Entry& entry = mEntries[slot];
+		entry.pointer = p;
+		entry.size = size;
+		entry.label = findLabel( label );
+		entry.line = line;
+		mCount++;
+		update( mLabels[entry.label], 1, size );
+		update( mTotal, 1, size );
+	}
+
+	void MemoryMgr::remove( void* p )
+	{
+		if ( !p || !mCapacity )
+			return;
+
+		unsigned int mask = mCapacity - 1;
+		unsigned int slot = hashPointer( p ) & mask;
+		while ( mEntries[slot].pointer != p )
+		{
+			// Not tracked, for example created without newobject.
+			if ( !mEntries[slot].pointer )
+				return;
+			slot = ( slot + 1 ) & mask;
+		}
+
+		Entry& entry = mEntries[slot];
+		update( mLabels[entry.label], -1, -entry.size );
+		update( mTotal, -1, -entry.size );
+		mCount--;
+
+		// Move later entries of the probe sequence back into the gap,
+		// so that lookups need no markers for removed entries.
+		unsigned int gap = slot;
+		unsigned int next = ( slot + 1 ) & mask;
+		while ( mEntries[next].pointer )
+		{
+			unsigned int home = hashPointer( mEntries[next].pointer ) & mask;
+			// The entry can move if its home is not after the gap,
+			// counting around the end of the table.
+			if ( ( ( next - home ) & mask ) >= ( ( next - gap ) & mask ) )
+			{
+				mEntries[gap] = mEntries[next];
+				gap = next;
+			}
+			next = ( next + 1 ) & mask;
+		}
+		mEntries[gap].pointer = NULL;
+	}
 	#endif
+
+	void MemoryMgr::dump( int maxObjects )
+	{
+		#ifdef TRACKOBJECTS
+
+		DebugPrintf( "=== Dump: %d objects remaining, %d bytes\n",
+				mTotal.objects, mTotal.bytes );
+		DebugPrintf( "%-20s %10s %10s %10s %10s %10s\n", "label", "objects",
+				"bytes", "peak", "peak bytes", "created" );
+		for ( int i = 0; i < mLabels.size( ); i++ )
+		{
+			const MemoryStats& stats = mLabels[i];
+			DebugPrintf( "%-20s %10d %10d %10d %10d %10d\n", stats.label,
+					stats.objects, stats.bytes, stats.peakObjects,
+					stats.peakBytes, stats.created );
+		}
+		if ( mCount > 0 && mCount <= maxObjects )
+		{
+			for ( int i = 0; i < mCapacity; i++ )
+			{
+				if ( mEntries[i].pointer )
+					DebugPrintf( "   %s:%d\n",
+							mLabels[mEntries[i].label].label,
+							mEntries[i].line );
+			}
+		}
+		DebugPrintf( "=== End dump\n" );
+
+		#endif
+	}
+
+	void MemoryMgr::snapshot( MemorySnapshot& snapshot )
+	{
+		snapshot.labels.clear( );
+		#ifdef TRACKOBJECTS
+		snapshot.total = mTotal;
+		for ( int i = 0; i < mLabels.size( ); i++ )
+			snapshot.labels.add( mLabels[i] );
+		#else
+		snapshot.total = MemoryStats( "total" );
+		#endif
+	}
+
+	int MemoryMgr::printDiff( const MemorySnapshot& before,
+			const MemorySnapshot& after )
+	{
+		#ifdef TRACKOBJECTS
+		// Labels are only ever added, so a label of before has the same
+		// index in after.
+		DebugPrintf( "=== Diff: %+d objects, %+d bytes\n",
+				after.total.objects - before.total.objects,
+				after.total.bytes - before.total.bytes );
+		for ( int i = 0; i < after.labels.size( ); i++ )
+		{
+			const MemoryStats& stats = after.labels[i];
+			int objects = stats.objects;
+			int bytes = stats.bytes;
+			if ( i < before.labels.size( ) )
+			{
+				objects -= before.labels[i].objects;
+				bytes -= before.labels[i].bytes;
+			}
+			if ( objects != 0 )
+				DebugPrintf( "%-20s %+10d objects %+10d bytes\n", stats.label,
+						objects, bytes );
+		}
+		#endif
+		return after.total.bytes - before.total.bytes;
+	}
+
+	void MemoryMgr::resetPeaks( )
+	{
+		#ifdef TRACKOBJECTS
+		mTotal.peakObjects = mTotal.objects;
+		mTotal.peakBytes = mTotal.bytes;
+		for ( int i = 0; i < mLabels.size( ); i++ )
+		{
+			mLabels[i].peakObjects = mLabels[i].objects;
+			mLabels[i].peakBytes = mLabels[i].bytes;
+		}
+		#endif
+	}
 }
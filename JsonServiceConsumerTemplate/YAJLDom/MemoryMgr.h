@@ -32,9 +32,9 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #include <ma.h>
 #include <maheap.h>
 
-#ifdef TRACKOBJECTS
-#include <MAUtil/Map.h>
 #include <MAUtil/Vector.h>
+
+#ifdef TRACKOBJECTS
 //#include "DebugPrintf.h"
 #include <stdio.h>
 #define DebugPrintf printf
@@ -43,19 +43,62 @@ using namespace MAUtil;
 
 namespace YAJLDomUtil
 {
-	struct Trace {
-		Trace() : label(""), line(0) {
+	/**
+	 * Counts of the tracked objects created with one label, which is
+	 * the type given to newobject.
+	 */
+	struct MemoryStats {
+		MemoryStats() : label(""), objects(0), bytes(0), peakObjects(0),
+			peakBytes(0), created(0) {
 		}
-		Trace(const char* label, int line) : label(label), line(line) {
+		MemoryStats(const char* label) : label(label), objects(0), bytes(0),
+			peakObjects(0), peakBytes(0), created(0) {
 		}
 
 		const char* label;
-		int line;
+
+		/**
+		 * Live objects and their size, and the most there have been
+		 * since tracking started or the peaks were reset.
+		 */
+		int objects;
+		int bytes;
+		int peakObjects;
+		int peakBytes;
+
+		/**
+		 * All objects created, live or not.
+		 */
+		int created;
+	};
+
+	/**
+	 * The counts of all labels at one point, see MemoryMgr::snapshot().
+	 * Empty unless TRACKOBJECTS is defined.
+	 */
+	struct MemorySnapshot {
+		MemoryStats total;
+		MAUtil::Vector<MemoryStats> labels;
 	};
 
 	//=========================================================================
 	/**
 	 * \brief Simple resource tracking class.
+	 *
+	 * With TRACKOBJECTS defined, every object created with newobject
+	 * is kept in a hash table until deleteobject is called, so both
+	 * take constant time however many objects are live. Counts are
+	 * kept for each label. Comparing two snapshots shows which types
+	 * of objects a piece of code leaves behind:
+	 *
+	 *   MemorySnapshot before, after;
+	 *   MemoryMgr::snapshot( before );
+	 *   runLoadTest( );
+	 *   MemoryMgr::snapshot( after );
+	 *   if ( MemoryMgr::printDiff( before, after ) > 0 ) ...
+	 *
+	 * Not thread safe, objects must be tracked on one thread.
+	 * Without TRACKOBJECTS nothing is tracked and the counts are zero.
 	 */
 	class MemoryMgr
 	//=========================================================================
@@ -68,8 +111,7 @@ namespace YAJLDomUtil
 		static T* track( T* p, const char* label, int line )
 		{
 			#ifdef TRACKOBJECTS
-			mKeys.add( p );
-			mValues.add( Trace(label, line) );
+			add( p, sizeof( T ), label, line );
 			#endif
 			return p;
 		}
@@ -79,38 +121,59 @@ namespace YAJLDomUtil
 		static void untrack( void* p )
 		{
 			#ifdef TRACKOBJECTS
-			for ( int i = 0; i < mKeys.size( ); i++ )
-			{
-				if ( mKeys[i] == p )
-				{
-					mKeys.remove( i );
-					mValues.remove( i );
-					return;
-				}
-			}
+			remove( p );
 			#endif
 		}
 		/**
-		 * Prints a list of currently tracked objects.
+		 * Prints the counts of each label, and the place each remaining
+		 * object was created if there are at most maxObjects of them.
 		 */
-		static void dump( )
-		{
-			#ifdef TRACKOBJECTS
+		static void dump( int maxObjects = 0 );
 
-			int count = mKeys.size( );
-			DebugPrintf( "=== Dump: %d objects remaining\n", count );
-			//for ( int i = 0; i < count; i++ )
-			//	DebugPrintf( "   %s:%d\n", mValues[i].label, mValues[i].line);
-			//DebugPrintf( "=== End dump: %d objects remaining\n", count );
+		/**
+		 * Copies the current counts.
+		 */
+		static void snapshot( MemorySnapshot& snapshot );
 
-			#endif
+		/**
+		 * Prints the labels whose live objects changed between two
+		 * snapshots.
+		 * \return The number of bytes more that were live in after,
+		 * negative if fewer.
+		 */
+		static int printDiff( const MemorySnapshot& before,
+				const MemorySnapshot& after );
 
-		}
+		/**
+		 * Sets the peaks to the current counts, to find the peaks of
+		 * the following code.
+		 */
+		static void resetPeaks( );
 
 	private:
 		#ifdef TRACKOBJECTS
-		static Vector<void*> mKeys;
-		static Vector<Trace> mValues;
+		/**
+		 * A tracked object. The table is open-addressed, a free slot
+		 * has no pointer.
+		 */
+		struct Entry {
+			void* pointer;
+			int size;
+			int label;
+			int line;
+		};
+
+		static void add( void* p, int size, const char* label, int line );
+		static void remove( void* p );
+		static int findLabel( const char* label );
+		static void grow( );
+		static void update( MemoryStats& stats, int objects, int bytes );
+
+		static Entry* mEntries;
+		static int mCapacity;
+		static int mCount;
+		static MemoryStats mTotal;
+		static Vector<MemoryStats> mLabels;
 		#endif
 	};
 
@@ -0,0 +1,142 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Number.cpp
+ *
+ *  Conversions between Json number text and numbers.
+ */
+
+#include "Number.h"
+#include <mastring.h>
+#include <mastdlib.h>
+#include <MAUtil/util.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+bool parseInteger(const char* str, int length, long long* result) {
+	const char* end = str + length;
+	bool negative = str < end && *str == '-';
+	if (negative)
+		str++;
+	if (str == end || end - str > 19)
+		return false;
+
+	// 19 digits fit in an unsigned 64 bit integer.
+	unsigned long long value = 0;
+	for (; str < end; str++) {
+		unsigned int digit = *str - '0';
+		if (digit > 9)
+			return false;
+		value = value * 10 + digit;
+	}
+
+	const unsigned long long max = 0x7fffffffffffffffULL;
+	if (value > max + (negative ? 1 : 0))
+		return false;
+	*result = negative ? (long long) (0 - value) : (long long) value;
+	return true;
+}
+
+// Powers of ten that are exact as doubles.
+static const double sPowersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/**
+ * Convert the text of a Json number to a double without allocating.
+ * Numbers with at most 15 significant digits and a small exponent,
+ * which is nearly all numbers in practice, are computed exactly with
+ * one multiplication or division, since both operands are exact
+ * doubles. Others are converted with strtod.
+ */
+double parseDouble(const char* str, int length) {
+	const char* p = str;
+	const char* end = str + length;
+	bool negative = p < end && *p == '-';
+	if (negative)
+		p++;
+
+	unsigned long long mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		mantissa = mantissa * 10 + (*p - '0');
+		if (mantissa)
+			digits++;
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+			mantissa = mantissa * 10 + (*p - '0');
+			if (mantissa)
+				digits++;
+			exponent--;
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negativeExponent = p < end && *p == '-';
+		if (p < end && (*p == '-' || *p == '+'))
+			p++;
+		int e = 0;
+		for (; p < end && *p >= '0' && *p <= '9'; p++)
+			if (e < 10000)
+				e = e * 10 + (*p - '0');
+		exponent += negativeExponent ? -e : e;
+	}
+
+	if (digits <= 15 && exponent >= -22 && exponent <= 22) {
+		double value = (double) mantissa;
+		if (exponent < 0)
+			value /= sPowersOfTen[-exponent];
+		else
+			value *= sPowersOfTen[exponent];
+		return negative ? -value : value;
+	}
+
+	// strtod needs a null terminated copy.
+	char buffer[64];
+	if (length < (int) sizeof(buffer)) {
+		memcpy(buffer, str, length);
+		buffer[length] = 0;
+		return strtod(buffer, NULL);
+	}
+	return stringToDouble(String(str, length));
+}
+
+int formatInteger(long long value, char* buffer) {
+	char digits[20];
+	int count = 0;
+	unsigned long long magnitude = value < 0 ? 0 - (unsigned long long) value
+			: (unsigned long long) value;
+	do {
+		digits[count++] = '0' + (int) (magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	int length = 0;
+	if (value < 0)
+		buffer[length++] = '-';
+	while (count)
+		buffer[length++] = digits[--count];
+	return length;
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
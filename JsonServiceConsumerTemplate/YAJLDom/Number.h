@@ -0,0 +1,53 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Number.h
+ *
+ *  Conversions between Json number text and numbers, shared by the
+ *  document and the struct bindings.
+ */
+
+#ifndef _YAJL_DOM_NUMBER_H_
+#define _YAJL_DOM_NUMBER_H_
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Parse the text of an integer.
+ * \return false if the number is not an integer or does not fit in
+ * 64 bits.
+ */
+bool parseInteger(const char* str, int length, long long* result);
+
+/**
+ * Convert the text of a Json number to a double without allocating.
+ */
+double parseDouble(const char* str, int length);
+
+/**
+ * Write an integer as text.
+ * \param buffer At least 21 characters.
+ * \return The length of the text, which is not null terminated.
+ */
+int formatInteger(long long value, char* buffer);
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_NUMBER_H_
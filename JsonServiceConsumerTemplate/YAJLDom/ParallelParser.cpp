@@ -0,0 +1,303 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * ParallelParser.cpp
+ *
+ *  Parses the elements of a large top-level array in parts that can
+ *  run on several threads.
+ */
+
+#include "ParallelParser.h"
+#include "MemoryMgr.h"
+#include <mastring.h>
+
+using namespace YAJLDomUtil;
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Arrays shorter than this are not split, the threads would cost more
+ * than they save.
+ */
+static const int MIN_PART_LENGTH = 16 * 1024;
+
+static bool isSpace(unsigned char c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+TaskRunner::~TaskRunner() {
+}
+
+ParallelParser::ParallelParser(Document& document) :
+	mDocument(document), mRunner(NULL), mPartCount(1) {
+	memset(mClasses, OTHER, sizeof(mClasses));
+	mClasses['"'] = QUOTE;
+	mClasses['/'] = SLASH;
+	mClasses['['] = OPEN;
+	mClasses['{'] = OPEN;
+	mClasses[']'] = CLOSE;
+	mClasses['}'] = CLOSE;
+	mClasses[','] = COMMA;
+}
+
+ParallelParser::~ParallelParser() {
+	for (int i = 0; i < mDocuments.size(); i++)
+		deleteobject(mDocuments[i]);
+}
+
+void ParallelParser::setTaskRunner(TaskRunner* runner, int parts) {
+	mRunner = runner;
+	mPartCount = parts > 1 ? parts : 1;
+}
+
+const NodeCounts& ParallelParser::getNodeCounts() const {
+	return mCounts;
+}
+
+Value* ParallelParser::parseSerially(const unsigned char* jsonText,
+		size_t jsonTextLength) {
+	// The parts do not intern keys, so neither does this, and the tree
+	// is the same whichever way the text was parsed.
+	KeyTable* keys = mDocument.getKeyTable();
+	mDocument.setKeyTable(NULL);
+	Parser parser(mDocument);
+	Value* root = parser.parse(jsonText, jsonTextLength);
+	mCounts = parser.getNodeCounts();
+	mDocument.setKeyTable(keys);
+	return root;
+}
+
+Value* ParallelParser::parse(const unsigned char* jsonText,
+		size_t jsonTextLength) {
+	if (!split(jsonText, jsonTextLength))
+		return parseSerially(jsonText, jsonTextLength);
+
+	// The parts allocate their own blocks, which are moved to the
+	// document, so the blocks the document holds would not be reused.
+	mDocument.clear();
+	mDocument.getArena().release();
+
+	while (mDocuments.size() < mParts.size())
+		mDocuments.add(newobject(Document, new Document()));
+	Vector<void*> tasks;
+	for (int i = 0; i < mParts.size(); i++) {
+		mParts[i].document = mDocuments[i];
+		mParts[i].target = &mDocument.getArena();
+		tasks.add(&mParts[i]);
+	}
+
+	if (mRunner) {
+		mRunner->run(parsePart, tasks.pointer(), tasks.size());
+	} else {
+		for (int i = 0; i < tasks.size(); i++)
+			parsePart(tasks[i]);
+	}
+
+	// A part that fails, or has no elements because of a comma too
+	// many, means the text is not valid. Let a Parser report it.
+	for (int i = 0; i < mParts.size(); i++) {
+		if (!mParts[i].root || mParts[i].root->getNumChildValues() == 0) {
+			for (int k = 0; k < mParts.size(); k++)
+				mParts[k].document->clear();
+			return parseSerially(jsonText, jsonTextLength);
+		}
+	}
+
+	ArrayValue* array = mDocument.createArray();
+	mCounts = NodeCounts();
+	mCounts.arrays = 1;
+	for (int i = 0; i < mParts.size(); i++) {
+		Part& part = mParts[i];
+		mDocument.getArena().adopt(part.document->getArena());
+		part.document->setRoot(NULL);
+
+		Value* root = part.root;
+		for (int k = 0; k < root->getNumChildValues(); k++)
+			array->addValue(root->getValueByIndex(k));
+
+		// Each part has an array of its own around its elements.
+		const NodeCounts& counts = part.counts;
+		mCounts.nulls += counts.nulls;
+		mCounts.booleans += counts.booleans;
+		mCounts.numbers += counts.numbers;
+		mCounts.strings += counts.strings;
+		mCounts.maps += counts.maps;
+		mCounts.arrays += counts.arrays - 1;
+	}
+	mDocument.setRoot(array);
+	return array;
+}
+
+/**
+ * Parse the elements of a part as an array of their own.
+ */
+void ParallelParser::parsePart(void* data) {
+	Part* part = (Part*) data;
+	Parser parser(*part->document);
+	parser.feed((const unsigned char*) "[", 1);
+	parser.feed(part->text, part->length);
+	parser.feed((const unsigned char*) "]", 1);
+	part->root = parser.finish();
+	part->counts = parser.getNodeCounts();
+
+	// The containers remember the arena to grow in, which will be the
+	// arena of the target document.
+	if (part->root)
+		setStorageArena(part->root, part->target);
+}
+
+void ParallelParser::setStorageArena(Value* value, Arena* arena) {
+	if (value->mType != Value::MAP && value->mType != Value::ARRAY)
+		return;
+	value->mData.storage->arena = arena;
+	Value** items = value->getItems();
+	for (int i = 0; i < value->mSize; i++)
+		setStorageArena(items[i], arena);
+}
+
+/**
+ * Split the elements of the array into parts of about the same length,
+ * at the commas found by scan().
+ * \return false if the text is not split, it is then parsed serially.
+ */
+bool ParallelParser::split(const unsigned char* jsonText, int length) {
+	mParts.clear();
+	mCommas.clear();
+	int parts = mPartCount;
+	if (length / MIN_PART_LENGTH < parts)
+		parts = length / MIN_PART_LENGTH;
+
+	int open, close;
+	if (parts < 2 || !scan(jsonText, length, open, close))
+		return false;
+
+	int start = open + 1;
+	int comma = 0;
+	for (int i = 1; i <= parts && start < close; i++) {
+		int end = close;
+		if (i < parts) {
+			int target = open + (int) ((long long) (close - open) * i / parts);
+			while (comma < mCommas.size() && mCommas[comma] < target)
+				comma++;
+			if (comma < mCommas.size())
+				end = mCommas[comma++];
+		}
+
+		Part part;
+		part.text = jsonText + start;
+		part.length = end - start;
+		part.root = NULL;
+		mParts.add(part);
+		start = end + 1;
+	}
+	return mParts.size() > 1;
+}
+
+/**
+ * \return The offset of the quote that ends a string starting at
+ * start, or length if there is none.
+ */
+static int findStringEnd(const unsigned char* jsonText, int start,
+		int length) {
+	int i = start;
+	for (;;) {
+		const unsigned char* quote = (const unsigned char*) memchr(
+				jsonText + i, '"', length - i);
+		if (!quote)
+			return length;
+		i = quote - jsonText;
+
+		// The quote is escaped if an odd number of backslashes are in
+		// front of it.
+		int backslashes = 0;
+		while (i - backslashes > start
+				&& jsonText[i - backslashes - 1] == '\\')
+			backslashes++;
+		if (backslashes % 2 == 0)
+			return i;
+		i++;
+	}
+}
+
+/**
+ * Find the brackets of a top-level array and the commas between its
+ * elements, following strings and comments.
+ * \return false if the text does not look like an array with nothing
+ * but white space around it.
+ */
+bool ParallelParser::scan(const unsigned char* jsonText, int length,
+		int& open, int& close) {
+	int i = 0;
+	while (i < length && isSpace(jsonText[i]))
+		i++;
+	if (i == length || jsonText[i] != '[')
+		return false;
+	open = i;
+
+	const unsigned char* classes = mClasses;
+	int depth = 0;
+	for (; i < length; i++) {
+		// Most characters need no attention.
+		while (i < length && classes[jsonText[i]] == OTHER)
+			i++;
+		if (i == length)
+			break;
+
+		switch (classes[jsonText[i]]) {
+			case QUOTE:
+				i = findStringEnd(jsonText, i + 1, length);
+				break;
+
+			case SLASH:
+				if (i + 1 < length && jsonText[i + 1] == '*') {
+					for (i += 2; i + 1 < length; i++)
+						if (jsonText[i] == '*' && jsonText[i + 1] == '/')
+							break;
+					i++;
+				} else if (i + 1 < length && jsonText[i + 1] == '/') {
+					while (i < length && jsonText[i] != '\n')
+						i++;
+				}
+				break;
+
+			case OPEN:
+				depth++;
+				break;
+
+			case CLOSE:
+				if (--depth == 0) {
+					close = i;
+					for (i++; i < length; i++)
+						if (!isSpace(jsonText[i]))
+							return false;
+					return true;
+				}
+				break;
+
+			case COMMA:
+				if (depth == 1)
+					mCommas.add(i);
+				break;
+		}
+	}
+	return false;
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
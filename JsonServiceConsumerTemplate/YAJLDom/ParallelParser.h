@@ -0,0 +1,164 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * ParallelParser.h
+ *
+ *  Parses the elements of a large top-level array in parts that can
+ *  run on several threads.
+ */
+
+#ifndef _YAJL_DOM_PARALLEL_PARSER_H_
+#define _YAJL_DOM_PARALLEL_PARSER_H_
+
+#include <MAUtil/Vector.h>
+
+#include "YAJLDom.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Runs the parts of a parallel parse. YAJLDom does not create threads
+ * itself, a runner lets each task run on a thread of its own or of a
+ * pool, and returns when all of them are done.
+ */
+class TaskRunner {
+public:
+	typedef void (*Task)(void* data);
+
+	virtual ~TaskRunner();
+
+	/**
+	 * Call task once for each of the count pointers in data, in any
+	 * order and at the same time if possible. Return when all calls
+	 * have returned.
+	 */
+	virtual void run(Task task, void* const* data, int count) = 0;
+};
+
+/**
+ * Parses Json text that is an array into a document, splitting the
+ * elements into parts that are parsed at the same time:
+ *
+ *   ParallelParser parser(document);
+ *   parser.setTaskRunner(&threads, 4);
+ *   parser.parse(jsonText, jsonTextLength);
+ *
+ * A scan of the text finds the commas between the elements of the
+ * array, following strings, escapes and comments but not checking the
+ * syntax. Each part is then parsed into a document of its own, and the
+ * blocks of those documents are moved into the target document, where
+ * the elements are collected in one ArrayValue. The result has the
+ * same values as a Parser would build.
+ *
+ * Text that is not an array, or is too short to split, is parsed with
+ * a Parser on the calling thread. So is text where a part fails, so
+ * that errors are reported as usual. The keys of the maps are not
+ * interned, since a KeyTable cannot be shared by several threads, and
+ * the key table of the document is not used by the serial parse
+ * either.
+ */
+class ParallelParser {
+public:
+	/**
+	 * \param document Receives the values, and is cleared when a parse
+	 * starts.
+	 */
+	ParallelParser(Document& document);
+	~ParallelParser();
+
+	/**
+	 * \param runner Runs the parts, or NULL to run them one after the
+	 * other on the calling thread, which is the default. Not copied.
+	 * \param parts The number of parts to split arrays into, typically
+	 * the number of threads.
+	 */
+	void setTaskRunner(TaskRunner* runner, int parts);
+
+	/**
+	 * Parse Json text into the document.
+	 * \return The root, or NULL if the text is not valid Json.
+	 */
+	Value* parse(const unsigned char* jsonText, size_t jsonTextLength);
+
+	/**
+	 * \return The number of values of each type in the last document.
+	 */
+	const NodeCounts& getNodeCounts() const;
+
+private:
+	/**
+	 * A range of elements of the array, parsed by one task.
+	 */
+	struct Part {
+		const unsigned char* text;
+		int length;
+		Document* document;
+		Arena* target;
+		Value* root;
+		NodeCounts counts;
+	};
+
+	bool split(const unsigned char* jsonText, int length);
+	bool scan(const unsigned char* jsonText, int length, int& open,
+			int& close);
+	Value* parseSerially(const unsigned char* jsonText,
+			size_t jsonTextLength);
+	static void parsePart(void* data);
+	static void setStorageArena(Value* value, Arena* arena);
+
+	// Never copied.
+	ParallelParser(const ParallelParser&);
+	ParallelParser& operator=(const ParallelParser&);
+
+	Document& mDocument;
+	TaskRunner* mRunner;
+	int mPartCount;
+
+	/**
+	 * The parts of the current parse, and one document for each part,
+	 * kept for the next parse.
+	 */
+	MAUtil::Vector<Part> mParts;
+	MAUtil::Vector<Document*> mDocuments;
+
+	/**
+	 * The offsets of the commas between the elements of the array.
+	 */
+	MAUtil::Vector<int> mCommas;
+
+	/**
+	 * What scan() does with each character.
+	 */
+	enum CharacterClass {
+		OTHER,
+		QUOTE,
+		SLASH,
+		OPEN,
+		CLOSE,
+		COMMA
+	};
+	unsigned char mClasses[256];
+
+	NodeCounts mCounts;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_PARALLEL_PARSER_H_
@@ -0,0 +1,741 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Patch.cpp
+ *
+ *  Json Patch (RFC 6902): the differences between two document trees,
+ *  as operations that can be applied to a tree.
+ */
+
+#include "Patch.h"
+#include "Number.h"
+#include "Shape.h"
+#include <mastring.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * The smallest hash table, in entries.
+ */
+static const int MIN_HASHES = 64;
+
+/**
+ * The names of the operations, in the order of Operation::Type.
+ */
+static const char* const sOperationNames[] = {
+	"add", "remove", "replace", "move", "copy", "test"
+};
+static const int OPERATION_COUNT = 6;
+
+/**
+ * Used for a missing target of diff().
+ */
+static NullValue sNull;
+
+/**
+ * Scramble the bits of a hash, the finalizer of SplitMix64.
+ */
+static unsigned long long mix(unsigned long long hash) {
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebULL;
+	hash ^= hash >> 31;
+	return hash;
+}
+
+/**
+ * FNV-1a over the bytes of a string or key.
+ */
+static unsigned long long hashBytes(const char* str, int length) {
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for (int i = 0; i < length; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+/**
+ * \return The hash of a value that is not a container. Numbers are
+ * hashed by value, so 1 and 1.0 are equal.
+ */
+static unsigned long long hashScalar(const Value* value) {
+	unsigned long long hash = 0;
+	switch (value->getType()) {
+		case Value::BOOLEAN:
+			hash = value->toBoolean();
+			break;
+
+		case Value::NUMBER: {
+			long long integer;
+			if (value->tryGetInt64(integer)) {
+				hash = integer;
+				break;
+			}
+			double number = value->toDouble();
+			memcpy(&hash, &number, sizeof(hash));
+		}
+		break;
+
+		case Value::STRING:
+			hash = hashBytes(value->getString(), value->getStringLength());
+			break;
+
+		default:
+			break;
+	}
+	return mix(hash + value->getType() * 0x9e3779b97f4a7c15ULL);
+}
+
+static unsigned int hashAddress(const Value* value) {
+	return (unsigned int) ((size_t) value >> 3) * 2654435761u;
+}
+
+Patch::Patch() :
+	mHashCount(0) {
+}
+
+Patch::~Patch() {
+}
+
+int Patch::getOperationCount() const {
+	return mOperations.size();
+}
+
+const Patch::Operation& Patch::getOperation(int index) const {
+	if (index < 0 || index >= mOperations.size())
+		maPanic(1, "YAJLDom::Patch::getOperation, index out of range.");
+	return mOperations[index];
+}
+
+void Patch::addOperation(const Operation& operation) {
+	mOperations.add(operation);
+}
+
+void Patch::clear() {
+	mOperations.clear();
+}
+
+void Patch::diff(const Value* from, const Value* to) {
+	mOperations.clear();
+	mPath.clear();
+	if (!to)
+		to = &sNull;
+	if (!from) {
+		add(Operation::ADD, to);
+		return;
+	}
+
+	// Empty the hash table, keeping its room.
+	for (int i = 0; i < mHashes.size(); i++)
+		mHashes[i].value = NULL;
+	mHashCount = 0;
+
+	hashTree(from);
+	hashTree(to);
+	diffValues(from, to);
+}
+
+/**
+ * Hash a value and, if it is a container, everything in it, storing
+ * the hashes of the containers.
+ */
+unsigned long long Patch::hashTree(const Value* value) {
+	unsigned long long hash;
+	switch (value->mType) {
+		case Value::MAP: {
+			// The entries are added up, so their order does not count.
+			hash = value->mSize;
+			const ShapeKey* keys = value->mSize ?
+					value->getShape()->getKeys() : NULL;
+			Value** items = value->getItems();
+			for (int i = 0; i < value->mSize; i++)
+				hash += mix(hashBytes(keys[i].key, keys[i].keyLength)
+						+ mix(hashTree(items[i])));
+		}
+		break;
+
+		case Value::ARRAY: {
+			hash = value->mSize;
+			Value** items = value->getItems();
+			for (int i = 0; i < value->mSize; i++)
+				hash = mix(hash ^ hashTree(items[i]));
+		}
+		break;
+
+		default:
+			return hashScalar(value);
+	}
+
+	hash = mix(hash + value->mType * 0x9e3779b97f4a7c15ULL);
+	storeHash(value, hash);
+	return hash;
+}
+
+/**
+ * \return The hash of a value, looked up for the containers hashed by
+ * hashTree().
+ */
+unsigned long long Patch::getHash(const Value* value) const {
+	if (value->mType != Value::MAP && value->mType != Value::ARRAY)
+		return hashScalar(value);
+
+	int mask = mHashes.size() - 1;
+	int slot = hashAddress(value) & mask;
+	while (mHashes[slot].value != value)
+		slot = (slot + 1) & mask;
+	return mHashes[slot].hash;
+}
+
+void Patch::storeHash(const Value* value, unsigned long long hash) {
+	// Keep the table at most half full.
+	if ((mHashCount + 1) * 2 > mHashes.size())
+		growHashes();
+
+	int mask = mHashes.size() - 1;
+	int slot = hashAddress(value) & mask;
+	while (mHashes[slot].value && mHashes[slot].value != value)
+		slot = (slot + 1) & mask;
+	if (!mHashes[slot].value)
+		mHashCount++;
+	mHashes[slot].value = value;
+	mHashes[slot].hash = hash;
+}
+
+void Patch::growHashes() {
+	Vector<HashEntry> old(mHashes);
+	int size = mHashes.size() ? mHashes.size() * 2 : MIN_HASHES;
+	mHashes.resize(size);
+	for (int i = 0; i < size; i++)
+		mHashes[i].value = NULL;
+
+	int mask = size - 1;
+	for (int i = 0; i < old.size(); i++) {
+		if (!old[i].value)
+			continue;
+		int slot = hashAddress(old[i].value) & mask;
+		while (mHashes[slot].value)
+			slot = (slot + 1) & mask;
+		mHashes[slot] = old[i];
+	}
+}
+
+/**
+ * \return true if diff() takes two values to be equal: maps and arrays
+ * when their hashes are, other values when they are.
+ */
+bool Patch::sameValues(const Value* a, const Value* b) const {
+	if ((a->mType == Value::MAP || a->mType == Value::ARRAY)
+			&& a->mType == b->mType)
+		return getHash(a) == getHash(b);
+	return equalValues(a, b);
+}
+
+void Patch::diffValues(const Value* from, const Value* to) {
+	if (sameValues(from, to))
+		return;
+	if (from->mType != to->mType
+			|| (from->mType != Value::MAP && from->mType != Value::ARRAY)) {
+		add(Operation::REPLACE, to);
+		return;
+	}
+	if (from->mType == Value::MAP)
+		diffMaps(from, to);
+	else
+		diffArrays(from, to);
+}
+
+void Patch::diffMaps(const Value* from, const Value* to) {
+	int length = mPath.size();
+	Value** fromItems = from->getItems();
+	Value** toItems = to->getItems();
+
+	// Removed and changed entries, in the order of from.
+	for (int i = 0; i < from->mSize; i++) {
+		const ShapeKey& key = from->getShape()->getKeys()[i];
+		int k = to->findKey(key.key, key.keyLength);
+		pushKey(key.key, key.keyLength);
+		if (k < 0)
+			add(Operation::REMOVE, NULL);
+		else
+			diffValues(fromItems[i], toItems[k]);
+		mPath.resize(length);
+	}
+
+	// Added entries, in the order of to.
+	for (int i = 0; i < to->mSize; i++) {
+		const ShapeKey& key = to->getShape()->getKeys()[i];
+		if (from->findKey(key.key, key.keyLength) >= 0)
+			continue;
+		pushKey(key.key, key.keyLength);
+		add(Operation::ADD, toItems[i]);
+		mPath.resize(length);
+	}
+}
+
+void Patch::diffArrays(const Value* from, const Value* to) {
+	int length = mPath.size();
+	Value** fromItems = from->getItems();
+	Value** toItems = to->getItems();
+
+	// Skip the equal elements at both ends.
+	int start = 0;
+	while (start < from->mSize && start < to->mSize
+			&& sameValues(fromItems[start], toItems[start]))
+		start++;
+	int fromEnd = from->mSize;
+	int toEnd = to->mSize;
+	while (fromEnd > start && toEnd > start
+			&& sameValues(fromItems[fromEnd - 1], toItems[toEnd - 1])) {
+		fromEnd--;
+		toEnd--;
+	}
+
+	// Patch the elements in between that both arrays have.
+	int common = fromEnd - start < toEnd - start ? fromEnd - start
+			: toEnd - start;
+	for (int i = start; i < start + common; i++) {
+		pushIndex(i);
+		diffValues(fromItems[i], toItems[i]);
+		mPath.resize(length);
+	}
+
+	// Remove the rest from the end, so that the earlier indexes hold,
+	// or add the rest from the start.
+	for (int i = fromEnd - 1; i >= start + common; i--) {
+		pushIndex(i);
+		add(Operation::REMOVE, NULL);
+		mPath.resize(length);
+	}
+	for (int i = start + common; i < toEnd; i++) {
+		pushIndex(i);
+		add(Operation::ADD, toItems[i]);
+		mPath.resize(length);
+	}
+}
+
+void Patch::pushKey(const char* key, int keyLength) {
+	mPath.add('/');
+	for (int i = 0; i < keyLength; i++) {
+		if (key[i] == '~') {
+			mPath.add('~');
+			mPath.add('0');
+		} else if (key[i] == '/') {
+			mPath.add('~');
+			mPath.add('1');
+		} else {
+			mPath.add(key[i]);
+		}
+	}
+}
+
+void Patch::pushIndex(int index) {
+	char buffer[32];
+	int length = formatInteger(index, buffer);
+	mPath.add('/');
+	mPath.add(buffer, length);
+}
+
+/**
+ * Add an operation on the current path.
+ */
+void Patch::add(Operation::Type type, const Value* value) {
+	Operation operation;
+	operation.type = type;
+	if (mPath.size())
+		operation.path = String(mPath.pointer(), mPath.size());
+	operation.value = value;
+	mOperations.add(operation);
+}
+
+bool Patch::read(const Value* patch) {
+	clear();
+	if (!patch || patch->mType != Value::ARRAY)
+		return false;
+
+	Value** items = patch->getItems();
+	for (int i = 0; i < patch->mSize; i++) {
+		const Value* entry = items[i];
+		const Value* op = entry->getValueForKey("op", 2);
+		const Value* path = entry->getValueForKey("path", 4);
+		if (op->mType != Value::STRING || path->mType != Value::STRING) {
+			clear();
+			return false;
+		}
+
+		Operation operation;
+		int type = 0;
+		while (type < OPERATION_COUNT
+				&& (strlen(sOperationNames[type]) != (size_t) op->mSize
+				|| memcmp(sOperationNames[type], op->mData.string, op->mSize)))
+			type++;
+		operation.type = (Operation::Type) type;
+		operation.path = String(path->mData.string, path->mSize);
+		operation.value = NULL;
+
+		bool valid = type < OPERATION_COUNT;
+		if (type == Operation::MOVE || type == Operation::COPY) {
+			const Value* from = entry->getValueForKey("from", 4);
+			valid = from->mType == Value::STRING;
+			if (valid)
+				operation.from = String(from->mData.string, from->mSize);
+		} else if (type == Operation::ADD || type == Operation::REPLACE
+				|| type == Operation::TEST) {
+			// The value can be null, but not missing.
+			int k = entry->findKey("value", 5);
+			valid = k >= 0;
+			if (valid)
+				operation.value = entry->getItems()[k];
+		}
+		if (!valid) {
+			clear();
+			return false;
+		}
+		mOperations.add(operation);
+	}
+	return true;
+}
+
+void Patch::write(Writer& writer) const {
+	writer.write('[');
+	for (int i = 0; i < mOperations.size(); i++) {
+		const Operation& operation = mOperations[i];
+		const char* name = sOperationNames[operation.type];
+		if (i)
+			writer.write(',');
+		writer.write("{\"op\":", 6);
+		serializeString(name, strlen(name), writer);
+		writer.write(",\"path\":", 8);
+		serializeString(operation.path.c_str(), operation.path.length(),
+				writer);
+		if (operation.type == Operation::MOVE
+				|| operation.type == Operation::COPY) {
+			writer.write(",\"from\":", 8);
+			serializeString(operation.from.c_str(), operation.from.length(),
+					writer);
+		}
+		if (operation.value) {
+			writer.write(",\"value\":", 9);
+			serialize(operation.value, writer);
+		}
+		writer.write('}');
+	}
+	writer.write(']');
+	writer.flush();
+}
+
+bool Patch::apply(Document& document) const {
+	Value* root = document.getRoot();
+	bool success = applyOperations(root, &document, false);
+	document.setRoot(root);
+	return success;
+}
+
+bool Patch::apply(Value*& root) const {
+	return applyOperations(root, NULL, false);
+}
+
+/**
+ * \param document Where the values added are copied, the heap if NULL.
+ * \param copyOnWrite true to change only the values owned by document:
+ * the maps and arrays on the path of an operation that are not are
+ * replaced by copies, up to and including the root. The original tree
+ * is left as it was and shares the rest with the new one.
+ */
+bool Patch::applyOperations(Value*& root, Document* document,
+		bool copyOnWrite) const {
+	for (int i = 0; i < mOperations.size(); i++)
+		if (!applyOperation(mOperations[i], root, document, copyOnWrite))
+			return false;
+	return true;
+}
+
+/**
+ * \return true if the value at from contains the value at path.
+ */
+static bool isInside(const String& path, const String& from) {
+	return path.length() > from.length()
+			&& strncmp(path.c_str(), from.c_str(), from.length()) == 0
+			&& path.c_str()[from.length()] == '/';
+}
+
+bool Patch::applyOperation(const Operation& operation, Value*& root,
+		Document* document, bool copyOnWrite) const {
+	// Tests and the sources of copies only read.
+	Document* copyTo = copyOnWrite ? document : NULL;
+	Path path;
+	Location location;
+	if (!resolve(root, operation.path, path, location,
+			operation.type != Operation::TEST ? copyTo : NULL))
+		return false;
+
+	Value* value;
+	switch (operation.type) {
+		case Operation::ADD:
+		case Operation::REPLACE: {
+			bool replace = operation.type == Operation::REPLACE;
+			if (!operation.value || (replace && !get(root, location)))
+				return false;
+			value = document ? document->copyValue(operation.value)
+					: copyValue(operation.value);
+		}
+		break;
+
+		case Operation::REMOVE:
+			value = take(root, location);
+			deleteValue(value);
+			return value != NULL;
+
+		case Operation::MOVE: {
+			// A value cannot be moved into itself.
+			if (isInside(operation.path, operation.from))
+				return false;
+			Path fromPath;
+			Location fromLocation;
+			if (!resolve(root, operation.from, fromPath, fromLocation, copyTo))
+				return false;
+			if (operation.from == operation.path)
+				return get(root, fromLocation) != NULL;
+			value = take(root, fromLocation);
+			if (!value)
+				return false;
+
+			// The removal can shift the indexes on the path.
+			if (!resolve(root, operation.path, path, location, copyTo)) {
+				deleteValue(value);
+				return false;
+			}
+		}
+		break;
+
+		case Operation::COPY: {
+			Path fromPath;
+			Location fromLocation;
+			if (!resolve(root, operation.from, fromPath, fromLocation, NULL))
+				return false;
+			Value* source = get(root, fromLocation);
+			if (!source)
+				return false;
+			value = document ? document->copyValue(source)
+					: copyValue(source);
+		}
+		break;
+
+		case Operation::TEST:
+			value = get(root, location);
+			return value && operation.value
+					&& equalValues(value, operation.value);
+
+		default:
+			return false;
+	}
+
+	if (put(root, location, value, operation.type == Operation::REPLACE))
+		return true;
+	deleteValue(value);
+	return false;
+}
+
+/**
+ * Find where a Json Pointer leads: the container of the value it
+ * refers to must exist, the value itself need not.
+ * \param path Compiled from the pointer, holds the key of location.
+ * \param copyTo If not NULL, the maps and arrays on the way that it
+ * does not own are replaced by copies in it, see applyOperations().
+ * \return false if the pointer is not valid or the container does not
+ * exist.
+ */
+bool Patch::resolve(Value*& root, const String& pointer, Path& path,
+		Location& location, Document* copyTo) {
+	// Path also accepts dotted paths, which Json Patch does not.
+	if (pointer.length() > 0 && pointer.c_str()[0] != '/')
+		return false;
+	if (!path.compile(pointer.c_str()))
+		return false;
+
+	location.parent = NULL;
+	const Vector<Path::Segment>& segments = path.mSegments;
+	if (segments.size() == 0)
+		return true;
+
+	if (copyTo && root)
+		root = own(root, copyTo);
+	Value* value = root;
+	for (int i = 0; i < segments.size() - 1 && value; i++) {
+		int k = -1;
+		if (value->mType == Value::MAP)
+			k = value->findKey(segments[i].key);
+		else if (value->mType == Value::ARRAY)
+			k = segments[i].index;
+		if (k < 0 || k >= value->mSize) {
+			value = NULL;
+			break;
+		}
+		Value*& item = value->getItems()[k];
+		if (copyTo)
+			item = own(item, copyTo);
+		value = item;
+	}
+	if (!value || (value->mType != Value::MAP
+			&& value->mType != Value::ARRAY))
+		return false;
+
+	const Path::Segment& last = segments[segments.size() - 1];
+	location.parent = value;
+	location.key = last.key.getKey();
+	location.keyLength = last.key.getKeyLength();
+	location.index = last.index;
+	return true;
+}
+
+/**
+ * \return value if it is owned by document or is not a map or array,
+ * else a copy of it in document that shares its items.
+ */
+Value* Patch::own(Value* value, Document* document) {
+	if ((value->mType != Value::MAP && value->mType != Value::ARRAY)
+			|| value->getStorageArena() == &document->getArena())
+		return value;
+	return Value::copy(value, &document->getArena(), document->getKeyTable(),
+			false);
+}
+
+/**
+ * \return The value at a location, or NULL if there is none.
+ */
+Value* Patch::get(Value* root, const Location& location) {
+	Value* parent = location.parent;
+	if (!parent)
+		return root;
+	int k = location.index;
+	if (parent->mType == Value::MAP)
+		k = parent->findKey(location.key, location.keyLength);
+	return k >= 0 && k < parent->mSize ? parent->getItems()[k] : NULL;
+}
+
+/**
+ * Remove the value at a location without deleting it.
+ * \return The value, or NULL if there is none.
+ */
+Value* Patch::take(Value*& root, const Location& location) {
+	Value* parent = location.parent;
+	if (!parent) {
+		Value* value = root;
+		root = NULL;
+		return value;
+	}
+	if (parent->mType == Value::MAP)
+		return ((MapValue*) parent)->removeValueForKey(location.key,
+				location.keyLength);
+	return ((ArrayValue*) parent)->removeValue(location.index);
+}
+
+/**
+ * Add a value at a location, or replace the value there.
+ * \return false if the location is not valid for the operation, in
+ * which case value is not used.
+ */
+bool Patch::put(Value*& root, const Location& location, Value* value,
+		bool replace) {
+	Value* parent = location.parent;
+	if (!parent) {
+		deleteValue(root);
+		root = value;
+		return true;
+	}
+
+	if (parent->mType == Value::MAP) {
+		if (replace && parent->findKey(location.key, location.keyLength) < 0)
+			return false;
+		((MapValue*) parent)->setValueForKey(location.key,
+				location.keyLength, value);
+		return true;
+	}
+
+	ArrayValue* array = (ArrayValue*) parent;
+	int index = location.index;
+	if (replace) {
+		if (index < 0 || index >= parent->mSize)
+			return false;
+		array->setValue(index, value);
+		return true;
+	}
+
+	// "-" is the end of the array.
+	if (location.keyLength == 1 && location.key[0] == '-')
+		index = parent->mSize;
+	if (index < 0 || index > parent->mSize)
+		return false;
+	array->insertValue(index, value);
+	return true;
+}
+
+/**
+ * \return true if the values are equal, see diff().
+ */
+bool Patch::equalValues(const Value* a, const Value* b) {
+	if (a->mType != b->mType)
+		return false;
+
+	switch (a->mType) {
+		case Value::NUL:
+			return true;
+
+		case Value::BOOLEAN:
+			return a->toBoolean() == b->toBoolean();
+
+		case Value::NUMBER: {
+			long long x, y;
+			if (a->tryGetInt64(x) && b->tryGetInt64(y))
+				return x == y;
+			return a->toDouble() == b->toDouble();
+		}
+
+		case Value::STRING:
+			return a->mSize == b->mSize
+					&& memcmp(a->mData.string, b->mData.string, a->mSize) == 0;
+
+		case Value::MAP: {
+			if (a->mSize != b->mSize)
+				return false;
+			Value** items = a->getItems();
+			for (int i = 0; i < a->mSize; i++) {
+				const ShapeKey& key = a->getShape()->getKeys()[i];
+				int k = b->findKey(key.key, key.keyLength);
+				if (k < 0 || !equalValues(items[i], b->getItems()[k]))
+					return false;
+			}
+			return true;
+		}
+
+		case Value::ARRAY: {
+			if (a->mSize != b->mSize)
+				return false;
+			for (int i = 0; i < a->mSize; i++)
+				if (!equalValues(a->getItems()[i], b->getItems()[i]))
+					return false;
+			return true;
+		}
+	}
+	return false;
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
@@ -0,0 +1,217 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Patch.h
+ *
+ *  Json Patch (RFC 6902): the differences between two document trees,
+ *  as operations that can be applied to a tree.
+ */
+
+#ifndef _YAJL_DOM_PATCH_H_
+#define _YAJL_DOM_PATCH_H_
+
+#include <MAUtil/String.h>
+#include <MAUtil/Vector.h>
+
+#include "YAJLDom.h"
+#include "Path.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * A list of operations that change one Json value into another, like
+ * a Json Patch document:
+ *
+ *   Patch patch;
+ *   patch.diff(shown.getRoot(), latest.getRoot());
+ *   for (int i = 0; i < patch.getOperationCount(); i++)
+ *       updateView(patch.getOperation(i).path);
+ *   patch.apply(shown);
+ *
+ * diff() first hashes every map and array of both trees, so that two
+ * subtrees are compared by their hashes in constant time, and only the
+ * subtrees that differ are descended into. The hashes have 64 bits,
+ * and subtrees with the same hash are taken to be equal. Strings,
+ * numbers and the other values are compared directly. Maps are equal
+ * when they have the same entries, in any order, and numbers when they
+ * have the same value, however they are written.
+ *
+ * Paths are Json Pointers (RFC 6901). The values of the operations are
+ * not copied: after diff() they are in the target tree, after read()
+ * in the patch document, which must be kept as long as the patch is
+ * used. apply() copies them into the tree that is patched.
+ */
+class Patch {
+public:
+	struct Operation {
+		enum Type {
+			ADD,
+			REMOVE,
+			REPLACE,
+			MOVE,
+			COPY,
+			TEST
+		};
+
+		Type type;
+		MAUtil::String path;
+
+		/**
+		 * The path of the value that is moved or copied.
+		 */
+		MAUtil::String from;
+
+		/**
+		 * The value to add, replace with or test against, NULL for
+		 * the other operations.
+		 */
+		const Value* value;
+	};
+
+	Patch();
+	~Patch();
+
+	/**
+	 * Find the operations that change from into to, replacing the
+	 * operations of the patch. Changed maps and values are patched in
+	 * place, arrays as well when the changed elements are where they
+	 * were. Elements added or removed in one place of an array are
+	 * found by comparing the ends of the arrays. The operations are
+	 * add, remove and replace, and the result is not always the
+	 * shortest patch.
+	 * \param from The tree to change, NULL for an empty tree.
+	 * \param to The tree to change into.
+	 */
+	void diff(const Value* from, const Value* to);
+
+	/**
+	 * Read the operations of a Json Patch document, replacing the
+	 * operations of the patch.
+	 * \param patch An array of operation maps.
+	 * \return false if the document is not a valid patch, in which case
+	 * the patch is empty.
+	 */
+	bool read(const Value* patch);
+
+	/**
+	 * Write the patch as a Json Patch document.
+	 * \param writer Receives the text. Flushed when done.
+	 */
+	void write(Writer& writer) const;
+
+	/**
+	 * Apply the operations to the tree of a document, in order, in
+	 * place. The values added are copied into the document.
+	 * \return false if an operation fails, for example because its
+	 * path does not exist or a test does not hold. The operations
+	 * before it are left applied.
+	 */
+	bool apply(Document& document) const;
+
+	/**
+	 * Apply the operations to a tree of heap values, see above. The
+	 * values added are copied to the heap, the values removed are
+	 * deleted.
+	 * \param root The root, which is replaced by an operation on the
+	 * empty path.
+	 */
+	bool apply(Value*& root) const;
+
+	int getOperationCount() const;
+	const Operation& getOperation(int index) const;
+
+	/**
+	 * Add an operation at the end.
+	 */
+	void addOperation(const Operation& operation);
+
+	void clear();
+
+private:
+	/**
+	 * The hash of a map or array, see diff().
+	 */
+	struct HashEntry {
+		const Value* value;
+		unsigned long long hash;
+	};
+
+	/**
+	 * Where an operation takes effect: the key or index in the parent
+	 * of the value, or the root if the parent is NULL.
+	 */
+	struct Location {
+		Value* parent;
+		const char* key;
+		int keyLength;
+		int index;
+	};
+
+	unsigned long long hashTree(const Value* value);
+	unsigned long long getHash(const Value* value) const;
+	bool sameValues(const Value* a, const Value* b) const;
+	void storeHash(const Value* value, unsigned long long hash);
+	void growHashes();
+
+	void diffValues(const Value* from, const Value* to);
+	void diffMaps(const Value* from, const Value* to);
+	void diffArrays(const Value* from, const Value* to);
+	void pushKey(const char* key, int keyLength);
+	void pushIndex(int index);
+	void add(Operation::Type type, const Value* value);
+
+	bool applyOperations(Value*& root, Document* document,
+			bool copyOnWrite) const;
+	bool applyOperation(const Operation& operation, Value*& root,
+			Document* document, bool copyOnWrite) const;
+	static bool resolve(Value*& root, const MAUtil::String& pointer,
+			Path& path, Location& location, Document* copyTo);
+	static Value* own(Value* value, Document* document);
+	static Value* get(Value* root, const Location& location);
+	static Value* take(Value*& root, const Location& location);
+	static bool put(Value*& root, const Location& location, Value* value,
+			bool replace);
+	static bool equalValues(const Value* a, const Value* b);
+
+	friend class SharedDocument;
+
+	// Never copied.
+	Patch(const Patch&);
+	Patch& operator=(const Patch&);
+
+	MAUtil::Vector<Operation> mOperations;
+
+	/**
+	 * The hashes of the maps and arrays of the trees being compared,
+	 * open addressed by the address of the value. Kept for the next
+	 * diff.
+	 */
+	MAUtil::Vector<HashEntry> mHashes;
+	int mHashCount;
+
+	/**
+	 * The Json Pointer to the values being compared.
+	 */
+	MAUtil::Vector<char> mPath;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_PATCH_H_
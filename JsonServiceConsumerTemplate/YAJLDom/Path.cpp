@@ -0,0 +1,443 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Path.cpp
+ *
+ *  Compiled paths to values in a Json document.
+ */
+
+#include "Path.h"
+#include <maheap.h>
+#include <mastring.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Indexes with more digits are not accepted, so they fit in an int.
+ */
+static const int MAX_INDEX_DIGITS = 9;
+
+/**
+ * \return The array index a Json Pointer segment stands for, or -1 if
+ * it is not one. Leading zeros are not allowed.
+ */
+static int pointerIndex(const char* text, int length) {
+	if (length == 0 || length > MAX_INDEX_DIGITS
+			|| (text[0] == '0' && length > 1))
+		return -1;
+	int index = 0;
+	for (int i = 0; i < length; i++) {
+		if (text[i] < '0' || text[i] > '9')
+			return -1;
+		index = index * 10 + text[i] - '0';
+	}
+	return index;
+}
+
+static bool storeFirst(const Value* value, void* userData) {
+	*(const Value**) userData = value;
+	return false;
+}
+
+static bool storeMatch(const Value* value, void* userData) {
+	((Vector<const Value*>*) userData)->add(value);
+	return true;
+}
+
+Path::Segment::Segment() :
+	type(KEY), index(-1), key("", 0) {
+}
+
+Path::Path() :
+	mText(NULL), mValid(false) {
+	compile("");
+}
+
+Path::Path(const char* path) :
+	mText(NULL), mValid(false) {
+	compile(path);
+}
+
+Path::~Path() {
+	clear();
+}
+
+void Path::clear() {
+	mSegments.clear();
+	free(mText);
+	mText = NULL;
+	mValid = false;
+}
+
+bool Path::compile(const char* path) {
+	clear();
+
+	// Unescaped keys are never longer than the path, and every key
+	// but the last has a separator that makes room for its terminator.
+	mText = (char*) malloc(strlen(path) + 1);
+	if (path[0] == '/')
+		mValid = compilePointer(path);
+	else
+		mValid = compileDotted(path);
+	if (!mValid)
+		mSegments.clear();
+	return mValid;
+}
+
+bool Path::isValid() const {
+	return mValid;
+}
+
+bool Path::compilePointer(const char* path) {
+	int length = 0;
+	const char* p = path;
+	while (*p == '/') {
+		p++;
+		int start = length;
+		for (; *p && *p != '/'; p++) {
+			char c = *p;
+			if (c == '~') {
+				if (p[1] == '0')
+					c = '~';
+				else if (p[1] == '1')
+					c = '/';
+				else
+					return false;
+				p++;
+			}
+			mText[length++] = c;
+		}
+		int keyLength = length - start;
+		mText[length++] = 0;
+		addKey(start, keyLength, pointerIndex(mText + start, keyLength));
+	}
+	return true;
+}
+
+bool Path::compileDotted(const char* path) {
+	int length = 0;
+	const char* p = path;
+	while (*p) {
+		if (*p == '[') {
+			p++;
+			if (p[0] == '*' && p[1] == ']') {
+				addIndex(-1, Segment::WILDCARD);
+				p += 2;
+				continue;
+			}
+			const char* digits = p;
+			int index = 0;
+			for (; *p >= '0' && *p <= '9'; p++) {
+				if (p - digits == MAX_INDEX_DIGITS)
+					return false;
+				index = index * 10 + *p - '0';
+			}
+			if (p == digits || *p != ']')
+				return false;
+			addIndex(index, Segment::INDEX);
+			p++;
+			continue;
+		}
+
+		// A name follows a dot, except at the start.
+		if (p != path) {
+			if (*p != '.')
+				return false;
+			p++;
+		}
+		int start = length;
+		while (*p && *p != '.' && *p != '[')
+			mText[length++] = *p++;
+		int keyLength = length - start;
+		if (keyLength == 0)
+			return false;
+		mText[length++] = 0;
+		addKey(start, keyLength, -1);
+	}
+	return true;
+}
+
+void Path::addKey(int offset, int length, int index) {
+	Segment segment;
+	segment.type = Segment::KEY;
+	segment.index = index;
+	segment.key = CachedKey(mText + offset, length);
+	mSegments.add(segment);
+}
+
+void Path::addIndex(int index, int type) {
+	Segment segment;
+	segment.type = type;
+	segment.index = index;
+	mSegments.add(segment);
+}
+
+const Value* Path::evaluate(const Value* root) const {
+	const Value* match = NULL;
+	forEachMatch(root, storeFirst, &match);
+	return match;
+}
+
+Value* Path::evaluate(Value* root) const {
+	return (Value*) evaluate((const Value*) root);
+}
+
+int Path::forEachMatch(const Value* root, MatchCallback callback,
+		void* userData) const {
+	int count = 0;
+	if (mValid && root)
+		visit(root, 0, callback, userData, count);
+	return count;
+}
+
+int Path::getMatches(const Value* root,
+		Vector<const Value*>& matches) const {
+	return forEachMatch(root, storeMatch, &matches);
+}
+
+/**
+ * Follow the segments from segment on, starting at value.
+ * \return false if the callback asked to stop.
+ */
+bool Path::visit(const Value* value, int segment, MatchCallback callback,
+		void* userData, int& count) const {
+	for (; segment < mSegments.size(); segment++) {
+		const Segment& s = mSegments[segment];
+		int type = value->getType();
+		int i;
+		switch (s.type) {
+			case Segment::KEY:
+				if (type == Value::MAP)
+					i = value->findKey(s.key);
+				else if (type == Value::ARRAY)
+					i = s.index;
+				else
+					return true;
+				break;
+
+			case Segment::INDEX:
+				if (type != Value::ARRAY)
+					return true;
+				i = s.index;
+				break;
+
+			default:
+				if (type != Value::MAP && type != Value::ARRAY)
+					return true;
+				for (i = 0; i < value->mSize; i++)
+					if (!visit(value->getItems()[i], segment + 1, callback,
+							userData, count))
+						return false;
+				return true;
+		}
+
+		if (i < 0 || i >= value->mSize)
+			return true;
+		value = value->getItems()[i];
+	}
+
+	count++;
+	return callback(value, userData);
+}
+
+Projection::Node::Node() :
+	type(Path::Segment::KEY), index(-1), key(NULL), keyLength(0),
+	all(false), lastIndex(-1), firstChild(-1), next(-1) {
+}
+
+Projection::Projection() :
+	mKeys(256) {
+	clear();
+}
+
+void Projection::clear() {
+	mNodes.clear();
+	mNodes.add(Node());
+	mKeys.reset();
+}
+
+bool Projection::add(const char* path) {
+	Path compiled(path);
+	return add(compiled);
+}
+
+bool Projection::add(const Path& path) {
+	if (!path.isValid())
+		return false;
+
+	int node = 0;
+	for (int i = 0; i < path.mSegments.size(); i++) {
+		const Path::Segment& segment = path.mSegments[i];
+		Node step;
+		step.type = segment.type;
+		step.index = segment.index;
+		if (segment.type == Path::Segment::KEY) {
+			step.key = segment.key.getKey();
+			step.keyLength = segment.key.getKeyLength();
+		}
+		node = addChild(node, step);
+	}
+	mNodes[node].all = true;
+
+	mergeWildcards(0);
+	return true;
+}
+
+/**
+ * \return The child of parent that step leads to, which is added if
+ * there is none.
+ */
+int Projection::addChild(int parent, const Node& step) {
+	int last = -1;
+	for (int i = mNodes[parent].firstChild; i >= 0; i = mNodes[i].next) {
+		last = i;
+		Node& child = mNodes[i];
+		if (child.type != step.type)
+			continue;
+		if (step.type == Path::Segment::INDEX && child.index != step.index)
+			continue;
+		if (step.type == Path::Segment::KEY) {
+			if (child.keyLength != step.keyLength
+					|| memcmp(child.key, step.key, step.keyLength) != 0)
+				continue;
+			// The same key from a Json Pointer is an index as well.
+			if (step.index > child.index)
+				child.index = step.index;
+		}
+		return i;
+	}
+
+	Node node;
+	node.type = step.type;
+	node.index = step.index;
+	if (step.key)
+		node.key = mKeys.copyString(step.key, step.keyLength);
+	node.keyLength = step.keyLength;
+	mNodes.add(node);
+
+	int i = mNodes.size() - 1;
+	if (last >= 0)
+		mNodes[last].next = i;
+	else
+		mNodes[parent].firstChild = i;
+	return i;
+}
+
+/**
+ * Add the paths below source to target.
+ */
+void Projection::merge(int target, int source) {
+	if (mNodes[source].all)
+		mNodes[target].all = true;
+	for (int i = mNodes[source].firstChild; i >= 0; i = mNodes[i].next) {
+		// Copied, adding a child can move the nodes.
+		Node step = mNodes[i];
+		merge(addChild(target, step), i);
+	}
+}
+
+/**
+ * A value can be reached by several steps, such as a key and a
+ * wildcard. The paths of all of them are merged into the specific one,
+ * so that the parser only has to follow one node per value. Done for
+ * every path that is added, since merging the same paths again changes
+ * nothing.
+ */
+void Projection::mergeWildcards(int node) {
+	int wildcard = -1;
+	for (int i = mNodes[node].firstChild; i >= 0; i = mNodes[i].next)
+		if (mNodes[i].type == Path::Segment::WILDCARD)
+			wildcard = i;
+
+	int lastIndex = -1;
+	for (int i = mNodes[node].firstChild; i >= 0; i = mNodes[i].next) {
+		if (wildcard >= 0 && i != wildcard)
+			merge(i, wildcard);
+
+		// An index and a Json Pointer key that is the same number.
+		if (mNodes[i].type == Path::Segment::INDEX) {
+			for (int k = mNodes[node].firstChild; k >= 0; k = mNodes[k].next) {
+				if (mNodes[k].type == Path::Segment::KEY
+						&& mNodes[k].index == mNodes[i].index) {
+					merge(i, k);
+					merge(k, i);
+				}
+			}
+		}
+
+		if (mNodes[i].index > lastIndex)
+			lastIndex = mNodes[i].index;
+	}
+	mNodes[node].lastIndex = wildcard >= 0 ? -1 : lastIndex;
+
+	for (int i = mNodes[node].firstChild; i >= 0; i = mNodes[i].next)
+		mergeWildcards(i);
+}
+
+/**
+ * \return ALL for a node where a path ends, otherwise node.
+ */
+int Projection::resolve(int node) const {
+	return mNodes[node].all ? (int) ALL : node;
+}
+
+int Projection::getRoot() const {
+	return resolve(0);
+}
+
+/**
+ * \return The node for the value of a key in a map at node, or NONE
+ * if the value is not on a path.
+ */
+int Projection::findKey(int node, const char* key, int keyLength) const {
+	int wildcard = NONE;
+	for (int i = mNodes[node].firstChild; i >= 0; i = mNodes[i].next) {
+		const Node& child = mNodes[i];
+		if (child.type == Path::Segment::WILDCARD)
+			wildcard = resolve(i);
+		else if (child.type == Path::Segment::KEY
+				&& child.keyLength == keyLength
+				&& memcmp(child.key, key, keyLength) == 0)
+			return resolve(i);
+	}
+	return wildcard;
+}
+
+/**
+ * \return The node for an element of an array at node, or NONE if
+ * the element is not on a path.
+ */
+int Projection::findIndex(int node, int index) const {
+	int wildcard = NONE;
+	for (int i = mNodes[node].firstChild; i >= 0; i = mNodes[i].next) {
+		const Node& child = mNodes[i];
+		if (child.type == Path::Segment::WILDCARD)
+			wildcard = resolve(i);
+		else if (child.index == index)
+			return resolve(i);
+	}
+	return wildcard;
+}
+
+int Projection::getLastIndex(int node) const {
+	return mNodes[node].lastIndex;
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
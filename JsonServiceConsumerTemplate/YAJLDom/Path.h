@@ -0,0 +1,257 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Path.h
+ *
+ *  Compiled paths to values in a Json document.
+ */
+
+#ifndef _YAJL_DOM_PATH_H_
+#define _YAJL_DOM_PATH_H_
+
+#include <MAUtil/Vector.h>
+
+#include "YAJLDom.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * A path to values in a document, compiled once and evaluated against
+ * any number of documents. Two notations are accepted:
+ *
+ *   A Json Pointer (RFC 6901), which starts with a slash:
+ *     /people/0/name
+ *   Segments are map keys, where ~0 stands for ~ and ~1 for /. A
+ *   segment that is a number is an index when applied to an array.
+ *
+ *   A dotted path:
+ *     people[0].name
+ *     people[*].name
+ *   Names are map keys, [n] is an array index and [*] matches every
+ *   value in an array or map.
+ *
+ * The empty path refers to the root.
+ *
+ * The keys of a path remember where they were found, like a CachedKey,
+ * so evaluating it on many documents with the same keys does not
+ * search the maps. For the same reason a Path should not be evaluated
+ * by several threads at the same time.
+ */
+class Path {
+public:
+	/**
+	 * Called for each value that matches a path.
+	 * \return false to stop.
+	 */
+	typedef bool (*MatchCallback)(const Value* value, void* userData);
+
+	Path();
+
+	/**
+	 * Compile path, see compile().
+	 */
+	explicit Path(const char* path);
+
+	~Path();
+
+	/**
+	 * Compile a path, replacing the previous one.
+	 * \param path Null terminated path. The text is copied.
+	 * \return false if the path is not valid, in which case nothing
+	 * matches it.
+	 */
+	bool compile(const char* path);
+
+	/**
+	 * \return true if the last compiled path was valid.
+	 */
+	bool isValid() const;
+
+	/**
+	 * \return The first value that matches the path, or NULL if
+	 * there is none.
+	 */
+	const Value* evaluate(const Value* root) const;
+	Value* evaluate(Value* root) const;
+
+	/**
+	 * Call callback for the values that match the path, in document
+	 * order, until it returns false.
+	 * \return The number of values passed to callback.
+	 */
+	int forEachMatch(const Value* root, MatchCallback callback,
+			void* userData) const;
+
+	/**
+	 * Add the values that match the path to matches.
+	 * \return The number of values added.
+	 */
+	int getMatches(const Value* root, Vector<const Value*>& matches) const;
+
+private:
+	friend class Projection;
+	friend class Parser;
+	friend class Patch;
+
+	struct Segment {
+		enum Type {
+			KEY,
+			INDEX,
+			WILDCARD
+		};
+
+		Segment();
+
+		int type;
+
+		/**
+		 * The array index of an INDEX segment. Also set for KEY
+		 * segments of a Json Pointer that are numbers, -1 otherwise.
+		 */
+		int index;
+
+		CachedKey key;
+	};
+
+	void clear();
+	bool compilePointer(const char* path);
+	bool compileDotted(const char* path);
+	void addKey(int offset, int length, int index);
+	void addIndex(int index, int type);
+	bool visit(const Value* value, int segment, MatchCallback callback,
+			void* userData, int& count) const;
+
+	// Never copied, the keys point into mText.
+	Path(const Path&);
+	Path& operator=(const Path&);
+
+	Vector<Segment> mSegments;
+
+	/**
+	 * The unescaped keys, each one null terminated.
+	 */
+	char* mText;
+
+	bool mValid;
+};
+
+/**
+ * A set of paths for a projected parse, which only builds the values
+ * the paths lead to, see Parser::setProjection():
+ *
+ *   Projection projection;
+ *   projection.add("people[*].name");
+ *   projection.add("people[*].company");
+ *   Parser parser(document);
+ *   parser.setProjection(&projection);
+ *
+ * A value a path leads to is built with everything it contains. The
+ * paths are kept as a tree, so each key of the Json text is compared
+ * with the keys that can follow at its position only.
+ */
+class Projection {
+public:
+	Projection();
+
+	/**
+	 * Add a path, see Path for the notation.
+	 * \return false if the path is not valid.
+	 */
+	bool add(const char* path);
+	bool add(const Path& path);
+
+	/**
+	 * Remove all paths, after which only the root is built.
+	 */
+	void clear();
+
+private:
+	friend class Parser;
+
+	/**
+	 * Node numbers with a special meaning.
+	 */
+	enum {
+		/**
+		 * Build the value and everything in it.
+		 */
+		ALL = -1,
+
+		/**
+		 * Skip the value.
+		 */
+		NONE = -2
+	};
+
+	/**
+	 * A step of one or more paths. The fields up to keyLength
+	 * describe the step from the parent, like a Path::Segment.
+	 */
+	struct Node {
+		Node();
+
+		int type;
+		int index;
+		const char* key;
+		int keyLength;
+
+		/**
+		 * A path ends here.
+		 */
+		bool all;
+
+		/**
+		 * The highest array index of the children, -1 if there is
+		 * none or if a wildcard child takes every element.
+		 */
+		int lastIndex;
+
+		int firstChild;
+		int next;
+	};
+
+	int getRoot() const;
+	int findKey(int node, const char* key, int keyLength) const;
+	int findIndex(int node, int index) const;
+	int getLastIndex(int node) const;
+
+	int resolve(int node) const;
+	int addChild(int parent, const Node& step);
+	void merge(int target, int source);
+	void mergeWildcards(int node);
+
+	// Never copied, the nodes point into mKeys.
+	Projection(const Projection&);
+	Projection& operator=(const Projection&);
+
+	/**
+	 * The root is the first node.
+	 */
+	Vector<Node> mNodes;
+
+	/**
+	 * Holds the keys of the nodes.
+	 */
+	Arena mKeys;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_PATH_H_
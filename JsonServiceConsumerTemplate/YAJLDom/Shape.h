@@ -0,0 +1,92 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Shape.h
+ *
+ *  The keys of maps, shared by maps with the same keys. Only used
+ *  inside YAJLDom.
+ */
+
+#ifndef _YAJL_DOM_SHAPE_H_
+#define _YAJL_DOM_SHAPE_H_
+
+#include "Arena.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * A key of a Shape.
+ */
+struct ShapeKey {
+	const char* key;
+	int keyLength;
+};
+
+/**
+ * The keys of a map, in insertion order. The values of the map are
+ * stored in the same order, so a key and its value have the same
+ * index, called the slot.
+ *
+ * The maps of a parsed document that have the same keys in the same
+ * order share one shape, and only store their values. Shared shapes
+ * are never modified, a map copies its shape before adding a key.
+ *
+ * Shapes with more than INDEX_THRESHOLD keys, see YAJLDom.cpp, have
+ * a hash index from key to slot. Each index slot holds a key slot plus
+ * one, or zero if it is empty. indexSize is a power of two.
+ */
+struct Shape {
+	int count;
+	int capacity;
+	int* index;
+	int indexSize;
+	bool shared;
+
+	/**
+	 * Hash of the key sequence and the next shape in the same bucket,
+	 * used by the shape table of the Parser.
+	 */
+	unsigned int hash;
+	Shape* next;
+
+	ShapeKey* getKeys() {
+		return (ShapeKey*) (this + 1);
+	}
+
+	const ShapeKey* getKeys() const {
+		return (const ShapeKey*) (this + 1);
+	}
+};
+
+/**
+ * \return A new, empty shape with room for capacity keys.
+ */
+Shape* allocShape(Arena* arena, int capacity);
+
+/**
+ * Add a key that is not in the shape, which must have room for it.
+ * \param interned true if the key is from the KeyTable of the map.
+ */
+void addShapeKey(Arena* arena, Shape* shape, bool interned,
+		const char* key, int keyLength);
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_SHAPE_H_
@@ -0,0 +1,165 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * SharedDocument.cpp
+ *
+ *  Immutable versions of a document that share the values they have
+ *  in common.
+ */
+
+#include "SharedDocument.h"
+#include "MemoryMgr.h"
+
+using namespace YAJLDomUtil;
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * The size of the first arena block of an update. Most updates change
+ * a few values, which would leave most of a default block unused.
+ */
+static const int UPDATE_BLOCK_SIZE = 512;
+
+/**
+ * The values of a parse or an update, and the segment of the version
+ * it was made from, whose values the tree can refer to.
+ */
+struct SharedSegment {
+	SharedSegment(SharedSegment* parent, int blockSize) :
+		document(blockSize), references(1), parent(parent) {
+	}
+
+	Document document;
+	int references;
+	SharedSegment* parent;
+};
+
+SharedDocument::SharedDocument() :
+	mSegment(NULL) {
+}
+
+SharedDocument::SharedDocument(const SharedDocument& other) :
+	mSegment(NULL) {
+	retain(other.mSegment);
+}
+
+SharedDocument& SharedDocument::operator=(const SharedDocument& other) {
+	retain(other.mSegment);
+	return *this;
+}
+
+SharedDocument::~SharedDocument() {
+	release();
+}
+
+bool SharedDocument::parse(const unsigned char* jsonText,
+		size_t jsonTextLength, int flags) {
+	SharedSegment* segment = newobject(SharedSegment,
+			new SharedSegment(NULL, 4096));
+	if (!segment->document.parse(jsonText, jsonTextLength, flags)) {
+		deleteobject(segment);
+		return false;
+	}
+	release();
+	mSegment = segment;
+	return true;
+}
+
+const Value* SharedDocument::getRoot() const {
+	return mSegment ? mSegment->document.getRoot() : NULL;
+}
+
+bool SharedDocument::apply(const Patch& patch, SharedDocument& result) const {
+	SharedSegment* segment = newobject(SharedSegment,
+			new SharedSegment(mSegment, UPDATE_BLOCK_SIZE));
+	Value* root = mSegment ? mSegment->document.getRoot() : NULL;
+	if (!patch.applyOperations(root, &segment->document, true)) {
+		deleteobject(segment);
+		return false;
+	}
+	segment->document.setRoot(root);
+
+	// The segment keeps the one it was made from, retained before
+	// result is released since result can be this version.
+	if (mSegment)
+		mSegment->references++;
+	result.release();
+	result.mSegment = segment;
+	return true;
+}
+
+void SharedDocument::compact() {
+	if (!mSegment || !mSegment->parent)
+		return;
+	SharedSegment* segment = newobject(SharedSegment,
+			new SharedSegment(NULL, 4096));
+	// A patch that removes the root leaves a version without one.
+	const Value* root = mSegment->document.getRoot();
+	if (root)
+		segment->document.setRoot(segment->document.copyValue(root));
+	release();
+	mSegment = segment;
+}
+
+void SharedDocument::clear() {
+	release();
+}
+
+int SharedDocument::getSegmentCount() const {
+	int count = 0;
+	for (SharedSegment* segment = mSegment; segment; segment = segment->parent)
+		count++;
+	return count;
+}
+
+int SharedDocument::getBytesUsed() const {
+	int bytes = 0;
+	for (SharedSegment* segment = mSegment; segment; segment = segment->parent)
+		bytes += segment->document.getArena().getBytesUsed();
+	return bytes;
+}
+
+/**
+ * Refer to a segment instead, retained first in case it is kept only
+ * by the current one.
+ */
+void SharedDocument::retain(SharedSegment* segment) {
+	if (segment)
+		segment->references++;
+	release();
+	mSegment = segment;
+}
+
+/**
+ * Drop the reference to the segment, and the segments it keeps that
+ * are no longer referenced. In a loop, since chains of updates can be
+ * long.
+ */
+void SharedDocument::release() {
+	SharedSegment* segment = mSegment;
+	mSegment = NULL;
+	while (segment && --segment->references == 0) {
+		SharedSegment* parent = segment->parent;
+		deleteobject(segment);
+		segment = parent;
+	}
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
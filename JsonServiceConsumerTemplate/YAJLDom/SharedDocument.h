@@ -0,0 +1,126 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * SharedDocument.h
+ *
+ *  Immutable versions of a document that share the values they have
+ *  in common.
+ */
+
+#ifndef _YAJL_DOM_SHARED_DOCUMENT_H_
+#define _YAJL_DOM_SHARED_DOCUMENT_H_
+
+#include "YAJLDom.h"
+#include "Patch.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+struct SharedSegment;
+
+/**
+ * A version of a Json tree that is never changed. Copying one is
+ * constant time, and a changed version is made by applying a patch,
+ * which copies only the maps and arrays on the paths of the changes
+ * and shares everything else with the version it was made from:
+ *
+ *   SharedDocument shown;
+ *   shown.parse(text, length);
+ *   SharedDocument undo = shown;
+ *   shown.apply(patch, shown);
+ *   ...
+ *   shown = undo;
+ *
+ * The values of each update are kept in an arena of their own, which
+ * also keeps the arenas of the versions it shares values with. Memory
+ * therefore grows with the size of the changes rather than with the
+ * number of versions, but an old version is only freed when no newer
+ * version made from it is left. compact() copies a version on its own
+ * after many updates. A map or array on a changed path is copied
+ * whole, with pointers to its items, so very large containers make
+ * every update that goes through them as large.
+ *
+ * The trees can be read from several threads, but versions must be
+ * copied and destroyed on one thread, since the reference counts are
+ * not atomic.
+ */
+class SharedDocument {
+public:
+	SharedDocument();
+	SharedDocument(const SharedDocument& other);
+	SharedDocument& operator=(const SharedDocument& other);
+	~SharedDocument();
+
+	/**
+	 * Parse Json text into a new version, replacing this one.
+	 * \param flags See Document::ParseFlags.
+	 * \return false on error, in which case this version is kept.
+	 */
+	bool parse(const unsigned char* jsonText, size_t jsonTextLength,
+			int flags = 0);
+
+	/**
+	 * \return The root, or NULL if the version is empty. The tree must
+	 * not be changed.
+	 */
+	const Value* getRoot() const;
+
+	/**
+	 * Make a new version by applying the operations of a patch to this
+	 * one, which is left as it was. The values added are copied.
+	 * \param result Receives the new version, can be this one.
+	 * \return false if an operation fails, see Patch::apply(), in
+	 * which case result is left as it was.
+	 */
+	bool apply(const Patch& patch, SharedDocument& result) const;
+
+	/**
+	 * Copy the tree of this version into an arena of its own, so that
+	 * it no longer keeps the arenas of earlier updates and their
+	 * versions. Takes time and memory in the size of the tree.
+	 */
+	void compact();
+
+	/**
+	 * Make this the empty version.
+	 */
+	void clear();
+
+	/**
+	 * \return The number of arenas kept by this version: one, plus one
+	 * for each update since it was parsed or compacted.
+	 */
+	int getSegmentCount() const;
+
+	/**
+	 * \return The bytes used by the arenas kept by this version, which
+	 * can be shared with other versions.
+	 */
+	int getBytesUsed() const;
+
+private:
+	void retain(SharedSegment* segment);
+	void release();
+
+	SharedSegment* mSegment;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_SHARED_DOCUMENT_H_
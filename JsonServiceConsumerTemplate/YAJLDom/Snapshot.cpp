@@ -0,0 +1,599 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Snapshot.cpp
+ *
+ *  Binary snapshots of document trees.
+ */
+
+#include "Snapshot.h"
+#include "Shape.h"
+#include <new>
+#include <maheap.h>
+#include <mastring.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * "YJS1" when read in the byte order of the device that wrote it.
+ */
+static const int SNAPSHOT_MAGIC = 0x314A5359;
+
+struct SnapshotHeader {
+	int magic;
+	int version;
+
+	/**
+	 * The size of the whole snapshot.
+	 */
+	int size;
+	int root;
+	int valueCount;
+	int containerCount;
+	int childCount;
+	int shapeCount;
+	int keyCount;
+	int poolSize;
+};
+
+struct SnapshotValue {
+	enum Flags {
+		INTEGER = 1,
+		NUMBER_TEXT = 2
+	};
+
+	unsigned char type;
+	unsigned char flags;
+	unsigned short reserved;
+
+	/**
+	 * String length, or number of children of a container.
+	 */
+	int size;
+
+	union {
+		long long integer;
+		double number;
+		struct {
+			/**
+			 * Where the text is in the string pool, where the
+			 * children are in the child table, or the value of a
+			 * boolean.
+			 */
+			int offset;
+
+			/**
+			 * The shape of a map with keys, -1 otherwise.
+			 */
+			int shape;
+		} ref;
+	} data;
+};
+
+struct SnapshotShape {
+	int firstKey;
+	int count;
+};
+
+struct SnapshotKey {
+	int offset;
+	int length;
+};
+
+// The tables are written as they are in memory.
+typedef char SnapshotValueSizeCheck[sizeof(SnapshotValue) == 16 ? 1 : -1];
+
+/**
+ * Collects the tables of a snapshot, see writeSnapshot().
+ */
+class SnapshotWriter {
+public:
+	SnapshotWriter() :
+		mContainerCount(0), mLastShape(NULL), mLastShapeIndex(-1),
+		mPoolSize(0) {
+	}
+
+	/**
+	 * Add a value and everything in it.
+	 * \return The number of the value.
+	 */
+	int addValue(const Value* value) {
+		SnapshotValue entry;
+		memset(&entry, 0, sizeof(entry));
+		entry.type = value->mType;
+		entry.data.ref.shape = -1;
+
+		switch (value->mType) {
+			case Value::BOOLEAN:
+				entry.data.ref.offset = value->mData.boolean ? 1 : 0;
+				break;
+
+			case Value::NUMBER:
+				if (value->mFlags & Value::INTEGER) {
+					entry.flags = SnapshotValue::INTEGER;
+					entry.data.integer = value->mData.integer;
+				} else if (value->mFlags & Value::NUMBER_TEXT) {
+					entry.flags = SnapshotValue::NUMBER_TEXT;
+					entry.size = value->mSize;
+					entry.data.ref.offset = addText(value->mData.string,
+							value->mSize);
+				} else {
+					entry.data.number = value->mData.number;
+				}
+				break;
+
+			case Value::STRING:
+				entry.size = value->mSize;
+				entry.data.ref.offset = addText(value->mData.string,
+						value->mSize);
+				break;
+
+			case Value::ARRAY:
+			case Value::MAP: {
+				int count = value->mSize;
+				int first = mChildren.size();
+				entry.size = count;
+				entry.data.ref.offset = first;
+				if (value->mType == Value::MAP && count > 0)
+					entry.data.ref.shape = addShape(value->getShape());
+				// Vector::resize() does not grow geometrically.
+				if (first + count > mChildren.capacity()) {
+					int capacity = mChildren.capacity() * 2;
+					mChildren.reserve(capacity > first + count ? capacity
+							: first + count);
+				}
+				mChildren.resize(first + count);
+				mContainerCount++;
+
+				// Added before the children, which get higher numbers.
+				int index = mValues.size();
+				mValues.add(entry);
+				Value** items = value->getItems();
+				for (int i = 0; i < count; i++) {
+					int child = addValue(items[i]);
+					mChildren[first + i] = child;
+				}
+				return index;
+			}
+
+			default:
+				break;
+		}
+
+		mValues.add(entry);
+		return mValues.size() - 1;
+	}
+
+	/**
+	 * \return The size of the snapshot.
+	 */
+	int getSize() const {
+		return sizeof(SnapshotHeader)
+				+ mValues.size() * sizeof(SnapshotValue)
+				+ mChildren.size() * sizeof(int)
+				+ mShapes.size() * sizeof(SnapshotShape)
+				+ mKeys.size() * sizeof(SnapshotKey)
+				+ mPoolSize;
+	}
+
+	void write(int root, Writer& writer) {
+		SnapshotHeader header;
+		header.magic = SNAPSHOT_MAGIC;
+		header.version = SNAPSHOT_VERSION;
+		header.size = getSize();
+		header.root = root;
+		header.valueCount = mValues.size();
+		header.containerCount = mContainerCount;
+		header.childCount = mChildren.size();
+		header.shapeCount = mShapes.size();
+		header.keyCount = mKeys.size();
+		header.poolSize = mPoolSize;
+
+		writer.write((const char*) &header, sizeof(header));
+		writer.write((const char*) mValues.pointer(),
+				mValues.size() * sizeof(SnapshotValue));
+		writer.write((const char*) mChildren.pointer(),
+				mChildren.size() * sizeof(int));
+		writer.write((const char*) mShapes.pointer(),
+				mShapes.size() * sizeof(SnapshotShape));
+		writer.write((const char*) mKeys.pointer(),
+				mKeys.size() * sizeof(SnapshotKey));
+		writer.write(mPool.getData(), mPoolSize);
+		writer.flush();
+	}
+
+private:
+	/**
+	 * \return The offset of a copy of text in the string pool.
+	 */
+	int addText(const char* text, int length) {
+		int offset = mPoolSize;
+		mPool.write(text, length);
+		mPool.write((char) 0);
+		mPoolSize += length + 1;
+		return offset;
+	}
+
+	static unsigned int hashShape(const Shape* shape) {
+		unsigned int hash = shape->count;
+		const ShapeKey* keys = shape->getKeys();
+		for (int i = 0; i < shape->count; i++)
+			hash = hash * 31 + KeyTable::hash(keys[i].key, keys[i].keyLength);
+		return hash;
+	}
+
+	static bool equalShapes(const Shape* a, const Shape* b) {
+		if (a == b)
+			return true;
+		if (a->count != b->count)
+			return false;
+		const ShapeKey* aKeys = a->getKeys();
+		const ShapeKey* bKeys = b->getKeys();
+		for (int i = 0; i < a->count; i++)
+			if (aKeys[i].keyLength != bKeys[i].keyLength
+					|| memcmp(aKeys[i].key, bKeys[i].key,
+							aKeys[i].keyLength) != 0)
+				return false;
+		return true;
+	}
+
+	/**
+	 * \return The number of the snapshot shape with the keys of shape,
+	 * which is added if there is none. Heap maps have a shape each, so
+	 * shapes are compared by their keys.
+	 */
+	int addShape(const Shape* shape) {
+		// The maps of an array usually share a shape.
+		if (shape == mLastShape)
+			return mLastShapeIndex;
+		mLastShape = shape;
+		mLastShapeIndex = findShape(shape);
+		return mLastShapeIndex;
+	}
+
+	int findShape(const Shape* shape) {
+		// Keep the table at most half full.
+		if (mShapes.size() * 2 >= mShapeTable.size())
+			growShapeTable();
+
+		int mask = mShapeTable.size() - 1;
+		int slot = hashShape(shape) & mask;
+		while (mShapeTable[slot]) {
+			int i = mShapeTable[slot] - 1;
+			if (equalShapes(mSourceShapes[i], shape))
+				return i;
+			slot = (slot + 1) & mask;
+		}
+
+		SnapshotShape entry;
+		entry.firstKey = mKeys.size();
+		entry.count = shape->count;
+		const ShapeKey* keys = shape->getKeys();
+		for (int i = 0; i < shape->count; i++) {
+			SnapshotKey key;
+			key.offset = addText(keys[i].key, keys[i].keyLength);
+			key.length = keys[i].keyLength;
+			mKeys.add(key);
+		}
+		mShapes.add(entry);
+		mSourceShapes.add(shape);
+		mShapeTable[slot] = mShapes.size();
+		return mShapes.size() - 1;
+	}
+
+	void growShapeTable() {
+		int size = mShapeTable.size() ? mShapeTable.size() * 2 : 64;
+		mShapeTable.clear();
+		mShapeTable.resize(size);
+		for (int slot = 0; slot < size; slot++)
+			mShapeTable[slot] = 0;
+		for (int i = 0; i < mSourceShapes.size(); i++) {
+			int slot = hashShape(mSourceShapes[i]) & (size - 1);
+			while (mShapeTable[slot])
+				slot = (slot + 1) & (size - 1);
+			mShapeTable[slot] = i + 1;
+		}
+	}
+
+	Vector<SnapshotValue> mValues;
+	Vector<int> mChildren;
+	Vector<SnapshotShape> mShapes;
+	Vector<SnapshotKey> mKeys;
+	int mContainerCount;
+
+	/**
+	 * The shapes the snapshot shapes were made from, and an open
+	 * addressed hash table of them holding their numbers plus one.
+	 */
+	Vector<const Shape*> mSourceShapes;
+	Vector<int> mShapeTable;
+	const Shape* mLastShape;
+	int mLastShapeIndex;
+
+	BufferWriter mPool;
+	int mPoolSize;
+};
+
+/**
+ * Builds the values of a snapshot in a document, see
+ * Document::loadSnapshot(). Every offset and number in the snapshot is
+ * checked, so a damaged snapshot is rejected instead of crashing.
+ */
+class SnapshotReader {
+public:
+	SnapshotReader(Arena& arena, KeyTable* keys) :
+		mArena(arena), mKeys(keys) {
+	}
+
+	/**
+	 * \return The root, or NULL if the snapshot is not valid.
+	 */
+	Value* read(const unsigned char* data, size_t length, bool zeroCopy) {
+		if (length < sizeof(SnapshotHeader))
+			return NULL;
+		const SnapshotHeader* header = (const SnapshotHeader*) data;
+		if (header->magic != SNAPSHOT_MAGIC
+				|| header->version != SNAPSHOT_VERSION
+				|| header->size != (int) length)
+			return NULL;
+
+		// Check each count on its own first, so the sum cannot overflow.
+		int size = length;
+		if (!checkCount(header->valueCount, sizeof(SnapshotValue), size)
+				|| !checkCount(header->childCount, sizeof(int), size)
+				|| !checkCount(header->shapeCount, sizeof(SnapshotShape), size)
+				|| !checkCount(header->keyCount, sizeof(SnapshotKey), size)
+				|| !checkCount(header->poolSize, 1, size)
+				|| header->containerCount < 0
+				|| header->containerCount > header->valueCount)
+			return NULL;
+		if (sizeof(SnapshotHeader)
+				+ header->valueCount * sizeof(SnapshotValue)
+				+ header->childCount * sizeof(int)
+				+ header->shapeCount * sizeof(SnapshotShape)
+				+ header->keyCount * sizeof(SnapshotKey)
+				+ header->poolSize != length)
+			return NULL;
+		if (header->root < 0 || header->root >= header->valueCount)
+			return NULL;
+
+		mEntries = (const SnapshotValue*) (header + 1);
+		mChildren = (const int*) (mEntries + header->valueCount);
+		const SnapshotShape* shapes = (const SnapshotShape*) (mChildren
+				+ header->childCount);
+		const SnapshotKey* keys = (const SnapshotKey*) (shapes
+				+ header->shapeCount);
+		const char* pool = (const char*) (keys + header->keyCount);
+		mValueCount = header->valueCount;
+		mChildCount = header->childCount;
+		mPoolSize = header->poolSize;
+
+		if (zeroCopy) {
+			mPool = pool;
+		} else {
+			char* copy = (char*) mArena.allocate(mPoolSize);
+			memcpy(copy, pool, mPoolSize);
+			mPool = copy;
+		}
+
+		if (!readShapes(shapes, header->shapeCount, keys, header->keyCount))
+			return NULL;
+
+		// The values and the containers each take one allocation.
+		mValues = (Value*) mArena.allocate(mValueCount * sizeof(Value));
+		mStorageLeft = header->containerCount;
+		mChildrenLeft = mChildCount;
+		mStorage = (char*) mArena.allocate(
+				mStorageLeft * sizeof(Value::Storage)
+				+ mChildrenLeft * sizeof(Value*));
+		for (int i = 0; i < mValueCount; i++)
+			if (!readValue(i))
+				return NULL;
+		return mValues + header->root;
+	}
+
+private:
+	static bool checkCount(int count, int itemSize, int size) {
+		return count >= 0 && count <= size / itemSize;
+	}
+
+	/**
+	 * \return true if the pool has length bytes at offset, followed by
+	 * a terminator.
+	 */
+	bool checkText(int offset, int length) const {
+		return offset >= 0 && length >= 0 && offset < mPoolSize
+				&& length < mPoolSize - offset
+				&& mPool[offset + length] == 0;
+	}
+
+	bool readShapes(const SnapshotShape* shapes, int shapeCount,
+			const SnapshotKey* keys, int keyCount) {
+		bool interned = mKeys != NULL;
+		mShapes = (Shape**) mArena.allocate(shapeCount * sizeof(Shape*));
+		for (int i = 0; i < shapeCount; i++) {
+			const SnapshotShape& entry = shapes[i];
+			if (entry.firstKey < 0 || entry.count <= 0
+					|| entry.count > keyCount - entry.firstKey)
+				return false;
+
+			Shape* shape = allocShape(&mArena, entry.count);
+			for (int k = 0; k < entry.count; k++) {
+				const SnapshotKey& key = keys[entry.firstKey + k];
+				if (!checkText(key.offset, key.length))
+					return false;
+				const char* text = mPool + key.offset;
+				if (interned)
+					text = mKeys->intern(text, key.length);
+				addShapeKey(&mArena, shape, interned, text, key.length);
+			}
+			shape->shared = true;
+			mShapes[i] = shape;
+		}
+		mShapeCount = shapeCount;
+		return true;
+	}
+
+	bool readValue(int i) {
+		const SnapshotValue& entry = mEntries[i];
+		Value* value = new (mValues + i) Value((Value::Type) entry.type,
+				&mArena);
+		value->mSize = entry.size;
+
+		switch (entry.type) {
+			case Value::NUL:
+				return true;
+
+			case Value::BOOLEAN:
+				value->mData.boolean = entry.data.ref.offset != 0;
+				return true;
+
+			case Value::NUMBER:
+				if (entry.flags & SnapshotValue::INTEGER) {
+					value->mFlags |= Value::INTEGER;
+					value->mData.integer = entry.data.integer;
+				} else if (entry.flags & SnapshotValue::NUMBER_TEXT) {
+					if (!checkText(entry.data.ref.offset, entry.size))
+						return false;
+					value->mFlags |= Value::NUMBER_TEXT;
+					value->mData.string = mPool + entry.data.ref.offset;
+				} else {
+					value->mData.number = entry.data.number;
+				}
+				return true;
+
+			case Value::STRING:
+				if (!checkText(entry.data.ref.offset, entry.size))
+					return false;
+				value->mData.string = mPool + entry.data.ref.offset;
+				return true;
+
+			case Value::ARRAY:
+			case Value::MAP:
+				return readContainer(i, value, entry);
+
+			default:
+				return false;
+		}
+	}
+
+	bool readContainer(int i, Value* value, const SnapshotValue& entry) {
+		int count = entry.size;
+		int first = entry.data.ref.offset;
+		if (count < 0 || first < 0 || count > mChildCount - first
+				|| count > mChildrenLeft || mStorageLeft == 0)
+			return false;
+
+		Shape* shape = NULL;
+		if (entry.type == Value::MAP && count > 0) {
+			int s = entry.data.ref.shape;
+			if (s < 0 || s >= mShapeCount || mShapes[s]->count != count)
+				return false;
+			shape = mShapes[s];
+		}
+
+		Value::Storage* storage = (Value::Storage*) mStorage;
+		mStorage += sizeof(Value::Storage) + count * sizeof(Value*);
+		mStorageLeft--;
+		mChildrenLeft -= count;
+		storage->arena = &mArena;
+		storage->capacity = count;
+		storage->keys = entry.type == Value::MAP ? mKeys : NULL;
+		storage->shape = shape;
+		value->mData.storage = storage;
+
+		Value** items = value->getItems();
+		for (int k = 0; k < count; k++) {
+			int child = mChildren[first + k];
+			if (child <= i || child >= mValueCount)
+				return false;
+			items[k] = mValues + child;
+		}
+		return true;
+	}
+
+	Arena& mArena;
+	KeyTable* mKeys;
+
+	const SnapshotValue* mEntries;
+	const int* mChildren;
+	int mValueCount;
+	int mChildCount;
+	const char* mPool;
+	int mPoolSize;
+	Shape** mShapes;
+	int mShapeCount;
+
+	Value* mValues;
+
+	/**
+	 * Where the storage of the next container goes, and how many
+	 * containers and children there is room for.
+	 */
+	char* mStorage;
+	int mStorageLeft;
+	int mChildrenLeft;
+};
+
+void writeSnapshot(const Value* value, Writer& writer) {
+	SnapshotWriter snapshot;
+	NullValue null;
+	int root = snapshot.addValue(value ? value : &null);
+	snapshot.write(root, writer);
+}
+
+int writeSnapshotToData(const Value* value, MAHandle placeholder) {
+	SnapshotWriter snapshot;
+	NullValue null;
+	int root = snapshot.addValue(value ? value : &null);
+	int result = maCreateData(placeholder, snapshot.getSize());
+	if (result != RES_OK)
+		return result;
+
+	DataWriter writer(placeholder);
+	snapshot.write(root, writer);
+	return RES_OK;
+}
+
+bool Document::loadSnapshot(const unsigned char* data, size_t length,
+		int flags) {
+	clear();
+	SnapshotReader reader(mArena, mKeys);
+	mRoot = reader.read(data, length, (flags & ZERO_COPY) != 0);
+	if (!mRoot)
+		mArena.reset();
+	// Take the snapshot even on failure, like parse().
+	if ((flags & ADOPT_TEXT) == ADOPT_TEXT)
+		mText = (unsigned char*) data;
+	return mRoot != NULL;
+}
+
+bool Document::loadSnapshot(MAHandle data) {
+	int size = maGetDataSize(data);
+	unsigned char* snapshot = (unsigned char*) malloc(size > 0 ? size : 1);
+	if (!snapshot) {
+		clear();
+		return false;
+	}
+	maReadData(data, snapshot, 0, size);
+	return loadSnapshot(snapshot, size, ADOPT_TEXT);
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
@@ -0,0 +1,88 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Snapshot.h
+ *
+ *  Binary snapshots of document trees, for saving a parsed response
+ *  and loading it again without parsing:
+ *
+ *  writeSnapshotToData(document.getRoot(), placeholder);
+ *  ...
+ *  Document cached;
+ *  cached.loadSnapshot(data);
+ */
+
+#ifndef _YAJL_DOM_SNAPSHOT_H_
+#define _YAJL_DOM_SNAPSHOT_H_
+
+#include <ma.h>
+
+#include "YAJLDom.h"
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * A snapshot holds no pointers. It has a header followed by five
+ * tables:
+ *
+ *   The values, 16 bytes each, in document order. A container refers
+ *   to its children as a range of the child table, a string to its
+ *   text as an offset in the string pool.
+ *   The children, as value numbers. A child always comes after its
+ *   container, so a snapshot cannot describe a cycle.
+ *   The shapes of the maps, each a range of the key table. Maps with
+ *   the same keys in the same order share one shape.
+ *   The keys, as offsets and lengths in the string pool.
+ *   The string pool, holding null terminated strings, keys and the
+ *   text of numbers.
+ *
+ * Integers are in the byte order of the device that wrote the
+ * snapshot. A snapshot from a device with another byte order, or
+ * another version of the format, is rejected when loaded.
+ *
+ * Loading a snapshot, see Document::loadSnapshot(), makes one pass
+ * over the tables and allocates the values and containers in a few
+ * large blocks. Strings are not decoded, numbers are not converted
+ * and keys are not hashed, except for maps with many keys.
+ */
+enum {
+	SNAPSHOT_VERSION = 1
+};
+
+/**
+ * Write a value and everything in it as a snapshot.
+ * \param value The value, NULL is written as null.
+ * \param writer Receives the snapshot. Flushed when done.
+ */
+void writeSnapshot(const Value* value, Writer& writer);
+
+/**
+ * Write a snapshot into a new data object, to be saved in a store.
+ * \param value The value, NULL is written as null.
+ * \param placeholder Where the data object is created, it has the
+ * size of the snapshot.
+ * \return RES_OK, or RES_OUT_OF_MEMORY if the data object could not be
+ * created.
+ */
+int writeSnapshotToData(const Value* value, MAHandle placeholder);
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_SNAPSHOT_H_
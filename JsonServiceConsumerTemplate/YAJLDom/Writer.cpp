@@ -0,0 +1,130 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Writer.cpp
+ *
+ *  Output sinks for serialized Json text.
+ */
+
+#include "Writer.h"
+#include <maheap.h>
+#include <mastring.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+Writer::Writer() :
+	mLength(0) {
+}
+
+Writer::~Writer() {
+}
+
+void Writer::write(const char* data, int length) {
+	if (mLength + length > BUFFER_SIZE) {
+		flush();
+		// Large blocks are passed on directly.
+		if (length > BUFFER_SIZE) {
+			output(data, length);
+			return;
+		}
+	}
+	memcpy(mBuffer + mLength, data, length);
+	mLength += length;
+}
+
+void Writer::flush() {
+	if (mLength) {
+		output(mBuffer, mLength);
+		mLength = 0;
+	}
+}
+
+BufferWriter::BufferWriter() :
+	mData(NULL), mSize(0), mCapacity(0) {
+}
+
+BufferWriter::~BufferWriter() {
+	free(mData);
+}
+
+const char* BufferWriter::getData() {
+	flush();
+	return mData ? mData : "";
+}
+
+int BufferWriter::getLength() {
+	flush();
+	return mSize;
+}
+
+void BufferWriter::clear() {
+	flush();
+	mSize = 0;
+	if (mData)
+		mData[0] = 0;
+}
+
+void BufferWriter::output(const char* data, int length) {
+	// Room for the terminating null.
+	if (mSize + length + 1 > mCapacity) {
+		int capacity = mCapacity ? mCapacity : 1024;
+		while (capacity < mSize + length + 1)
+			capacity *= 2;
+		char* newData = (char*) realloc(mData, capacity);
+		if (!newData)
+			maPanic(1, "YAJLDom::BufferWriter, out of memory.");
+		mData = newData;
+		mCapacity = capacity;
+	}
+	memcpy(mData + mSize, data, length);
+	mSize += length;
+	mData[mSize] = 0;
+}
+
+CallbackWriter::CallbackWriter(Callback callback, void* context) :
+	mCallback(callback), mContext(context) {
+}
+
+CallbackWriter::~CallbackWriter() {
+	flush();
+}
+
+void CallbackWriter::output(const char* data, int length) {
+	mCallback(mContext, data, length);
+}
+
+DataWriter::DataWriter(MAHandle data, int offset) :
+	mData(data), mOffset(offset) {
+}
+
+DataWriter::~DataWriter() {
+	flush();
+}
+
+int DataWriter::getOffset() const {
+	return mOffset;
+}
+
+void DataWriter::output(const char* data, int length) {
+	maWriteData(mData, data, mOffset, length);
+	mOffset += length;
+}
+
+} // namespace YAJLDom
+} // namespace MAUtil
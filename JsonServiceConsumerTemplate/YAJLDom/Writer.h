@@ -0,0 +1,150 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Writer.h
+ *
+ *  Output sinks for serialized Json text.
+ */
+
+#ifndef _YAJL_DOM_WRITER_H_
+#define _YAJL_DOM_WRITER_H_
+
+#include <ma.h>
+
+namespace MAUtil {
+namespace YAJLDom {
+
+/**
+ * Receives text in pieces. Writes are collected in a small buffer
+ * and passed on to output() in larger blocks, so writing one character
+ * at a time is cheap. Call flush() to pass on the rest, serialize()
+ * does this when it is done.
+ */
+class Writer {
+public:
+	Writer();
+	virtual ~Writer();
+
+	void write(const char* data, int length);
+
+	void write(char c) {
+		if (mLength == BUFFER_SIZE)
+			flush();
+		mBuffer[mLength++] = c;
+	}
+
+	/**
+	 * Pass on the buffered text to output().
+	 */
+	void flush();
+
+protected:
+	/**
+	 * Called with the next block of text.
+	 */
+	virtual void output(const char* data, int length) = 0;
+
+private:
+	enum { BUFFER_SIZE = 512 };
+
+	char mBuffer[BUFFER_SIZE];
+	int mLength;
+};
+
+/**
+ * Collects the text in a growable buffer.
+ */
+class BufferWriter : public Writer {
+public:
+	BufferWriter();
+	~BufferWriter();
+
+	/**
+	 * \return The text written so far, null terminated. Flushes the
+	 * writer.
+	 */
+	const char* getData();
+
+	/**
+	 * \return The length of the text written so far. Flushes the
+	 * writer.
+	 */
+	int getLength();
+
+	/**
+	 * Remove the text. The buffer is kept for reuse.
+	 */
+	void clear();
+
+protected:
+	void output(const char* data, int length);
+
+private:
+	char* mData;
+	int mSize;
+	int mCapacity;
+};
+
+/**
+ * Passes the text to a callback, with the same signature as the
+ * yajl_print_t callback given to yajl_gen_alloc2.
+ */
+class CallbackWriter : public Writer {
+public:
+	typedef void (*Callback)(void* context, const char* str, unsigned int length);
+
+	CallbackWriter(Callback callback, void* context);
+	~CallbackWriter();
+
+protected:
+	void output(const char* data, int length);
+
+private:
+	Callback mCallback;
+	void* mContext;
+};
+
+/**
+ * Writes the text into a data object, which must be large enough.
+ */
+class DataWriter : public Writer {
+public:
+	/**
+	 * \param data The data object.
+	 * \param offset Where to start writing.
+	 */
+	DataWriter(MAHandle data, int offset = 0);
+	~DataWriter();
+
+	/**
+	 * \return The offset after the text written so far, once flushed.
+	 */
+	int getOffset() const;
+
+protected:
+	void output(const char* data, int length);
+
+private:
+	MAHandle mData;
+	int mOffset;
+};
+
+} // namespace YAJLDom
+} // namespace MAUtil
+
+#endif // _YAJL_DOM_WRITER_H_
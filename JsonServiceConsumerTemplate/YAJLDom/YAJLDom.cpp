@@ -23,6 +23,13 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
  */
 
 #include "YAJLDom.h"
+#include "Path.h"
+#include "Number.h"
+#include "Shape.h"
+#include <new>
+#include <maheap.h>
+#include <mastring.h>
+#include <mastdlib.h>
 #include <MAUtil/util.h>
 #include <MAUtil/Stack.h>
 #include <yajl/yajl_parse.h>
@@ -43,13 +50,260 @@ using namespace YAJLDomUtil;
 namespace MAUtil {
 namespace YAJLDom {
 
+// Values must stay compact, see the Value class comment.
+typedef char ValueSizeCheck[sizeof(Value) <= 16 ? 1 : -1];
+
+// Maps with more entries than this get a hash index. Smaller maps
+// are faster to search linearly, their entries fit in a cache line
+// or two.
+static const int INDEX_THRESHOLD = 8;
+
+// Size of the shape table of a Parser, and the most shapes a parse
+// creates. Maps with new keys after that get their own shape, which
+// keeps documents with many different objects from filling the table.
+static const int SHAPE_BUCKETS = 256;
+static const int MAX_SHAPES = 1024;
+
+// The first block of the arena that yajl allocates from. It holds the
+// parser, the generator, their state stacks and their first buffers.
+// Json text shorter than YAJL_MAX_HINT gets room for strings of its
+// whole length as well.
+static const int YAJL_ARENA_SIZE = 8 * 1024;
+static const int YAJL_MAX_HINT = 64 * 1024;
+
+// Returned for missing keys and indices. It is never modified, so all
+// parsers and readers can share it.
 static NullValue sNullValue;
 
-Value::Value(Type type) :
-	mType(type) {
+#ifdef YAJLDOM_STATS
+// Heap allocations for ParseStats. Arenas count their own. Atomic,
+// since heap parses run on the threads of BatchParser and
+// ParallelParser.
+static int sHeapAllocations = 0;
+static int sHeapBytes = 0;
+
+static void countHeapAllocation(int size) {
+	__sync_fetch_and_add(&sHeapAllocations, 1);
+	__sync_fetch_and_add(&sHeapBytes, size);
+}
+
+template<class T>
+static T* countHeapValue(T* value) {
+	countHeapAllocation(sizeof(T));
+	return value;
+}
+
+#define heapvalue(type, args) countHeapValue(newobject(type, new type args))
+#else
+#define heapvalue(type, args) newobject(type, new type args)
+#endif
+
+// Allocate a value in an arena, or on the heap if the arena is NULL.
+// args is the parenthesized constructor argument list.
+#define newvalue(arena, type, args) \
+	((arena) ? new ((arena)->allocate(sizeof(type))) type args \
+		: heapvalue(type, args))
+
+// Allocate and free storage for strings and containers.
+static void* allocStorage(Arena* arena, int size) {
+	if (arena)
+		return arena->allocate(size);
+#ifdef YAJLDOM_STATS
+	countHeapAllocation(size);
+#endif
+	void* ptr = malloc(size);
+	if (!ptr)
+		maPanic(1, "YAJLDom, out of memory.");
+	return ptr;
+}
+
+static void* reallocStorage(Arena* arena, void* ptr, int oldSize, int newSize) {
+	if (arena)
+		return arena->reallocate(ptr, oldSize, newSize);
+#ifdef YAJLDOM_STATS
+	countHeapAllocation(newSize);
+#endif
+	ptr = realloc(ptr, newSize);
+	if (!ptr)
+		maPanic(1, "YAJLDom, out of memory.");
+	return ptr;
+}
+
+static void freeStorage(Arena* arena, void* ptr) {
+	// Arena storage is released with the arena.
+	if (!arena)
+		free(ptr);
+}
+
+static char* copyStorage(Arena* arena, const char* str, int length) {
+	char* copy = (char*) allocStorage(arena, length + 1);
+	memcpy(copy, str, length);
+	copy[length] = 0;
+	return copy;
+}
+
+static unsigned int hashKey(bool interned, const char* key, int keyLength) {
+	// Interned keys are unique, their address is enough.
+	if (interned)
+		return (unsigned int) ((size_t) key >> 3) * 2654435761u;
+	return KeyTable::hash(key, keyLength);
+}
+
+
+static bool equalKeys(bool interned, const ShapeKey& shapeKey,
+		const char* key, int keyLength) {
+	if (interned)
+		return shapeKey.key == key;
+	return shapeKey.keyLength == keyLength
+			&& memcmp(shapeKey.key, key, keyLength) == 0;
+}
+
+/**
+ * \return The slot of the key, or -1 if it is not in the shape.
+ * Interned keys must be given as the pointer from the KeyTable.
+ * \param textHash KeyTable::hash() of the key, used if the key is not
+ * interned and the shape has an index.
+ */
+static int findShapeKey(const Shape* shape, bool interned, const char* key,
+		int keyLength, unsigned int textHash) {
+	const ShapeKey* keys = shape->getKeys();
+	if (!shape->index) {
+		for (int i = 0; i < shape->count; i++)
+			if (equalKeys(interned, keys[i], key, keyLength))
+				return i;
+		return -1;
+	}
+
+	int mask = shape->indexSize - 1;
+	int slot = (interned ? hashKey(true, key, keyLength) : textHash) & mask;
+	while (shape->index[slot]) {
+		int i = shape->index[slot] - 1;
+		if (equalKeys(interned, keys[i], key, keyLength))
+			return i;
+		slot = (slot + 1) & mask;
+	}
+	return -1;
+}
+
+static int findShapeKey(const Shape* shape, bool interned, const char* key,
+		int keyLength) {
+	// Only a shape with an index needs the hash of the text.
+	unsigned int textHash = interned || !shape->index ? 0
+			: KeyTable::hash(key, keyLength);
+	return findShapeKey(shape, interned, key, keyLength, textHash);
+}
+
+static void indexShapeKey(Shape* shape, bool interned, int i) {
+	const ShapeKey& key = shape->getKeys()[i];
+	int mask = shape->indexSize - 1;
+	int slot = hashKey(interned, key.key, key.keyLength) & mask;
+	while (shape->index[slot])
+		slot = (slot + 1) & mask;
+	shape->index[slot] = i + 1;
+}
+
+/**
+ * Make room in the index for capacity keys, if the shape needs one.
+ */
+static void reserveShapeIndex(Arena* arena, Shape* shape, bool interned,
+		int capacity) {
+	// Keep the index at most half full.
+	if (capacity <= INDEX_THRESHOLD || capacity * 2 <= shape->indexSize)
+		return;
+	int indexSize = 16;
+	while (indexSize < capacity * 2)
+		indexSize *= 2;
+
+	// An old arena index stays in the arena until it is reset.
+	freeStorage(arena, shape->index);
+	shape->index = (int*) allocStorage(arena, indexSize * sizeof(int));
+	shape->indexSize = indexSize;
+	memset(shape->index, 0, indexSize * sizeof(int));
+	for (int i = 0; i < shape->count; i++)
+		indexShapeKey(shape, interned, i);
+}
+
+Shape* allocShape(Arena* arena, int capacity) {
+	Shape* shape = (Shape*) allocStorage(arena,
+			sizeof(Shape) + capacity * sizeof(ShapeKey));
+	shape->count = 0;
+	shape->capacity = capacity;
+	shape->index = NULL;
+	shape->indexSize = 0;
+	shape->shared = false;
+	shape->hash = 0;
+	shape->next = NULL;
+	return shape;
+}
+
+void addShapeKey(Arena* arena, Shape* shape, bool interned,
+		const char* key, int keyLength) {
+	ShapeKey& shapeKey = shape->getKeys()[shape->count++];
+	shapeKey.key = key;
+	shapeKey.keyLength = keyLength;
+	if (shape->index)
+		indexShapeKey(shape, interned, shape->count - 1);
+	else
+		reserveShapeIndex(arena, shape, interned, shape->count);
+}
+
+CachedKey::CachedKey(const char* key) :
+	mKey(key), mLength(strlen(key)), mHash(KeyTable::hash(key, mLength)),
+	mShape(NULL), mSlot(0) {
+}
+
+CachedKey::CachedKey(const char* key, int keyLength) :
+	mKey(key), mLength(keyLength), mHash(KeyTable::hash(key, keyLength)),
+	mShape(NULL), mSlot(0) {
+}
+
+const char* CachedKey::getKey() const {
+	return mKey;
+}
+
+int CachedKey::getKeyLength() const {
+	return mLength;
+}
+
+Value::Value(Type type, Arena* arena) :
+	mType(type), mFlags(arena ? IN_ARENA : 0), mReserved(0), mSize(0) {
+	mData.storage = NULL;
 }
 
 Value::~Value() {
+	// Arena values are released with the arena.
+	if (mFlags & IN_ARENA)
+		return;
+
+	switch (mType) {
+		case STRING:
+			free((void*) mData.string);
+			break;
+		case MAP: {
+			// Heap maps own their shape and keys.
+			Value** items = getItems();
+			Shape* shape = getShape();
+			for (int i = 0; i < mSize; i++) {
+				free((void*) shape->getKeys()[i].key);
+				deleteValue(items[i]);
+			}
+			if (shape) {
+				free(shape->index);
+				free(shape);
+			}
+			free(mData.storage);
+		}
+		break;
+		case ARRAY: {
+			Value** items = getItems();
+			for (int i = 0; i < mSize; i++)
+				deleteValue(items[i]);
+			free(mData.storage);
+		}
+		break;
+		default:
+			break;
+	}
 }
 
 bool Value::isNull() const {
@@ -57,232 +311,914 @@ bool Value::isNull() const {
 }
 
 Value::Type Value::getType() const {
-	return mType;
+	return (Type) mType;
+}
+
+bool Value::isArenaValue() const {
+	return (mFlags & IN_ARENA) != 0;
+}
+
+void* Value::allocateStorage(Arena* arena, int capacity, int itemSize) {
+	int size = sizeof(Storage) + capacity * itemSize;
+	Storage* storage = (Storage*) allocStorage(arena, size);
+	storage->arena = arena;
+	storage->capacity = capacity;
+	storage->keys = NULL;
+	storage->shape = NULL;
+	mData.storage = storage;
+	return storage;
+}
+
+void Value::growStorage(int capacity, int itemSize) {
+	Storage* storage = mData.storage;
+	if (!storage) {
+		// Only heap containers start out without storage.
+		allocateStorage(NULL, capacity, itemSize);
+		return;
+	}
+	if (capacity <= storage->capacity)
+		return;
+	storage = (Storage*) reallocStorage(storage->arena, storage,
+			sizeof(Storage) + storage->capacity * itemSize,
+			sizeof(Storage) + capacity * itemSize);
+	storage->capacity = capacity;
+	mData.storage = storage;
+}
+
+Arena* Value::getStorageArena() const {
+	return mData.storage ? mData.storage->arena : NULL;
+}
+
+int Value::getCapacity() const {
+	return mData.storage ? mData.storage->capacity : 0;
+}
+
+Value** Value::getItems() const {
+	return (Value**) (mData.storage + 1);
+}
+
+Shape* Value::getShape() const {
+	return mData.storage ? mData.storage->shape : NULL;
+}
+
+bool Value::hasInternedKeys() const {
+	return mData.storage && mData.storage->keys;
+}
+
+int Value::findKey(const char* key, int keyLength) const {
+	return findKey(key, keyLength, KeyTable::hash(key, keyLength));
+}
+
+int Value::findKey(const char* key, int keyLength, unsigned int hash) const {
+	Shape* shape = getShape();
+	if (!shape)
+		return -1;
+
+	KeyTable* keys = mData.storage->keys;
+	if (keys) {
+		// A key that is not in the table is not in any map using it.
+		key = keys->find(key, keyLength, hash);
+		if (!key)
+			return -1;
+	}
+	return findShapeKey(shape, keys != NULL, key, keyLength, hash);
+}
+
+String Value::toString() const {
+	switch (mType) {
+		case NUL:
+			return "";
+
+		case BOOLEAN:
+			if (mData.boolean == true)
+				return "true";
+			else
+				return "false";
+
+		case NUMBER:
+			if (mFlags & INTEGER) {
+				char buffer[24];
+				return String(buffer, formatInteger(mData.integer, buffer));
+			}
+			if (mFlags & NUMBER_TEXT)
+				return String(mData.string, mSize);
+			return doubleToString(mData.number);
+
+		case STRING:
+			return String(mData.string, mSize);
+
+		case MAP:
+		case ARRAY: {
+			BufferWriter writer;
+			serialize(this, writer);
+			return String(writer.getData(), writer.getLength());
+		}
+	}
+	return "";
 }
 
 bool Value::toBoolean() const {
-	String ret = toString();
-	if (ret == "true")
+	bool value;
+	if (tryGetBool(value))
+		return value;
+	if (mType == STRING) {
+		if (mSize == 4 && memcmp(mData.string, "true", 4) == 0)
+			return true;
+		if (mSize == 5 && memcmp(mData.string, "false", 5) == 0)
+			return false;
+	}
+	maPanic(1, "Not a boolean value!");
+	return false;
+}
+
+// Strings are converted through a null terminated copy on the stack,
+// other values that are not numbers convert to 0.
+static const int MAX_NUMBER_STRING = 64;
+
+int Value::toInt() const {
+	if (mType == NUMBER)
+		return (int) toInt64();
+	if (mType != STRING)
+		return 0;
+	if (mSize >= MAX_NUMBER_STRING)
+		return stringToInteger(toString());
+	char buffer[MAX_NUMBER_STRING];
+	memcpy(buffer, mData.string, mSize);
+	buffer[mSize] = 0;
+	return (int) strtol(buffer, NULL, 10);
+}
+
+double Value::toDouble() const {
+	double value;
+	if (tryGetDouble(value))
+		return value;
+	if (mType != STRING)
+		return 0;
+	if (mSize >= MAX_NUMBER_STRING)
+		return stringToDouble(toString());
+	char buffer[MAX_NUMBER_STRING];
+	memcpy(buffer, mData.string, mSize);
+	buffer[mSize] = 0;
+	return strtod(buffer, NULL);
+}
+
+long long Value::toInt64() const {
+	if (mType == NUMBER && (mFlags & INTEGER))
+		return mData.integer;
+
+	// Out of range doubles are clamped, NaN is 0.
+	double value = toDouble();
+	if (value >= 9223372036854775807.0)
+		return 0x7fffffffffffffffLL;
+	if (value <= -9223372036854775808.0)
+		return -0x7fffffffffffffffLL - 1;
+	if (value != value)
+		return 0;
+	return (long long) value;
+}
+
+bool Value::tryGetBool(bool& value) const {
+	if (mType != BOOLEAN)
+		return false;
+	value = mData.boolean;
+	return true;
+}
+
+bool Value::tryGetInt(int& value) const {
+	long long integer;
+	if (!tryGetInt64(integer) || integer != (int) integer)
+		return false;
+	value = (int) integer;
+	return true;
+}
+
+bool Value::tryGetInt64(long long& value) const {
+	if (mType != NUMBER)
+		return false;
+	if (mFlags & INTEGER) {
+		value = mData.integer;
 		return true;
-	if (ret == "false")
+	}
+
+	// Doubles must be whole numbers in range.
+	double number;
+	tryGetDouble(number);
+	if (!(number >= -9223372036854775808.0 && number < 9223372036854775808.0))
+		return false;
+	long long integer = (long long) number;
+	if ((double) integer != number)
+		return false;
+	value = integer;
+	return true;
+}
+
+bool Value::tryGetDouble(double& value) const {
+	if (mType != NUMBER)
 		return false;
+	if (mFlags & INTEGER)
+		value = (double) mData.integer;
+	else if (mFlags & NUMBER_TEXT)
+		value = parseDouble(mData.string, mSize);
 	else
-		maPanic(1, "Not a boolean value!");
+		value = mData.number;
+	return true;
 }
 
-int Value::toInt() const {
-	return stringToInteger(toString());
+const char* Value::getString() const {
+	return mType == STRING ? mData.string : "";
 }
 
-double Value::toDouble() const {
-	return stringToDouble(toString());
+int Value::getStringLength() const {
+	return mType == STRING ? mSize : 0;
+}
+
+/**
+ * Writes values as Json text, see serialize().
+ */
+class Serializer {
+public:
+	Serializer(Writer& writer, bool pretty) :
+		mWriter(writer), mPretty(pretty) {
+	}
+
+	void writeValue(const Value* value, int depth) {
+		switch (value->mType) {
+			case Value::NUL:
+				mWriter.write("null", 4);
+				break;
+
+			case Value::BOOLEAN:
+				if (value->mData.boolean)
+					mWriter.write("true", 4);
+				else
+					mWriter.write("false", 5);
+				break;
+
+			case Value::NUMBER:
+				writeNumber(value);
+				break;
+
+			case Value::STRING:
+				writeString(value->mData.string, value->mSize);
+				break;
+
+			case Value::MAP: {
+				mWriter.write('{');
+				const ShapeKey* keys = value->mSize ?
+						value->getShape()->getKeys() : NULL;
+				Value** items = value->getItems();
+				for (int i = 0; i < value->mSize; i++) {
+					if (i)
+						mWriter.write(',');
+					newLine(depth + 1);
+					writeString(keys[i].key, keys[i].keyLength);
+					mWriter.write(':');
+					if (mPretty)
+						mWriter.write(' ');
+					writeValue(items[i], depth + 1);
+				}
+				if (value->mSize)
+					newLine(depth);
+				mWriter.write('}');
+			}
+			break;
+
+			case Value::ARRAY: {
+				mWriter.write('[');
+				Value** items = value->getItems();
+				for (int i = 0; i < value->mSize; i++) {
+					if (i)
+						mWriter.write(',');
+					newLine(depth + 1);
+					writeValue(items[i], depth + 1);
+				}
+				if (value->mSize)
+					newLine(depth);
+				mWriter.write(']');
+			}
+			break;
+		}
+	}
+
+	void writeString(const char* str, int length) {
+		static const char hex[] = "0123456789abcdef";
+		const char* end = str + length;
+		const char* run = str;
+
+		mWriter.write('"');
+		for (const char* p = str; p < end; p++) {
+			unsigned char c = *p;
+			if (c >= 0x20 && c != '"' && c != '\\')
+				continue;
+
+			// Write the characters before the one that is escaped.
+			mWriter.write(run, p - run);
+			run = p + 1;
+
+			mWriter.write('\\');
+			switch (c) {
+				case '"': mWriter.write('"'); break;
+				case '\\': mWriter.write('\\'); break;
+				case '\b': mWriter.write('b'); break;
+				case '\f': mWriter.write('f'); break;
+				case '\n': mWriter.write('n'); break;
+				case '\r': mWriter.write('r'); break;
+				case '\t': mWriter.write('t'); break;
+				default:
+					mWriter.write("u00", 3);
+					mWriter.write(hex[c >> 4]);
+					mWriter.write(hex[c & 15]);
+					break;
+			}
+		}
+		mWriter.write(run, end - run);
+		mWriter.write('"');
+	}
+
+private:
+	void writeNumber(const Value* value) {
+		char buffer[32];
+		if (value->mFlags & Value::INTEGER) {
+			mWriter.write(buffer, formatInteger(value->mData.integer, buffer));
+			return;
+		}
+		if (value->mFlags & Value::NUMBER_TEXT) {
+			mWriter.write(value->mData.string, value->mSize);
+			return;
+		}
+
+		// Json has no infinity or NaN.
+		double number = value->mData.number;
+		if (number != number || number - number != 0) {
+			mWriter.write("null", 4);
+			return;
+		}
+		// The shortest of the usual precisions that reads back exactly.
+		int length = sprintf(buffer, "%.15g", number);
+		if (parseDouble(buffer, length) != number)
+			length = sprintf(buffer, "%.17g", number);
+		mWriter.write(buffer, length);
+	}
+
+	void newLine(int depth) {
+		if (!mPretty)
+			return;
+		mWriter.write('\n');
+		for (int i = 0; i < depth; i++)
+			mWriter.write("  ", 2);
+	}
+
+	Writer& mWriter;
+	bool mPretty;
+};
+
+/**
+ * Counts the length of the text, for serializeToData().
+ */
+class CountingWriter : public Writer {
+public:
+	CountingWriter() :
+		mCount(0) {
+	}
+
+	int getCount() {
+		flush();
+		return mCount;
+	}
+
+protected:
+	void output(const char* data, int length) {
+		mCount += length;
+	}
+
+private:
+	int mCount;
+};
+
+void serialize(const Value* value, Writer& writer, int flags) {
+	Serializer serializer(writer, (flags & PRETTY) != 0);
+	serializer.writeValue(value ? value : &sNullValue, 0);
+	writer.flush();
+}
+
+int serializeToData(const Value* value, MAHandle placeholder, int flags) {
+	// Measure first, the data object cannot grow.
+	CountingWriter counter;
+	serialize(value, counter, flags);
+	int result = maCreateData(placeholder, counter.getCount());
+	if (result != RES_OK)
+		return result;
+
+	DataWriter writer(placeholder);
+	serialize(value, writer, flags);
+	return RES_OK;
+}
+
+void serializeString(const char* str, int length, Writer& writer) {
+	Serializer serializer(writer, false);
+	serializer.writeString(str, length);
 }
 
 Value* Value::getValueForKey(const MAUtil::String& key) {
-	return &sNullValue;
+	return (Value*) ((const Value*) this)->getValueForKey(key.c_str(),
+			key.length());
 }
 
-Value* Value::getValueByIndex(int i) {
-	return &sNullValue;
+Value* Value::getValueForKey(const char* key) {
+	return (Value*) ((const Value*) this)->getValueForKey(key, strlen(key));
+}
+
+Value* Value::getValueForKey(const char* key, int keyLength) {
+	return (Value*) ((const Value*) this)->getValueForKey(key, keyLength);
 }
 
 const Value* Value::getValueForKey(const MAUtil::String& key) const {
-	return &sNullValue;
+	return getValueForKey(key.c_str(), key.length());
+}
+
+const Value* Value::getValueForKey(const char* key) const {
+	return getValueForKey(key, strlen(key));
+}
+
+const Value* Value::getValueForKey(const char* key, int keyLength) const {
+	if (mType != MAP)
+		return &sNullValue;
+	int i = findKey(key, keyLength);
+	if (i >= 0)
+		return getItems()[i];
+	else
+		return &sNullValue;
+}
+
+Value* Value::getValueForKey(const CachedKey& key) {
+	return (Value*) ((const Value*) this)->getValueForKey(key);
+}
+
+const Value* Value::getValueForKey(const CachedKey& key) const {
+	if (mType != MAP)
+		return &sNullValue;
+	int i = findKey(key);
+	if (i >= 0)
+		return getItems()[i];
+	else
+		return &sNullValue;
+}
+
+int Value::findKey(const CachedKey& key) const {
+	// Maps with the same shape have the key in the same slot. The key
+	// is compared as well, since a shape can change or be deallocated
+	// and another one created at the same address.
+	const Shape* shape = getShape();
+	int slot = key.mSlot;
+	if (shape && shape == key.mShape && slot < mSize) {
+		const ShapeKey& shapeKey = shape->getKeys()[slot];
+		if (shapeKey.keyLength == key.mLength
+				&& memcmp(shapeKey.key, key.mKey, key.mLength) == 0)
+			return slot;
+	}
+
+	int i = findKey(key.mKey, key.mLength, key.mHash);
+	if (i >= 0) {
+		key.mShape = shape;
+		key.mSlot = i;
+	}
+	return i;
+}
+
+Value* Value::getValueByIndex(int i) {
+	return (Value*) ((const Value*) this)->getValueByIndex(i);
 }
 
 const Value* Value::getValueByIndex(int i) const {
-	return &sNullValue;
+	if (mType != ARRAY || i < 0 || i >= mSize)
+		return &sNullValue;
+	return getItems()[i];
 }
 
 int Value::getNumChildValues() const {
-	return 0;
+	if (mType != ARRAY)
+		return 0;
+	return mSize;
 }
 
-NullValue::NullValue() :
-	Value(NUL) {
+int Value::getNumEntries() const {
+	if (mType != MAP)
+		return 0;
+	return mSize;
 }
 
-MAUtil::String NullValue::toString() const {
-	return "";
+const char* Value::getKeyByIndex(int i, int* keyLength) const {
+	if (mType != MAP || i < 0 || i >= mSize)
+		return NULL;
+	const ShapeKey& key = getShape()->getKeys()[i];
+	if (keyLength)
+		*keyLength = key.keyLength;
+	return key.key;
 }
 
-BooleanValue::BooleanValue(bool value) :
-	Value(BOOLEAN), mValue(value) {
+Value* Value::getEntryValue(int i) {
+	return (Value*) ((const Value*) this)->getEntryValue(i);
+}
 
+const Value* Value::getEntryValue(int i) const {
+	if (mType != MAP || i < 0 || i >= mSize)
+		return &sNullValue;
+	return getItems()[i];
 }
 
-MAUtil::String BooleanValue::toString() const {
-	if (mValue == true)
-		return "true";
-	else
-		return "false";
+Value* Value::copy(const Value* value, Arena* arena, KeyTable* keys,
+		bool deep) {
+	switch (value->mType) {
+		case NUL:
+			return newvalue(arena, NullValue, (arena));
+
+		case BOOLEAN:
+			return newvalue(arena, BooleanValue, (value->mData.boolean, arena));
+
+		case NUMBER:
+			if (value->mFlags & INTEGER)
+				return newvalue(arena, NumberValue,
+						(value->mData.integer, arena));
+			if (!(value->mFlags & NUMBER_TEXT))
+				return newvalue(arena, NumberValue,
+						(value->mData.number, arena));
+			// Heap numbers cannot refer to text, they are converted.
+			if (!arena)
+				return heapvalue(NumberValue, (value->toDouble()));
+			return new (arena->allocate(sizeof(NumberValue))) NumberValue(
+					copyStorage(arena, value->mData.string, value->mSize),
+					value->mSize, *arena);
+
+		case STRING:
+			return newvalue(arena, StringValue,
+					(value->mData.string, value->mSize, arena));
+
+		case MAP: {
+			MapValue* map = newvalue(arena, MapValue, (arena));
+			if (!value->mSize)
+				return map;
+			if (arena)
+				map->setKeyTable(keys);
+			map->reserve(value->mSize);
+			const ShapeKey* shapeKeys = value->getShape()->getKeys();
+			Value** items = value->getItems();
+			for (int i = 0; i < value->mSize; i++)
+				map->setValueForKey(shapeKeys[i].key, shapeKeys[i].keyLength,
+						deep ? copy(items[i], arena, keys) : items[i]);
+			return map;
+		}
+
+		case ARRAY: {
+			ArrayValue* array = newvalue(arena, ArrayValue, (arena));
+			if (!value->mSize)
+				return array;
+			array->reserve(value->mSize);
+			Value** items = value->getItems();
+			for (int i = 0; i < value->mSize; i++)
+				array->addValue(deep ? copy(items[i], arena, keys) : items[i]);
+			return array;
+		}
+	}
+	return NULL;
+}
+
+Value* copyValue(const Value* value) {
+	if (!value)
+		return NULL;
+	return Value::copy(value, NULL, NULL);
+}
+
+NullValue::NullValue(Arena* arena) :
+	Value(NUL, arena) {
 }
 
-bool BooleanValue::toBoolean() const {
-	return mValue;
+BooleanValue::BooleanValue(bool value, Arena* arena) :
+	Value(BOOLEAN, arena) {
+	mData.boolean = value;
 }
 
 void BooleanValue::setBoolean(bool value) {
-	mValue = value;
+	mData.boolean = value;
 }
 
-NumberValue::NumberValue(double num) :
-	Value(NUMBER), mValue(num) {
+NumberValue::NumberValue(double num, Arena* arena) :
+	Value(NUMBER, arena) {
+	mData.number = num;
 }
 
-String NumberValue::toString() const {
-	return doubleToString(mValue);
+NumberValue::NumberValue(int num, Arena* arena) :
+	Value(NUMBER, arena) {
+	mFlags |= INTEGER;
+	mData.integer = num;
 }
 
-int NumberValue::toInt() const {
-	return (int) mValue;
+NumberValue::NumberValue(long long num, Arena* arena) :
+	Value(NUMBER, arena) {
+	mFlags |= INTEGER;
+	mData.integer = num;
 }
 
-double NumberValue::toDouble() const {
-	return mValue;
+NumberValue::NumberValue(const char* text, int length, Arena& arena) :
+	Value(NUMBER, &arena) {
+	mFlags |= NUMBER_TEXT;
+	mSize = length;
+	mData.string = text;
 }
 
-StringValue::StringValue(const char* str, size_t length) :
-	Value(STRING), mValue(str, length) {
+StringValue::StringValue(const char* str, size_t length, Arena* arena) :
+	Value(STRING, arena) {
+	mSize = length;
+	mData.string = copyStorage(arena, str, mSize);
 }
 
 StringValue::StringValue(const String& str) :
-	Value(STRING), mValue(str) {
+	Value(STRING) {
+	mSize = str.length();
+	mData.string = copyStorage(NULL, str.c_str(), mSize);
 }
 
-String StringValue::toString() const {
-	return mValue;
+StringValue::StringValue(const char* str, size_t length, Arena& arena) :
+	Value(STRING, &arena) {
+	mSize = length;
+	mData.string = str;
 }
 
-MapValue::MapValue() :
-	Value(MAP) {
+MapValue::MapValue(Arena* arena) :
+	Value(MAP, arena) {
+	// Arena maps need their storage header to know where to grow.
+	if (arena)
+		allocateStorage(arena, 0, sizeof(Value*));
 }
 
-MapValue::~MapValue() {
-	Map<String, Value*>::Iterator iter = mMap.begin();
-	while (iter != mMap.end()) {
-		deleteobject(iter->second);
-		iter++;
-	}
+void MapValue::setKeyTable(KeyTable* keys) {
+	mData.storage->keys = keys;
 }
 
-void MapValue::setValueForKey(const String& key, Value* value) {
-	mMap[key] = value;
+void MapValue::setShape(Shape* shape) {
+	growStorage(shape->count, sizeof(Value*));
+	mData.storage->shape = shape;
 }
 
-Value* MapValue::getValueForKey(const String& key) {
-	Map<String, Value*>::ConstIterator iter = mMap.find(key);
-	if (iter != mMap.end())
-		return iter->second;
-	else
-		return &sNullValue;
+void MapValue::reserve(int capacity) {
+	growStorage(capacity, sizeof(Value*));
+
+	Storage* storage = mData.storage;
+	Shape* shape = storage->shape;
+	bool interned = storage->keys != NULL;
+	if (shape && !shape->shared && capacity <= shape->capacity)
+		return;
+
+	// Copy a shared shape, grow an unshared one.
+	if (!shape || shape->shared) {
+		Shape* copy = allocShape(storage->arena, capacity);
+		if (shape) {
+			memcpy(copy->getKeys(), shape->getKeys(),
+					shape->count * sizeof(ShapeKey));
+			copy->count = shape->count;
+		}
+		shape = copy;
+	} else {
+		shape = (Shape*) reallocStorage(storage->arena, shape,
+				sizeof(Shape) + shape->capacity * sizeof(ShapeKey),
+				sizeof(Shape) + capacity * sizeof(ShapeKey));
+		shape->capacity = capacity;
+	}
+	storage->shape = shape;
+
+	// Size the index up front, so that it is not rebuilt while the
+	// keys are added.
+	reserveShapeIndex(storage->arena, shape, interned, capacity);
 }
 
-const Value* MapValue::getValueForKey(const String& key) const {
-	Map<String, Value*>::ConstIterator iter = mMap.find(key);
-	if (iter != mMap.end())
-		return iter->second;
-	else
-		return &sNullValue;
+void MapValue::addEntry(const char* key, int keyLength, Value* value) {
+	// Json allows repeated keys, the last value wins.
+	// The map owns the key, keep the first copy.
+	Shape* shape = getShape();
+	bool interned = hasInternedKeys();
+	int i = shape ? findShapeKey(shape, interned, key, keyLength) : -1;
+	if (i >= 0) {
+		if (shape->getKeys()[i].key != key)
+			freeStorage(getStorageArena(), (void*) key);
+		Value** items = getItems();
+		if (items[i] != value)
+			deleteValue(items[i]);
+		items[i] = value;
+		return;
+	}
+
+	if (mSize == getCapacity())
+		reserve(mSize ? mSize * 2 : 4);
+	else if (shape->shared)
+		reserve(getCapacity());
+	addShapeKey(getStorageArena(), getShape(), interned, key, keyLength);
+	getItems()[mSize++] = value;
 }
 
-String MapValue::toString() const {
-	String ret = "{";
-	Map<String, Value*>::ConstIterator iter = mMap.begin();
-	while (iter != mMap.end()) {
-		ret += "\"" + iter->first + "\": ";
+void MapValue::setValueForKey(const String& key, Value* value) {
+	setValueForKey(key.c_str(), key.length(), value);
+}
 
-		Value *value = iter->second;
-		bool isString = value->getType() == Value::STRING;
-		if (isString)
-			ret += "\"";
-		if (value->getType() == Value::NUL)
-			ret += "null";
-		else
-			ret += value->toString();
-		if (isString)
-			ret += "\"";
+void MapValue::setValueForKey(const char* key, int keyLength, Value* value) {
+	KeyTable* keys = mData.storage ? mData.storage->keys : NULL;
+	if (keys) {
+		addEntry(keys->intern(key, keyLength), keyLength, value);
+		return;
+	}
+	int i = findKey(key, keyLength);
+	if (i >= 0) {
+		addEntry(getShape()->getKeys()[i].key, keyLength, value);
+		return;
+	}
+	addEntry(copyStorage(getStorageArena(), key, keyLength), keyLength, value);
+}
 
-		iter++;
+Value* MapValue::removeValueForKey(const char* key, int keyLength) {
+	int i = findKey(key, keyLength);
+	if (i < 0)
+		return NULL;
 
-		if (iter != mMap.end())
-			ret += ", ";
+	// Copy a shared shape before changing it.
+	if (getShape()->shared)
+		reserve(getCapacity());
+	Shape* shape = getShape();
+	ShapeKey* keys = shape->getKeys();
+	Value** items = getItems();
+	Value* value = items[i];
+
+	// Heap maps own their keys.
+	if (!isArenaValue())
+		free((void*) keys[i].key);
+	memmove(keys + i, keys + i + 1, (mSize - i - 1) * sizeof(ShapeKey));
+	memmove(items + i, items + i + 1, (mSize - i - 1) * sizeof(Value*));
+	shape->count--;
+	mSize--;
+
+	// The keys after the removed one moved, index them again.
+	if (shape->index) {
+		bool interned = hasInternedKeys();
+		memset(shape->index, 0, shape->indexSize * sizeof(int));
+		for (int k = 0; k < shape->count; k++)
+			indexShapeKey(shape, interned, k);
 	}
-	ret += "}";
-	return ret;
+	return value;
 }
 
-ArrayValue::ArrayValue() :
-	Value(ARRAY) {
+ArrayValue::ArrayValue(Arena* arena) :
+	Value(ARRAY, arena) {
+	// Arena arrays need their storage header to know where to grow.
+	if (arena)
+		allocateStorage(arena, 0, sizeof(Value*));
 }
 
-ArrayValue::~ArrayValue() {
-	for (int i = 0; i < mValues.size(); i++) {
-		deleteobject(mValues[i]);
-	}
+void ArrayValue::reserve(int capacity) {
+	growStorage(capacity, sizeof(Value*));
 }
 
 void ArrayValue::addValue(Value* value) {
-	mValues.add(value);
+	if (mSize == getCapacity())
+		reserve(mSize ? mSize * 2 : 4);
+	getItems()[mSize++] = value;
 }
 
-const Vector<Value*>& ArrayValue::getValues() const {
-	return mValues;
+void ArrayValue::insertValue(int index, Value* value) {
+	if (index < 0 || index > mSize)
+		maPanic(1, "YAJLDom::ArrayValue::insertValue, index out of range.");
+	if (mSize == getCapacity())
+		reserve(mSize ? mSize * 2 : 4);
+	Value** items = getItems();
+	memmove(items + index + 1, items + index, (mSize - index) * sizeof(Value*));
+	items[index] = value;
+	mSize++;
 }
 
-int ArrayValue::getNumChildValues() const {
-	return mValues.size();
+void ArrayValue::setValue(int index, Value* value) {
+	if (index < 0 || index >= mSize)
+		maPanic(1, "YAJLDom::ArrayValue::setValue, index out of range.");
+	Value** items = getItems();
+	if (items[index] != value)
+		deleteValue(items[index]);
+	items[index] = value;
 }
 
+Value* ArrayValue::removeValue(int index) {
+	if (index < 0 || index >= mSize)
+		return NULL;
+	Value** items = getItems();
+	Value* value = items[index];
+	memmove(items + index, items + index + 1,
+			(mSize - index - 1) * sizeof(Value*));
+	mSize--;
+	return value;
+}
 
-String ArrayValue::toString() const {
-	String ret = "[";
-	for (int i = 0; i < mValues.size(); i++) {
-		Value *value = mValues[i];
-		bool isString = value->getType() == Value::STRING;
-		if (isString)
-			ret += "\"";
-		ret += value->toString();
-		if (isString)
-			ret += "\"";
+Value* const* ArrayValue::getValues() const {
+	return getItems();
+}
 
-		if (i != mValues.size() - 1)
-			ret += ", ";
-	}
-	ret += "]";
-	return ret;
+Document::Document() :
+	mRoot(NULL), mKeys(NULL), mText(NULL) {
 }
 
-Value* ArrayValue::getValueByIndex(int i) {
-	if (i < 0 || i >= mValues.size())
-		return &sNullValue;
-	return mValues[i];
+Document::Document(int blockSize) :
+	mArena(blockSize), mRoot(NULL), mKeys(NULL), mText(NULL) {
 }
 
-const Value* ArrayValue::getValueByIndex(int i) const {
-	if (i < 0 || i >= mValues.size())
-		return &sNullValue;
-	return mValues[i];
+Document::~Document() {
+	// The values are not destroyed one by one, the arena frees
+	// everything they allocated.
+	free(mText);
 }
 
-Value *sRoot = NULL;
-Stack<Value*> sValueStack;
+bool Document::parse(const unsigned char* jsonText, size_t jsonTextLength,
+		int flags) {
+	Parser parser(*this);
+	parser.setZeroCopy((flags & ZERO_COPY) != 0);
+	bool success = parser.parse(jsonText, jsonTextLength) != NULL;
+	// Take the text even on failure, the caller has handed it over.
+	if ((flags & ADOPT_TEXT) == ADOPT_TEXT)
+		mText = (unsigned char*) jsonText;
+	return success;
+}
 
-struct KeyString {
-	KeyString() {}
-	KeyString(const char *str, int length) : str(str), length(length) {
-	}
-	const char* str;
-	int length;
-};
+Value* Document::getRoot() {
+	return mRoot;
+}
+
+const Value* Document::getRoot() const {
+	return mRoot;
+}
+
+void Document::setRoot(Value* root) {
+	if (root && !root->isArenaValue())
+		maPanic(1, "YAJLDom::Document::setRoot, value not owned by the document.");
+	mRoot = root;
+}
 
-Stack<KeyString> sKeyStack;
+void Document::clear() {
+	mRoot = NULL;
+	mArena.reset();
+	free(mText);
+	mText = NULL;
+}
+
+Arena& Document::getArena() {
+	return mArena;
+}
+
+void Document::setKeyTable(KeyTable* keys) {
+	mKeys = keys;
+}
+
+KeyTable* Document::getKeyTable() {
+	return mKeys;
+}
+
+NullValue* Document::createNull() {
+	return newvalue(&mArena, NullValue, (&mArena));
+}
+
+BooleanValue* Document::createBoolean(bool value) {
+	return newvalue(&mArena, BooleanValue, (value, &mArena));
+}
+
+NumberValue* Document::createNumber(double num) {
+	return newvalue(&mArena, NumberValue, (num, &mArena));
+}
+
+NumberValue* Document::createNumber(int num) {
+	return newvalue(&mArena, NumberValue, (num, &mArena));
+}
+
+NumberValue* Document::createNumber(long long num) {
+	return newvalue(&mArena, NumberValue, (num, &mArena));
+}
+
+StringValue* Document::createString(const char* str, int length) {
+	return newvalue(&mArena, StringValue, (str, length, &mArena));
+}
+
+MapValue* Document::createMap() {
+	MapValue* map = newvalue(&mArena, MapValue, (&mArena));
+	map->setKeyTable(mKeys);
+	return map;
+}
+
+ArrayValue* Document::createArray() {
+	return newvalue(&mArena, ArrayValue, (&mArena));
+}
+
+Value* Document::copyValue(const Value* value) {
+	if (!value)
+		return NULL;
+	return Value::copy(value, &mArena, mKeys);
+}
 
 Value* validateValue(Value* value, Value::Type type) {
-	if (value->getType() != type)
+	if (value->getType() != type) {
 		maPanic(1, "Invalid value!");
-	else
-		return value;
+		return NULL;
+	}
+	return value;
 }
 
 void printValue(Value* value) {
@@ -302,9 +1238,101 @@ void printValue(Value* value) {
 	}
 }
 
-void pushValue(Value *value) {
-	Value* parent;
+NodeCounts::NodeCounts() :
+	nulls(0), booleans(0), numbers(0), strings(0), maps(0), arrays(0) {
+}
+
+int NodeCounts::getTotal() const {
+	return nulls + booleans + numbers + strings + maps + arrays;
+}
+
+ParseStats::ParseStats() :
+	bytes(0), nullTokens(0), booleanTokens(0), numberTokens(0),
+	stringTokens(0), keyTokens(0), mapTokens(0), arrayTokens(0),
+	escapedStrings(0), maxDepth(0), allocations(0), bytesAllocated(0),
+	lexTime(0), buildTime(0), teardownTime(0) {
+}
+
+Parser::Parser() :
+	mRoot(NULL), mKey(NULL), mKeyLength(0), mKeyArena(1024),
+	mArena(NULL), mDocument(NULL), mKeys(NULL), mText(NULL), mTextEnd(NULL),
+	mZeroCopy(false), mShapeCount(0), mMode(BUILD_TREE), mGen(NULL),
+	mSpareGen(NULL), mHandle(NULL), mStarted(false), mFailed(false),
+	mValid(false), mProjection(NULL),
+	mNode(Projection::ALL), mNextNode(Projection::ALL), mSkipDepth(0),
+	mRecordPath(NULL), mRecordCallback(NULL), mRecordUserData(NULL),
+	mNextStep(-1), mRecordIndex(0), mInRecord(false), mStopped(false),
+	mRecordArena(1024), mYajlArena(YAJL_ARENA_SIZE), mSizeHint(0) {
+}
+
+Parser::Parser(Document& document) :
+	mRoot(NULL), mKey(NULL), mKeyLength(0), mKeyArena(1024),
+	mArena(&document.getArena()), mDocument(&document), mKeys(NULL),
+	mText(NULL),
+	mTextEnd(NULL), mZeroCopy(false), mShapeCount(0), mMode(BUILD_TREE),
+	mGen(NULL), mSpareGen(NULL), mHandle(NULL), mStarted(false),
+	mFailed(false), mValid(false),
+	mProjection(NULL), mNode(Projection::ALL), mNextNode(Projection::ALL),
+	mSkipDepth(0), mRecordPath(NULL), mRecordCallback(NULL),
+	mRecordUserData(NULL), mNextStep(-1), mRecordIndex(0), mInRecord(false),
+	mStopped(false), mRecordArena(1024), mYajlArena(YAJL_ARENA_SIZE),
+	mSizeHint(0) {
+}
+
+Parser::~Parser() {
+	// An unfinished or failed document is still owned by us.
+	end();
+	reset();
+	freeText();
+	if (mSpareGen)
+		yajl_gen_free(mSpareGen);
+	if (mHandle)
+		yajl_free(mHandle);
+}
 
+void Parser::setDocument(Document& document) {
+	// Discard any document left unfinished by feed().
+	end();
+	reset();
+	mFailed = false;
+	mDocument = &document;
+	mArena = &document.getArena();
+}
+
+void Parser::reset() {
+	if (mDocument) {
+		// Everything was allocated in the document.
+		if (mRoot)
+			mDocument->clear();
+	} else {
+		// Values of containers that were never closed are not
+		// reachable from the root.
+		for (int i = 0; i < mPending.size(); i++)
+			deleteValue(mPending[i].value);
+		deleteValue(mRoot);
+	}
+	mRoot = NULL;
+	mValueStack.clear();
+	mPending.clear();
+	mKey = NULL;
+	mKeyLength = 0;
+	mKeyArena.reset();
+	mNode = Projection::ALL;
+	mNextNode = Projection::ALL;
+	mSkipDepth = 0;
+	mNextStep = -1;
+	mInRecord = false;
+	mRecordArena.reset();
+	mArena = mDocument ? &mDocument->getArena() : NULL;
+
+	// Shapes are allocated in the document.
+	mShapes.resize(SHAPE_BUCKETS);
+	for (int i = 0; i < SHAPE_BUCKETS; i++)
+		mShapes[i] = NULL;
+	mShapeCount = 0;
+}
+
+void Parser::pushValue(Value *value) {
 	if (value == NULL)
 		maPanic(1, "YAJLDom::pushValue, value is null.");
 
@@ -312,41 +1340,99 @@ void pushValue(Value *value) {
 	bool isContainer = (value->getType() == Value::MAP || value->getType()
 			== Value::ARRAY);
 
-	// this must be the first item (i.e. sRoot is NULL).
-	if(sValueStack.size()==0)
+	// this must be the first item (i.e. mRoot is NULL).
+	if(mValueStack.size()==0)
 	{
 		// if that is case we set it as the root and if it's a container, we push it to the stack.
-		if (sRoot == NULL)
+		if (mRoot == NULL)
 		{
-			sRoot = value;
+			mRoot = value;
 			if (isContainer)
-				sValueStack.push(value);
+				pushContainer(value);
 			return;
 		}
 		else
 		{
-			maPanic(1, "YAJLDom::pushValue, sValueStack.size() is 0.");
+			maPanic(1, "YAJLDom::pushValue, mValueStack.size() is 0.");
 		}
 	}
-	parent = sValueStack.peek();
 
-	if (parent == NULL)
-		maPanic(1, "YAJLDom::pushValue, parent is null.");
+	// Records are passed on instead of stored, see streamRecords().
+	if (mValueStack.peek().records) {
+		if (!isContainer) {
+			endRecord(value);
+			return;
+		}
+		Container container(value, mPending.size(), mNextNode, -1);
+		container.record = true;
+		container.keys = mKeyArena.getMark();
+		mValueStack.push(container);
+		return;
+	}
+
+	// The value is stored in its container when the container is closed.
+	if (mValueStack.peek().value->getType() == Value::MAP)
+	{
+		mPending.add(Pending(mKey, mKeyLength, value));
+		mKey = NULL;
+	}
+	else
+	{
+		mPending.add(Pending(NULL, 0, value));
+	}
+
+	if (isContainer)
+		pushContainer(value);
+}
+
+void Parser::pushContainer(Value* value) {
+	Container container(value, mPending.size(), mNextNode, mNextStep);
+	container.records = mRecordPath && value->getType() == Value::ARRAY
+			&& mNextStep == mRecordPath->mSegments.size();
+	container.keys = mKeyArena.getMark();
+	mValueStack.push(container);
+}
+
+void Parser::popValue() {
+	const Container& container = mValueStack.peek();
+	int first = container.first;
+	int count = mPending.size() - first;
+	const Pending* pending = mPending.pointer() + first;
 
-	switch (parent->getType())
+	switch (container.value->getType())
 	{
 		case Value::MAP:
 		{
-			MapValue* map = (MapValue*) parent;
-			const KeyString& key = sKeyStack.peek();
-			map->setValueForKey(String(key.str, key.length), value);
+			MapValue* map = (MapValue*) container.value;
+
+			// Maps in a document share the shape of the first map with
+			// the same keys, and only store their values.
+			Shape* shape = mDocument ? findShape(pending, count) : NULL;
+			if (shape) {
+				map->setShape(shape);
+				Value** items = map->getItems();
+				for (int i = 0; i < count; i++)
+					items[i] = pending[i].value;
+				map->mSize = count;
+				break;
+			}
+
+			map->reserve(count);
+			for (int i = 0; i < count; i++)
+				map->addEntry(keepKey(mArena, pending[i].key,
+						pending[i].keyLength), pending[i].keyLength,
+						pending[i].value);
 		}
 		break;
 
 		case Value::ARRAY:
 		{
-			ArrayValue* array = (ArrayValue*) parent;
-			array->addValue(value);
+			ArrayValue* array = (ArrayValue*) container.value;
+			array->reserve(count);
+			Value** items = array->getItems();
+			for (int i = 0; i < count; i++)
+				items[i] = pending[i].value;
+			array->mSize = count;
 		}
 		break;
 
@@ -357,82 +1443,544 @@ void pushValue(Value *value) {
 		break;
 	}
 
-	if (isContainer)
-		sValueStack.push(value);
+	// Keeps the memory of a streamed parse in the nesting depth rather
+	// than the number of keys.
+	mKeyArena.rewind(container.keys);
+	mPending.resize(first);
+	bool record = container.record;
+	Value* value = container.value;
+	mValueStack.pop();
+	if (record)
+		endRecord(value);
 }
 
-void popValue() {
-	sValueStack.pop();
+Shape* Parser::findShape(const Pending* pending, int count) {
+	bool interned = mKeys != NULL;
+	unsigned int hash = count;
+	for (int i = 0; i < count; i++)
+		hash = hash * 31 + hashKey(interned, pending[i].key, pending[i].keyLength);
+
+	Shape*& bucket = mShapes[hash & (SHAPE_BUCKETS - 1)];
+	for (Shape* shape = bucket; shape; shape = shape->next) {
+		if (shape->hash != hash || shape->count != count)
+			continue;
+		const ShapeKey* keys = shape->getKeys();
+		int i = 0;
+		while (i < count && equalKeys(interned, keys[i], pending[i].key,
+				pending[i].keyLength))
+			i++;
+		if (i == count)
+			return shape;
+	}
+
+	if (mShapeCount == MAX_SHAPES)
+		return NULL;
+
+	// Shapes are kept in the document, also when the map is in the
+	// record arena, see streamRecords().
+	Arena* arena = &mDocument->getArena();
+	Shape* shape = allocShape(arena, count);
+	reserveShapeIndex(arena, shape, interned, count);
+	for (int i = 0; i < count; i++) {
+		const char* key = pending[i].key;
+		int keyLength = pending[i].keyLength;
+		// A map with repeated keys gets a shape of its own, where the
+		// last value wins.
+		if (findShapeKey(shape, interned, key, keyLength) >= 0)
+			return NULL;
+		addShapeKey(arena, shape, interned, keepKey(arena, key, keyLength),
+				keyLength);
+	}
+	shape->shared = true;
+	shape->hash = hash;
+	shape->next = bucket;
+	bucket = shape;
+	mShapeCount++;
+	return shape;
 }
 
-static int parse_null(void * ctx) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_null(g);
-	pushValue(newobject(NullValue, new NullValue()));
-	return 1;
+const char* Parser::keepKey(Arena* arena, const char* key, int keyLength) {
+	// Interned keys and keys in the text of a zero copy parse outlive
+	// the map. Other keys are in mKeyArena, which only lives until the
+	// map is closed, and are copied into the arena of the map or shape.
+	if (mKeys || isInText((const unsigned char*) key, keyLength))
+		return key;
+	return copyStorage(arena, key, keyLength);
 }
 
-static int parse_boolean(void * ctx, int boolean) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_bool(g, boolean);
-	pushValue(newobject(BooleanValue, new BooleanValue((bool) boolean)));
-	return 1;
+bool Parser::isInText(const unsigned char* str, int length) const {
+	return str >= mText && str + length <= mTextEnd;
 }
 
-static int parse_number(void * ctx, const char * s, unsigned int l) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_number(g, s, l);
-	pushValue(newobject(NumberValue, new NumberValue(stringToDouble(String(s, l)))));
-	return 1;
+void Parser::pushKey(const char* str, int length) {
+	mKeyLength = length;
+
+	// Interned keys are shared by all maps that use the table.
+	if (mKeys) {
+		mKey = mKeys->intern(str, length);
+		return;
+	}
+
+	// Keys without escapes can refer to the text of a zero copy parse.
+	if (isInText((const unsigned char*) str, length)) {
+		mKey = str;
+		return;
+	}
+
+	// Copy the key, the text it points to is either the current
+	// chunk or yajl's decode buffer, and neither outlives the map.
+	// The map copies it again if it needs to keep it, see keepKey(),
+	// and the copy is released when the map is closed, see popValue().
+	// Keys in a record are released with the record.
+	Arena& arena = mInRecord ? mRecordArena : mKeyArena;
+	mKey = arena.copyString(str, length);
 }
 
-static int parse_string(void * ctx, const unsigned char * stringVal,
-		unsigned int stringLen) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_string(g, stringVal, stringLen);
-	pushValue(newobject(StringValue, new StringValue(String((const char*) stringVal, stringLen))));
-	return 1;
+void Parser::pushString(const char* str, int length) {
+	// Short repeated values can be shared through the key table.
+	const char* interned = mKeys ? mKeys->internString(str, length) : NULL;
+	if (interned)
+		pushValue(new (mArena->allocate(sizeof(StringValue)))
+				StringValue(interned, length, *mArena));
+	else if (isInText((const unsigned char*) str, length))
+		pushValue(new (mArena->allocate(sizeof(StringValue)))
+				StringValue(str, length, *mArena));
+	else
+		pushValue(newvalue(mArena, StringValue, (str, length, mArena)));
 }
 
-static int parse_map_key(void * ctx, const unsigned char * stringVal,
-		unsigned int stringLen) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_string(g, stringVal, stringLen);
-	sKeyStack.push(KeyString((const char*) stringVal, stringLen));
-	return 1;
+void Parser::pushNumber(const char* str, int length) {
+	long long integer;
+	if (parseInteger(str, length, &integer)) {
+		pushValue(newvalue(mArena, NumberValue, (integer, mArena)));
+	} else if (mArena) {
+		// Converted when read, the text is usually shorter than a
+		// double and many numbers are never read.
+		if (!isInText((const unsigned char*) str, length))
+			str = mArena->copyString(str, length);
+		pushValue(new (mArena->allocate(sizeof(NumberValue)))
+				NumberValue(str, length, *mArena));
+	} else {
+		pushValue(heapvalue(NumberValue, (parseDouble(str, length))));
+	}
 }
 
-static int parse_start_map(void * ctx) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_map_open(g);
-	pushValue(newobject(MapValue, new MapValue()));
-	return 1;
+void Parser::setZeroCopy(bool zeroCopy) {
+	mZeroCopy = zeroCopy;
 }
 
-static int parse_end_map(void * ctx) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_map_close(g);
-	popValue();
-	return 1;
+/**
+ * Find the projection node for the value of a key.
+ * \return false if the value is skipped.
+ */
+bool Parser::acceptKey(const char* str, int length) {
+	int node = mValueStack.peek().node;
+	if (node != Projection::ALL)
+		node = mProjection->findKey(node, str, length);
+	mNode = node;
+	return node != Projection::NONE;
 }
 
-static int parse_start_array(void * ctx) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_array_open(g);
-	pushValue(newobject(ArrayValue, new ArrayValue()));
-	return 1;
+/**
+ * Called when a value starts, before it is created, if there is a
+ * projection or a record path. Sets mNextNode to the projection node
+ * of the value and mNextStep to its record path step.
+ * \return true if the value is skipped.
+ */
+bool Parser::beginValue(bool isContainer) {
+	if (mValueStack.size() == 0) {
+		mNextNode = mProjection ? mProjection->getRoot()
+				: (int) Projection::ALL;
+		mNextStep = 0;
+		return false;
+	}
+
+	Container& container = mValueStack.peek();
+	bool inMap = container.value->getType() == Value::MAP;
+	int position = inMap ? -1 : container.position++;
+
+	if (mProjection) {
+		int node = container.node;
+		if (node != Projection::ALL) {
+			if (inMap)
+				node = mNode;
+			else
+				node = mProjection->findIndex(node, position);
+		}
+
+		// Values that are not maps or arrays contain nothing to look for.
+		if (node == Projection::NONE
+				|| (!isContainer && node != Projection::ALL)) {
+			// Keep the index of later elements that are on a path.
+			if (!inMap && position < mProjection->getLastIndex(
+					container.node)) {
+				mCounts.nulls++;
+				if (mGen)
+					yajl_gen_null(mGen);
+				pushValue(newvalue(mArena, NullValue, (mArena)));
+			}
+			return true;
+		}
+
+		// The key was held back until its value was known.
+		if (inMap && mGen && yajl_gen_string(mGen,
+				(const unsigned char*) mKey, mKeyLength) != yajl_gen_status_ok)
+			freeText();
+		mNextNode = node;
+	}
+
+	if (mRecordPath) {
+		if (container.records) {
+			// A record of a document parse is allocated where it can
+			// be released as soon as it has been handled.
+			mRecordIndex = position;
+			mInRecord = true;
+			if (mDocument)
+				mArena = &mRecordArena;
+			mNextStep = -1;
+		} else {
+			mNextStep = nextRecordStep(container, position);
+		}
+	}
+	return false;
 }
 
-static int parse_end_array(void * ctx) {
-	yajl_gen g = (yajl_gen) ctx;
-	yajl_gen_array_close(g);
-	popValue();
+/**
+ * \return The record path step of a value in container, -1 if it is not
+ * on the path.
+ * \param position The index of the value in an array, -1 in a map.
+ */
+int Parser::nextRecordStep(const Container& container, int position) const {
+	int step = container.step;
+	if (step < 0 || step >= mRecordPath->mSegments.size())
+		return -1;
+
+	const Path::Segment& segment = mRecordPath->mSegments[step];
+	bool match;
+	switch (segment.type) {
+		case Path::Segment::KEY:
+			if (position < 0)
+				match = mKeyLength == segment.key.getKeyLength()
+						&& memcmp(mKey, segment.key.getKey(), mKeyLength) == 0;
+			else
+				match = position == segment.index;
+			break;
+		case Path::Segment::INDEX:
+			match = position >= 0 && position == segment.index;
+			break;
+		default:
+			match = true;
+			break;
+	}
+	return match ? step + 1 : -1;
+}
+
+/**
+ * Pass a finished record to the callback and release it.
+ */
+void Parser::endRecord(Value* record) {
+	if (!mRecordCallback(record, mRecordIndex, mRecordUserData))
+		mStopped = true;
+
+	if (mDocument)
+		mArena = &mDocument->getArena();
+	else
+		deleteValue(record);
+
+	// Holds the values of a document record, and the keys of any record.
+	mRecordArena.reset();
+	mInRecord = false;
+}
+
+/**
+ * The yajl callbacks. The context pointer is the Parser that
+ * started the parse.
+ */
+struct ParserCallbacks {
+
+	/**
+	 * Follow the projection and the record path, if there are any.
+	 * \return true if the value is skipped.
+	 */
+	static bool skip(Parser* p, bool isContainer) {
+		return (p->mProjection || p->mRecordPath)
+				&& p->beginValue(isContainer);
+	}
+
+	// The callbacks that can finish a record stop the parse when the
+	// record callback asks for it.
+
+	static int parse_null(void * ctx) {
+		Parser* p = (Parser*) ctx;
+		if (skip(p, false))
+			return 1;
+		p->mCounts.nulls++;
+		if (p->mGen && yajl_gen_null(p->mGen) != yajl_gen_status_ok)
+			p->freeText();
+		p->pushValue(newvalue(p->mArena, NullValue, (p->mArena)));
+		return !p->mStopped;
+	}
+
+	static int parse_boolean(void * ctx, int boolean) {
+		Parser* p = (Parser*) ctx;
+		if (skip(p, false))
+			return 1;
+		p->mCounts.booleans++;
+		if (p->mGen && yajl_gen_bool(p->mGen, boolean) != yajl_gen_status_ok)
+			p->freeText();
+		p->pushValue(newvalue(p->mArena, BooleanValue, ((bool) boolean, p->mArena)));
+		return !p->mStopped;
+	}
+
+	static int parse_number(void * ctx, const char * s, unsigned int l) {
+		Parser* p = (Parser*) ctx;
+		if (skip(p, false))
+			return 1;
+		p->mCounts.numbers++;
+		if (p->mGen && yajl_gen_number(p->mGen, s, l) != yajl_gen_status_ok)
+			p->freeText();
+		p->pushNumber(s, l);
+		return !p->mStopped;
+	}
+
+	static int parse_string(void * ctx, const unsigned char * stringVal,
+			unsigned int stringLen) {
+		Parser* p = (Parser*) ctx;
+		if (skip(p, false))
+			return 1;
+		p->mCounts.strings++;
+		if (p->mGen && yajl_gen_string(p->mGen, stringVal, stringLen)
+				!= yajl_gen_status_ok)
+			p->freeText();
+		p->pushString((const char*) stringVal, stringLen);
+		return !p->mStopped;
+	}
+
+	static int parse_map_key(void * ctx, const unsigned char * stringVal,
+			unsigned int stringLen) {
+		Parser* p = (Parser*) ctx;
+		if (p->mProjection) {
+			// The key is written with its value, see beginValue().
+			if (p->acceptKey((const char*) stringVal, stringLen))
+				p->pushKey((const char*) stringVal, stringLen);
+			return 1;
+		}
+		if (p->mGen && yajl_gen_string(p->mGen, stringVal, stringLen)
+				!= yajl_gen_status_ok)
+			p->freeText();
+		p->pushKey((const char*) stringVal, stringLen);
+		return 1;
+	}
+
+	static int parse_start_map(void * ctx) {
+		Parser* p = (Parser*) ctx;
+		if (skip(p, true)) {
+			p->skipContainer();
+			return 1;
+		}
+		p->mCounts.maps++;
+		if (p->mGen && yajl_gen_map_open(p->mGen) != yajl_gen_status_ok)
+			p->freeText();
+		MapValue* map = newvalue(p->mArena, MapValue, (p->mArena));
+		if (p->mKeys)
+			map->setKeyTable(p->mKeys);
+		p->pushValue(map);
+		return 1;
+	}
+
+	static int parse_end_map(void * ctx) {
+		Parser* p = (Parser*) ctx;
+		if (p->mGen && yajl_gen_map_close(p->mGen) != yajl_gen_status_ok)
+			p->freeText();
+		p->popValue();
+		return !p->mStopped;
+	}
+
+	static int parse_start_array(void * ctx) {
+		Parser* p = (Parser*) ctx;
+		if (skip(p, true)) {
+			p->skipContainer();
+			return 1;
+		}
+		p->mCounts.arrays++;
+		if (p->mGen && yajl_gen_array_open(p->mGen) != yajl_gen_status_ok)
+			p->freeText();
+		p->pushValue(newvalue(p->mArena, ArrayValue, (p->mArena)));
+		return 1;
+	}
+
+	static int parse_end_array(void * ctx) {
+		Parser* p = (Parser*) ctx;
+		if (p->mGen && yajl_gen_array_close(p->mGen) != yajl_gen_status_ok)
+			p->freeText();
+		p->popValue();
+		return !p->mStopped;
+	}
+
+	// Callbacks for Parser::VALIDATE, they only count the values.
+
+	static int count_null(void * ctx) {
+		((Parser*) ctx)->mCounts.nulls++;
+		return 1;
+	}
+
+	static int count_boolean(void * ctx, int boolean) {
+		((Parser*) ctx)->mCounts.booleans++;
+		return 1;
+	}
+
+	static int count_number(void * ctx, const char * s, unsigned int l) {
+		((Parser*) ctx)->mCounts.numbers++;
+		return 1;
+	}
+
+	static int count_string(void * ctx, const unsigned char * stringVal,
+			unsigned int stringLen) {
+		((Parser*) ctx)->mCounts.strings++;
+		return 1;
+	}
+
+	static int count_start_map(void * ctx) {
+		((Parser*) ctx)->mCounts.maps++;
+		return 1;
+	}
+
+	static int count_start_array(void * ctx) {
+		((Parser*) ctx)->mCounts.arrays++;
+		return 1;
+	}
+
+	// Callbacks while a map or array is skipped by a projection, they
+	// only follow the depth.
+
+	static int skip_start(void * ctx) {
+		((Parser*) ctx)->mSkipDepth++;
+		return 1;
+	}
+
+	static int skip_end(void * ctx);
+};
+
+#ifdef YAJLDOM_STATS
+/**
+ * Wrappers that add the time of callbacks to the build time of the
+ * parse. Reading the clock around every callback would cost more than
+ * most callbacks, so only one callback in a random gap of 1 to 32 is
+ * timed, and counts for the whole gap. The gaps do not follow the
+ * structure of the document, so the estimate is not biased towards
+ * some callbacks.
+ */
+struct StatsCallbacks {
+	/**
+	 * \return true if the next callback is timed.
+	 */
+	static bool sample(Parser* p) {
+		if (--p->mStatsCountdown > 0)
+			return false;
+		p->mStatsRandom = p->mStatsRandom * 1103515245 + 12345;
+		p->mStatsCountdown = 1 + ((p->mStatsRandom >> 16) & 31);
+		return true;
+	}
+
+	/**
+	 * Count a timed callback for its gap, which is starting a new one.
+	 */
+	static void addSample(Parser* p, int start) {
+		p->mStats.buildTime += (maGetMilliSecondCount() - start) * p->mStatsGap;
+		p->mStatsGap = p->mStatsCountdown;
+	}
+
+	template<int (*CALLBACK)(void*)>
+	static int timed(void * ctx) {
+		Parser* p = (Parser*) ctx;
+		if (!sample(p))
+			return CALLBACK(ctx);
+		int start = maGetMilliSecondCount();
+		int result = CALLBACK(ctx);
+		addSample(p, start);
+		return result;
+	}
+
+	template<int (*CALLBACK)(void*, int)>
+	static int timedBoolean(void * ctx, int boolean) {
+		Parser* p = (Parser*) ctx;
+		if (!sample(p))
+			return CALLBACK(ctx, boolean);
+		int start = maGetMilliSecondCount();
+		int result = CALLBACK(ctx, boolean);
+		addSample(p, start);
+		return result;
+	}
+
+	template<int (*CALLBACK)(void*, const char*, unsigned int)>
+	static int timedNumber(void * ctx, const char * s, unsigned int l) {
+		Parser* p = (Parser*) ctx;
+		if (!sample(p))
+			return CALLBACK(ctx, s, l);
+		int start = maGetMilliSecondCount();
+		int result = CALLBACK(ctx, s, l);
+		addSample(p, start);
+		return result;
+	}
+
+	template<int (*CALLBACK)(void*, const unsigned char*, unsigned int)>
+	static int timedString(void * ctx, const unsigned char * stringVal,
+			unsigned int stringLen) {
+		Parser* p = (Parser*) ctx;
+		if (!sample(p))
+			return CALLBACK(ctx, stringVal, stringLen);
+		int start = maGetMilliSecondCount();
+		int result = CALLBACK(ctx, stringVal, stringLen);
+		addSample(p, start);
+		return result;
+	}
+};
+
+#define TIMED(wrapper, callback) StatsCallbacks::wrapper<callback>
+#else
+#define TIMED(wrapper, callback) callback
+#endif
+
+static const yajl_callbacks callbacks = {
+		TIMED(timed, ParserCallbacks::parse_null),
+		TIMED(timedBoolean, ParserCallbacks::parse_boolean), NULL, NULL,
+		TIMED(timedNumber, ParserCallbacks::parse_number),
+		TIMED(timedString, ParserCallbacks::parse_string),
+		TIMED(timed, ParserCallbacks::parse_start_map),
+		TIMED(timedString, ParserCallbacks::parse_map_key),
+		TIMED(timed, ParserCallbacks::parse_end_map),
+		TIMED(timed, ParserCallbacks::parse_start_array),
+		TIMED(timed, ParserCallbacks::parse_end_array) };
+
+// Keys and container ends need no callbacks when validating. Strings
+// are still decoded by yajl, so that invalid escapes are found.
+static const yajl_callbacks validateCallbacks = {
+		TIMED(timed, ParserCallbacks::count_null),
+		TIMED(timedBoolean, ParserCallbacks::count_boolean), NULL, NULL,
+		TIMED(timedNumber, ParserCallbacks::count_number),
+		TIMED(timedString, ParserCallbacks::count_string),
+		TIMED(timed, ParserCallbacks::count_start_map), NULL, NULL,
+		TIMED(timed, ParserCallbacks::count_start_array), NULL };
+
+// Without string and key callbacks, yajl does not decode the strings
+// of skipped values.
+static const yajl_callbacks skipCallbacks = { NULL, NULL, NULL, NULL, NULL,
+		NULL, TIMED(timed, ParserCallbacks::skip_start), NULL,
+		TIMED(timed, ParserCallbacks::skip_end),
+		TIMED(timed, ParserCallbacks::skip_start),
+		TIMED(timed, ParserCallbacks::skip_end) };
+
+int ParserCallbacks::skip_end(void * ctx) {
+	Parser* p = (Parser*) ctx;
+	if (--p->mSkipDepth == 0)
+		yajl_set_callbacks(p->mHandle, &callbacks);
 	return 1;
 }
 
-static yajl_callbacks callbacks = { parse_null, parse_boolean, NULL, NULL,
-		parse_number, parse_string, parse_start_map, parse_map_key,
-		parse_end_map, parse_start_array, parse_end_array };
+void Parser::skipContainer() {
+	mSkipDepth = 1;
+	yajl_set_callbacks(mHandle, &skipCallbacks);
+}
 
 void parseError(yajl_handle hand, int verbose, const unsigned char* jsonText,
 		size_t jsonTextLength) {
@@ -441,60 +1989,343 @@ void parseError(yajl_handle hand, int verbose, const unsigned char* jsonText,
 	yajl_free_error(hand, str);
 }
 
-void gen_print(void *ctx, const char *str, unsigned int len) {
-	printf("%.*s", len, str);
+// Add the milliseconds that code takes to total, when collecting
+// ParseStats.
+#ifdef YAJLDOM_STATS
+#define STATS_TIME(total, code) \
+	do { \
+		int statsStart = maGetMilliSecondCount(); \
+		code; \
+		(total) += maGetMilliSecondCount() - statsStart; \
+	} while (0)
+#else
+#define STATS_TIME(total, code) code
+#endif
+
+/**
+ * yajl allocates from the arena of the Parser. The size of each
+ * allocation is kept in front of it, since the arena needs it to
+ * reallocate. Freeing only gives memory back when it is the latest
+ * allocation, which is the case for error messages.
+ */
+#define YAJL_HEADER_SIZE 8
+
+static void* yajlMalloc(void* ctx, unsigned int size) {
+	char* ptr = (char*) ((Arena*) ctx)->allocate(YAJL_HEADER_SIZE + size);
+	*(unsigned int*) ptr = size;
+	return ptr + YAJL_HEADER_SIZE;
 }
 
-Value* parse(const unsigned char* jsonText, size_t jsonTextLength) {
-	yajl_handle hand;
-	yajl_gen_config conf = { 1, "  " };
-	yajl_gen g;
-	yajl_status stat;
-	yajl_parser_config cfg = { 1, 1 };
+static void* yajlRealloc(void* ctx, void* ptr, unsigned int size) {
+	if (!ptr)
+		return yajlMalloc(ctx, size);
+	char* header = (char*) ptr - YAJL_HEADER_SIZE;
+	unsigned int oldSize = *(unsigned int*) header;
+	header = (char*) ((Arena*) ctx)->reallocate(header,
+			YAJL_HEADER_SIZE + oldSize, YAJL_HEADER_SIZE + size);
+	*(unsigned int*) header = size;
+	return header + YAJL_HEADER_SIZE;
+}
 
-	//conf.beautify = 0;
+static void yajlFree(void* ctx, void* ptr) {
+	if (!ptr)
+		return;
+	char* header = (char*) ptr - YAJL_HEADER_SIZE;
+	((Arena*) ctx)->reallocate(header,
+			YAJL_HEADER_SIZE + *(unsigned int*) header, 0);
+}
+
+void Parser::begin() {
+	yajl_parser_config cfg = { 1, 1 };
 
 	// enable this if it should parse utf-8?
 	cfg.checkUTF8 = 1;
 
-	g = yajl_gen_alloc(&conf, NULL);
-	//g = yajl_gen_alloc2(gen_print, &conf, NULL, NULL);
+	yajl_alloc_funcs allocFuncs = { yajlMalloc, yajlRealloc, yajlFree,
+			&mYajlArena };
+
+#ifdef YAJLDOM_STATS
+	beginStats();
+#endif
+	STATS_TIME(mStats.teardownTime, reset());
+	freeText();
+	mFailed = false;
+	mValid = false;
+	mStopped = false;
+	mCounts = NodeCounts();
+	mStarted = true;
+
+	const yajl_callbacks* parserCallbacks = &callbacks;
+	if (mMode == VALIDATE) {
+		parserCallbacks = &validateCallbacks;
+	} else {
+		if (mDocument) {
+			STATS_TIME(mStats.teardownTime, mDocument->clear());
+			mKeys = mDocument->getKeyTable();
+		}
 
-	hand = yajl_alloc(&callbacks, &cfg, NULL, (void *) g);
+		if (mMode == BUILD_TREE_AND_TEXT) {
+			if (mSpareGen) {
+				mGen = mSpareGen;
+				mSpareGen = NULL;
+				yajl_gen_reset(mGen);
+			} else {
+				// The text is about as long as the Json text, so let
+				// its buffer grow in place.
+				mYajlArena.reserve(YAJL_ARENA_SIZE + 2 * mSizeHint);
+				yajl_gen_config conf = { 0, "" };
+				mGen = yajl_gen_alloc(&conf, &allocFuncs);
+			}
+		}
+	}
+
+	// The handle and its buffers are kept from the last document.
+	if (mHandle) {
+		yajl_reset(mHandle);
+		yajl_set_callbacks(mHandle, parserCallbacks);
+	} else {
+		mYajlArena.reserve(YAJL_ARENA_SIZE + (mSizeHint < YAJL_MAX_HINT
+				? mSizeHint : YAJL_MAX_HINT));
+		mHandle = yajl_alloc(parserCallbacks, &cfg, &allocFuncs,
+				(void *) this);
+	}
+}
 
-	sValueStack.clear();
-	sKeyStack.clear();
-	sRoot = NULL;
+void Parser::freeText() {
+	// The generator is kept for the next BUILD_TREE_AND_TEXT parse.
+	if (mGen) {
+		mSpareGen = mGen;
+		mGen = NULL;
+	}
+}
 
-	/* read file data, pass to parser */
-	stat = yajl_parse(hand, jsonText, jsonTextLength);
+void Parser::end() {
+	mStarted = false;
+}
+
+bool Parser::feed(const unsigned char* chunk, size_t chunkLength) {
+	if (mFailed)
+		return false;
+
+	if (!mStarted)
+		begin();
+
+	yajl_status stat;
+	STATS_TIME(mParseTime, stat = yajl_parse(mHandle, chunk, chunkLength));
+#ifdef YAJLDOM_STATS
+	mStats.bytes += yajl_get_bytes_consumed(mHandle);
+#endif
 
 	if (stat != yajl_status_ok && stat != yajl_status_insufficient_data) {
-		parseError(hand, 1, jsonText, jsonTextLength);
-		yajl_gen_free(g);
-		yajl_free(hand);
+		// Stopping from the record callback is not an error.
+		if (!mStopped)
+			parseError(mHandle, 1, chunk, chunkLength);
+		end();
+		STATS_TIME(mStats.teardownTime, reset());
+		freeText();
+#ifdef YAJLDOM_STATS
+		endStats();
+#endif
+		mFailed = true;
+		return false;
+	}
+
+	return true;
+}
+
+Value* Parser::finish() {
+	if (mFailed || !mStarted) {
+		mFailed = false;
 		return NULL;
 	}
 
-	stat = yajl_parse_complete(hand);
+	yajl_status stat;
+	STATS_TIME(mParseTime, stat = yajl_parse_complete(mHandle));
 
-	yajl_gen_free(g);
+	if (stat != yajl_status_ok) {
+		// Needing more data after the end means the text was cut off,
+		// for example by a dropped connection.
+		if (stat == yajl_status_insufficient_data)
+			printf("YAJLDom: premature end of Json text\n");
+		else
+			parseError(mHandle, 1, (const unsigned char*) " ", 1);
+		end();
+		STATS_TIME(mStats.teardownTime, reset());
+		freeText();
+#ifdef YAJLDOM_STATS
+		endStats();
+#endif
+		return NULL;
+	}
 
-	if (stat != yajl_status_ok && stat != yajl_status_insufficient_data) {
-		parseError(hand, 1, jsonText, jsonTextLength);
-		yajl_free(hand);
+	end();
+	mValid = true;
+#ifdef YAJLDOM_STATS
+	endStats();
+#endif
+
+	// Hand the tree over to the caller or the document.
+	Value* root = mRoot;
+	mRoot = NULL;
+	mValueStack.clear();
+	mPending.clear();
+	mKeyArena.reset();
+	if (mDocument && mMode != VALIDATE)
+		mDocument->setRoot(root);
+	return root;
+}
+
+Value* Parser::parse(const unsigned char* jsonText, size_t jsonTextLength) {
+	// Discard any document left unfinished by feed().
+	end();
+	mFailed = false;
+
+	mSizeHint = jsonTextLength;
+
+	// The text outlives the values only when parsing into a document.
+	if (mZeroCopy && mDocument) {
+		mText = jsonText;
+		mTextEnd = jsonText + jsonTextLength;
+	}
+
+	bool success = feed(jsonText, jsonTextLength);
+
+	mText = NULL;
+	mTextEnd = NULL;
+	mSizeHint = 0;
+
+	if (!success) {
+		mFailed = false;
 		return NULL;
 	}
 
-	yajl_free(hand);
+	return finish();
+}
+
+void Parser::setMode(Mode mode) {
+	mMode = mode;
+}
+
+void Parser::setProjection(const Projection* projection) {
+	mProjection = projection;
+}
+
+void Parser::streamRecords(const Path* arrayPath, RecordCallback callback,
+		void* userData) {
+	mRecordPath = arrayPath;
+	mRecordCallback = callback;
+	mRecordUserData = userData;
+}
+
+bool Parser::isValid() const {
+	return mValid;
+}
+
+const NodeCounts& Parser::getNodeCounts() const {
+	return mCounts;
+}
+
+#ifdef YAJLDOM_STATS
+const ParseStats& Parser::getStats() const {
+	return mStats;
+}
+
+void Parser::countAllocations(int& count, int& bytes) const {
+	count = __sync_fetch_and_add(&sHeapAllocations, 0)
+			+ mKeyArena.getAllocationCount()
+			+ mRecordArena.getAllocationCount()
+			+ mYajlArena.getAllocationCount();
+	bytes = __sync_fetch_and_add(&sHeapBytes, 0)
+			+ mKeyArena.getBytesAllocated()
+			+ mRecordArena.getBytesAllocated()
+			+ mYajlArena.getBytesAllocated();
+	if (mDocument) {
+		count += mDocument->getArena().getAllocationCount();
+		bytes += mDocument->getArena().getBytesAllocated();
+	}
+}
+
+void Parser::beginStats() {
+	mStats = ParseStats();
+	mParseTime = 0;
+	countAllocations(mAllocationBase, mBytesBase);
+	mStatsRandom = 1;
+	mStatsCountdown = 1;
+	StatsCallbacks::sample(this);
+	mStatsGap = mStatsCountdown;
+}
+
+void Parser::endStats() {
+	const yajl_stats* tokens = yajl_get_stats(mHandle);
+	mStats.nullTokens = tokens->nulls;
+	mStats.booleanTokens = tokens->booleans;
+	mStats.numberTokens = tokens->numbers;
+	mStats.stringTokens = tokens->strings;
+	mStats.keyTokens = tokens->keys;
+	mStats.mapTokens = tokens->maps;
+	mStats.arrayTokens = tokens->arrays;
+	mStats.escapedStrings = tokens->escapedStrings;
+	mStats.maxDepth = tokens->maxDepth;
+
+	if (mMode != VALIDATE)
+		mStats.nodes = mCounts;
+
+	int count, bytes;
+	countAllocations(count, bytes);
+	mStats.allocations = count - mAllocationBase;
+	mStats.bytesAllocated = bytes - mBytesBase;
+
+	// The build time is part of the time spent in yajl. It is an
+	// estimate, which can exceed the measured time of a short parse.
+	if (mStats.buildTime > mParseTime)
+		mStats.buildTime = mParseTime;
+	mStats.lexTime = mParseTime - mStats.buildTime;
+}
+#else
+const ParseStats& Parser::getStats() const {
+	static const ParseStats empty;
+	return empty;
+}
+#endif
+
+bool Parser::getText(const unsigned char** text, unsigned int* length) const {
+	if (!mValid || !mGen)
+		return false;
+	yajl_gen_get_buf(mGen, text, length);
+	return true;
+}
 
-	return sRoot;
+Value* parse(const unsigned char* jsonText, size_t jsonTextLength,
+		ParseStats* stats) {
+	Parser parser;
+	Value* root = parser.parse(jsonText, jsonTextLength);
+	if (stats)
+		*stats = parser.getStats();
+	return root;
+}
+
+bool validate(const unsigned char* jsonText, size_t jsonTextLength,
+		NodeCounts* counts) {
+	Parser parser;
+	parser.setMode(Parser::VALIDATE);
+	parser.parse(jsonText, jsonTextLength);
+	if (counts)
+		*counts = parser.getNodeCounts();
+	return parser.isValid();
 }
 
 void deleteValue(Value* value) {
-	if(!value || value == &sNullValue) return;
-	deleteobject(value);
-	//MAPUtil::MemoryMgr::dump();
+	if(!value || value == &sNullValue || value->isArenaValue()) return;
+	// Delete through the type the value was created with.
+	switch (value->getType()) {
+		case Value::NUL: { NullValue* v = (NullValue*) value; deleteobject(v); } break;
+		case Value::BOOLEAN: { BooleanValue* v = (BooleanValue*) value; deleteobject(v); } break;
+		case Value::NUMBER: { NumberValue* v = (NumberValue*) value; deleteobject(v); } break;
+		case Value::STRING: { StringValue* v = (StringValue*) value; deleteobject(v); } break;
+		case Value::MAP: { MapValue* v = (MapValue*) value; deleteobject(v); } break;
+		case Value::ARRAY: { ArrayValue* v = (ArrayValue*) value; deleteobject(v); } break;
+	}
+	//YAJLDomUtil::MemoryMgr::dump();
 }
 
 } // namespace YAJLDom
@@ -26,12 +26,95 @@ Software Foundation, 59 Temple Place - Suite 330, Boston, MA
 #define _YAJL_DOM_H_
 
 #include <MAUtil/Vector.h>
-#include <MAUtil/Map.h>
 #include <MAUtil/String.h>
+#include <MAUtil/Stack.h>
+
+#include "Arena.h"
+#include "KeyTable.h"
+#include "Writer.h"
+
+struct yajl_gen_t;
+struct yajl_handle_t;
 
 namespace MAUtil {
 namespace YAJLDom {
 
+struct Shape;
+class Path;
+class Projection;
+
+/**
+ * A map key for lookups that are repeated on many maps, typically the
+ * objects of an array. It remembers the shape of the last map it was
+ * found in and the slot of the value, so the next map with the same
+ * shape is read without searching:
+ *
+ *   static const CachedKey name("name");
+ *   for (int i = 0; i < people->getNumChildValues(); ++i)
+ *       people->getValueByIndex(i)->getValueForKey(name);
+ *
+ * The cache is updated by lookups, so a CachedKey should not be used
+ * by several threads at the same time.
+ */
+class CachedKey {
+public:
+	/**
+	 * \param key Null terminated key. The text is not copied and must
+	 * outlive the CachedKey, a string literal is typical.
+	 */
+	explicit CachedKey(const char* key);
+	CachedKey(const char* key, int keyLength);
+
+	/**
+	 * \return The key, which is not copied.
+	 */
+	const char* getKey() const;
+	int getKeyLength() const;
+
+private:
+	friend class Value;
+
+	const char* mKey;
+	int mLength;
+	/**
+	 * KeyTable::hash() of the key, so lookups that miss the cache do
+	 * not hash it again.
+	 */
+	unsigned int mHash;
+	mutable const Shape* mShape;
+	mutable int mSlot;
+};
+
+/**
+ * A node in a Json document tree.
+ *
+ * All values share one compact layout: a type tag, a size and a
+ * payload union, 16 bytes in total. There are no virtual functions,
+ * the accessors switch on the type tag. The subclasses add no data,
+ * they only provide constructors and functions that modify a value
+ * of their type. Strings point to their characters, containers point
+ * to one contiguous array of child pointers with the arena and
+ * capacity in front. Numbers are stored as a 64 bit integer, a double,
+ * or, for parsed numbers that are not integers, as the text of the
+ * number, which is converted each time it is read.
+ *
+ * Maps keep their keys in insertion order in a Shape, and their values
+ * in the same order. Maps parsed into a Document that have the same
+ * keys share one shape. Small shapes are searched linearly, larger
+ * ones also have an open addressed hash index from key to slot. The
+ * keys of maps in a Document that has a KeyTable are interned, and are
+ * looked up by comparing pointers.
+ *
+ * A finished tree is never modified by the accessor functions, so
+ * it can be read from several threads at the same time. This also
+ * holds for the shared null value returned for missing keys and
+ * indices.
+ *
+ * Values are either allocated on the heap, with new or by parse(), and
+ * deallocated with deleteValue, or allocated in the Arena of a Document
+ * and deallocated all at once with the Document. A container only
+ * holds values allocated the same way as itself.
+ */
 class Value {
 	public:
 		enum Type {
@@ -43,97 +126,923 @@ class Value {
 			STRING
 		};
 
-		Value(Type type);
-		virtual ~Value();
+		Value(Type type, Arena* arena = NULL);
+		~Value();
 
 		Type getType() const;
 		bool isNull() const;
 
-		virtual MAUtil::String toString() const = 0;
-		virtual bool toBoolean() const;
-		virtual int toInt() const;
-		virtual double toDouble() const;
-		virtual Value* getValueForKey(const MAUtil::String& key);
-		virtual Value* getValueByIndex(int i);
+		/**
+		 * \return true if this value is allocated in the arena of a
+		 * Document, false if it is allocated on the heap.
+		 */
+		bool isArenaValue() const;
+
+		/**
+		 * \return The text of a string, number or boolean, an empty
+		 * string for null, or compact Json text for a map or array.
+		 */
+		MAUtil::String toString() const;
+		bool toBoolean() const;
+		int toInt() const;
+		double toDouble() const;
+
+		/**
+		 * \return The value as a 64 bit integer. Integers in Json text
+		 * are stored exactly, also above 2^53 where a double cannot
+		 * represent all of them.
+		 */
+		long long toInt64() const;
+		/**
+		 * Read a number or boolean without converting it.
+		 * \param value Set to the value on success.
+		 * \return false if the value is not of the requested type. For
+		 * tryGetInt and tryGetInt64 also if the number is not a whole
+		 * number or does not fit.
+		 */
+		bool tryGetBool(bool& value) const;
+		bool tryGetInt(int& value) const;
+		bool tryGetInt64(long long& value) const;
+		bool tryGetDouble(double& value) const;
+
+		/**
+		 * \return The characters of a string without copying them, or
+		 * an empty string if this is not a string. The characters are
+		 * null terminated, except for strings that refer to the Json
+		 * text of a zero copy parse, see Document::ZERO_COPY.
+		 */
+		const char* getString() const;
+
+		/**
+		 * \return The length of a string, 0 if this is not a string.
+		 */
+		int getStringLength() const;
+
+		/**
+		 * Find the value for a key in a map.
+		 * \return The value, or a shared null value if this is not a
+		 * map or the key is not in it.
+		 */
+		Value* getValueForKey(const MAUtil::String& key);
+		Value* getValueForKey(const char* key);
+		Value* getValueForKey(const char* key, int keyLength);
+		Value* getValueForKey(const CachedKey& key);
+		Value* getValueByIndex(int i);
+
+		const Value* getValueForKey(const MAUtil::String& key) const;
+		const Value* getValueForKey(const char* key) const;
+		const Value* getValueForKey(const char* key, int keyLength) const;
+		const Value* getValueForKey(const CachedKey& key) const;
+		const Value* getValueByIndex(int i) const;
+
+		int getNumChildValues() const;
+
+		/**
+		 * Read the entries of a map in the order their keys were
+		 * added, from index 0 to getNumEntries() - 1.
+		 * \return The number of entries of a map, 0 if this is not a
+		 * map.
+		 */
+		int getNumEntries() const;
+
+		/**
+		 * \param keyLength Set to the length of the key, if not NULL.
+		 * \return The key of the entry at index i, without copying it,
+		 * or NULL if this is not a map or i is out of range. Like
+		 * strings, keys that refer to the Json text of a zero copy
+		 * parse are not null terminated.
+		 */
+		const char* getKeyByIndex(int i, int* keyLength = NULL) const;
+
+		/**
+		 * \return The value of the entry at index i, or a shared null
+		 * value if this is not a map or i is out of range.
+		 */
+		Value* getEntryValue(int i);
+		const Value* getEntryValue(int i) const;
+
+	protected:
+		enum Flags {
+			IN_ARENA = 1,
+
+			/**
+			 * A number stored in mData.integer.
+			 */
+			INTEGER = 2,
+
+			/**
+			 * A number stored as text in mData.string, mSize long.
+			 */
+			NUMBER_TEXT = 4
+		};
+
+		/**
+		 * Header in front of the children of a container.
+		 */
+		struct Storage {
+			Arena* arena;
+			int capacity;
+
+			/**
+			 * Interns the keys of a map, NULL if the keys are not
+			 * interned.
+			 */
+			KeyTable* keys;
+
+			/**
+			 * The keys of a map, NULL for an empty heap map.
+			 */
+			Shape* shape;
+		};
 
-		virtual const Value* getValueForKey(const MAUtil::String& key) const;
-		virtual  const Value* getValueByIndex(int i) const;
+		void* allocateStorage(Arena* arena, int capacity, int itemSize);
+		void growStorage(int capacity, int itemSize);
+		Arena* getStorageArena() const;
+		int getCapacity() const;
+		Value** getItems() const;
+		Shape* getShape() const;
+		bool hasInternedKeys() const;
+		int findKey(const char* key, int keyLength) const;
+		int findKey(const char* key, int keyLength, unsigned int hash) const;
+		int findKey(const CachedKey& key) const;
 
-		virtual int getNumChildValues() const;
+		/**
+		 * \return A deep copy of value, in arena or on the heap if
+		 * arena is NULL. The maps of an arena copy intern their keys
+		 * in keys, if it is not NULL.
+		 * \param deep false to copy only the map or array itself, the
+		 * copy then refers to the same items.
+		 */
+		static Value* copy(const Value* value, Arena* arena, KeyTable* keys,
+				bool deep = true);
+
+		unsigned char mType;
+		unsigned char mFlags;
+		unsigned short mReserved;
+
+		/**
+		 * String length, or number of children of a container.
+		 */
+		int mSize;
+
+		union {
+			bool boolean;
+			double number;
+			long long integer;
+			const char* string;
+			Storage* storage;
+		} mData;
 
 	private:
-		Type mType;
+		friend class Serializer;
+		friend class Path;
+		friend class SnapshotWriter;
+		friend class SnapshotReader;
+		friend class ParallelParser;
+		friend class Patch;
+		friend class Document;
+		friend Value* copyValue(const Value* value);
 
+		// Values are only copied by the subclasses that allow it.
+		Value(const Value&);
+		Value& operator=(const Value&);
 	};
 
 	class NullValue : public Value {
 	public:
-		NullValue();
-		MAUtil::String toString() const;
+		NullValue(Arena* arena = NULL);
 	};
 
 	class BooleanValue : public Value {
 	public:
-		BooleanValue(bool value);
-		MAUtil::String toString() const;
-		bool toBoolean() const;
+		BooleanValue(bool value, Arena* arena = NULL);
 		void setBoolean(bool value);
-
-	private:
-		bool mValue;
 	};
 
 	class NumberValue : public Value {
 	public:
-		NumberValue(double num);
-		MAUtil::String toString() const;
-		int toInt() const;
-		double toDouble() const;
+		NumberValue(double num, Arena* arena = NULL);
+		NumberValue(int num, Arena* arena = NULL);
+		NumberValue(long long num, Arena* arena = NULL);
 
 	private:
-		double mValue;
+		friend class Value;
+		friend class Parser;
+
+		/**
+		 * Create an arena number that refers to the text of a number
+		 * that is not an integer, and converts it when it is read.
+		 */
+		NumberValue(const char* text, int length, Arena& arena);
 	};
 
 	class StringValue : public Value {
 	public:
-		StringValue(const char* str, size_t length);
+		StringValue(const char* str, size_t length, Arena* arena = NULL);
 		StringValue(const MAUtil::String& str);
-		MAUtil::String toString() const;
-	private:
-		MAUtil::String mValue;
+
+		/**
+		 * Create an arena string that refers to str instead of copying
+		 * it. The text is not null terminated and must stay valid as
+		 * long as the arena holds the value.
+		 */
+		StringValue(const char* str, size_t length, Arena& arena);
 	};
 
 	class MapValue : public Value {
 	public:
-		MapValue();
-		~MapValue();
+		MapValue(Arena* arena = NULL);
 
+		/**
+		 * Set the value for a key, replacing and deleting any
+		 * previous value. The map takes ownership of the value.
+		 */
 		void setValueForKey(const MAUtil::String& key, Value* value);
-		Value* getValueForKey(const MAUtil::String& key);
-		const Value* getValueForKey(const MAUtil::String& key) const;
+		void setValueForKey(const char* key, int keyLength, Value* value);
 
-		MAUtil::String toString() const;
+		/**
+		 * Remove the entry for a key without deleting its value. The
+		 * entries after it move down one index.
+		 * \return The value, which the caller now owns, or NULL if the
+		 * key is not in the map.
+		 */
+		Value* removeValueForKey(const char* key, int keyLength);
 
 	private:
-		MAUtil::Map<MAUtil::String, Value*> mMap;
+		friend class Value;
+		friend class Parser;
+		friend class Document;
+		friend struct ParserCallbacks;
+
+		void setKeyTable(KeyTable* keys);
+		void setShape(Shape* shape);
+		void reserve(int capacity);
+		void addEntry(const char* key, int keyLength, Value* value);
 	};
 
 	class ArrayValue : public Value {
 	public:
-		ArrayValue();
-		~ArrayValue();
+		ArrayValue(Arena* arena = NULL);
 
+		/**
+		 * Add a value at the end. The array takes ownership of the value.
+		 */
 		void addValue(Value* value);
 
-		Value* getValueByIndex(int i);
-		const Value* getValueByIndex(int i) const;
-		int getNumChildValues() const;
+		/**
+		 * Insert a value before the value at index, or at the end if
+		 * index is getNumChildValues(). The array takes ownership of
+		 * the value.
+		 */
+		void insertValue(int index, Value* value);
 
-		const MAUtil::Vector<Value*>& getValues() const;
+		/**
+		 * Replace the value at index, deleting the previous value. The
+		 * array takes ownership of the value.
+		 */
+		void setValue(int index, Value* value);
+
+		/**
+		 * Remove the value at index without deleting it. The values
+		 * after it move down one index.
+		 * \return The value, which the caller now owns, or NULL if
+		 * index is out of range.
+		 */
+		Value* removeValue(int index);
+
+		/**
+		 * \return The getNumChildValues() values of the array.
+		 */
+		Value* const* getValues() const;
 
-		MAUtil::String toString() const;
 	private:
-		MAUtil::Vector<Value*> mValues;
+		friend class Value;
+		friend class Parser;
+
+		void reserve(int capacity);
+	};
+
+	class Parser;
+
+	/**
+	 * The number of values of each type in a parsed document.
+	 */
+	struct NodeCounts {
+		NodeCounts();
+
+		/**
+		 * \return The total number of values.
+		 */
+		int getTotal() const;
+
+		int nulls;
+		int booleans;
+		int numbers;
+		int strings;
+		int maps;
+		int arrays;
+	};
+
+	/**
+	 * What a parse did and where its time went, see Parser::getStats().
+	 *
+	 * Only collected when YAJLDom and yajl are built with
+	 * YAJLDOM_STATS defined, otherwise all fields are zero and parses
+	 * cost nothing extra. When collected, the counters cost an
+	 * increment each and the clock is read around one yajl callback in
+	 * 16, on average.
+	 */
+	struct ParseStats {
+		ParseStats();
+
+		/**
+		 * The bytes of Json text consumed.
+		 */
+		int bytes;
+
+		/**
+		 * The tokens of each type, including values that are skipped
+		 * by a projection or only validated.
+		 */
+		int nullTokens;
+		int booleanTokens;
+		int numberTokens;
+		int stringTokens;
+		int keyTokens;
+		int mapTokens;
+		int arrayTokens;
+
+		/**
+		 * The values created, by type. Zero when validating.
+		 */
+		NodeCounts nodes;
+
+		/**
+		 * Strings and keys with escapes, which yajl decodes into a
+		 * buffer of its own.
+		 */
+		int escapedStrings;
+
+		/**
+		 * The most maps and arrays open at once.
+		 */
+		int maxDepth;
+
+		/**
+		 * Allocations made for the values, keys and yajl buffers, in
+		 * arenas and on the heap, and their total size. Heap
+		 * allocations are counted for the whole program, so heap
+		 * parses on other threads at the same time are included.
+		 */
+		int allocations;
+		int bytesAllocated;
+
+		/**
+		 * Milliseconds spent in yajl lexing and parsing the text, in
+		 * the callbacks that build the tree, and deleting values of
+		 * an earlier or a failed document. The build time is
+		 * estimated by timing a random sample of the callbacks with
+		 * the millisecond clock. Like the lexing time, which is the
+		 * rest of the time spent in yajl, it is only accurate for
+		 * large documents, or summed over many parses.
+		 */
+		int lexTime;
+		int buildTime;
+		int teardownTime;
+	};
+
+	/**
+	 * A document tree that owns all its values.
+	 *
+	 * Values, string data and container storage are allocated from
+	 * one Arena. Deleting the document frees the arena in a few large
+	 * blocks, without visiting the values. Parsing into a document
+	 * that has been used before reuses its blocks.
+	 */
+	class Document {
+	public:
+		/**
+		 * Flags for parse().
+		 */
+		enum ParseFlags {
+			/**
+			 * Strings and keys without escapes refer to the Json text
+			 * instead of being copied. The caller must keep the text
+			 * unchanged until the document is cleared or deleted.
+			 * Strings with escapes are still decoded into the document.
+			 */
+			ZERO_COPY = 1,
+
+			/**
+			 * Like ZERO_COPY, but the document takes ownership of the
+			 * text and deallocates it with free() when it is cleared
+			 * or deleted.
+			 */
+			ADOPT_TEXT = 3
+		};
+
+		Document();
+
+		/**
+		 * \param blockSize The size of the first block of the arena,
+		 * smaller than the default for documents that stay small.
+		 */
+		explicit Document(int blockSize);
+
+		~Document();
+
+		/**
+		 * Parse Json string data into this document, replacing the
+		 * current contents.
+		 * \param jsonText UTF8 or ASCII.
+		 * \param jsonTextLength Length of Json text.
+		 * \param flags A combination of ParseFlags, 0 to copy all
+		 * strings into the document.
+		 * \return true if successful. On error the document is empty.
+		 */
+		bool parse(const unsigned char* jsonText, size_t jsonTextLength,
+				int flags = 0);
+
+		/**
+		 * Load a snapshot written by writeSnapshot() into this
+		 * document, replacing the current contents. Much faster than
+		 * parsing the Json text, see Snapshot.h.
+		 * \param data The snapshot, aligned like memory from malloc.
+		 * \param length Length of the snapshot.
+		 * \param flags ZERO_COPY or ADOPT_TEXT let strings and keys
+		 * refer to the snapshot, which must then be kept like the Json
+		 * text of a zero copy parse. With 0 they are copied into the
+		 * document.
+		 * \return true if successful. On error the document is empty.
+		 */
+		bool loadSnapshot(const unsigned char* data, size_t length,
+				int flags = 0);
+
+		/**
+		 * Load a snapshot from a data object. It is read with one call
+		 * into memory that the document keeps, so the data object is
+		 * not needed afterwards.
+		 */
+		bool loadSnapshot(MAHandle data);
+
+		/**
+		 * \return The root of the document, or NULL if it is empty.
+		 */
+		Value* getRoot();
+		const Value* getRoot() const;
+
+		/**
+		 * Set the root of the document. The value must be created by
+		 * this document.
+		 */
+		void setRoot(Value* root);
+
+		/**
+		 * Delete all values. The memory is kept for reuse.
+		 */
+		void clear();
+
+		/**
+		 * \return The arena that holds the values of this document.
+		 */
+		Arena& getArena();
+
+		/**
+		 * Intern the keys of the maps in this document in a table,
+		 * which can be shared with other documents and kept between
+		 * parses. The table is not owned by the document and must
+		 * outlive it. Only used by maps created after the call.
+		 * \param keys The table, or NULL to copy the keys into the
+		 * document, which is the default.
+		 */
+		void setKeyTable(KeyTable* keys);
+
+		/**
+		 * \return The key table, or NULL if keys are not interned.
+		 */
+		KeyTable* getKeyTable();
+
+		/**
+		 * Create values owned by this document. They are deallocated
+		 * with the document and must not be passed to deleteValue.
+		 */
+		NullValue* createNull();
+		BooleanValue* createBoolean(bool value);
+		NumberValue* createNumber(double num);
+		NumberValue* createNumber(int num);
+		NumberValue* createNumber(long long num);
+		StringValue* createString(const char* str, int length);
+		MapValue* createMap();
+		ArrayValue* createArray();
+
+		/**
+		 * \return A deep copy of value owned by this document, NULL if
+		 * value is NULL. value can be in any document or on the heap.
+		 */
+		Value* copyValue(const Value* value);
+
+	private:
+		// Never copied.
+		Document(const Document&);
+		Document& operator=(const Document&);
+
+		Arena mArena;
+		Value* mRoot;
+		KeyTable* mKeys;
+
+		/**
+		 * Json text owned by the document, see ADOPT_TEXT.
+		 */
+		unsigned char* mText;
+	};
+
+	/**
+	 * Builds a document tree from yajl parse events.
+	 *
+	 * All state used while parsing (the root, the stack of open
+	 * containers and the stack of map keys) lives in the Parser
+	 * object and is passed to yajl as the callback context. Separate
+	 * Parser objects can therefore parse documents at the same time,
+	 * interleaved or on separate threads. A single Parser parses one
+	 * document at a time.
+	 *
+	 * A document can be given all at once with parse(), or streamed in
+	 * pieces with feed() followed by finish(). When streaming, the tree
+	 * is built as the data arrives and the chunks do not have to be
+	 * kept after feed() returns.
+	 *
+	 * The values of a container are collected while it is open and
+	 * stored in one allocation of the exact size when it is closed. When
+	 * parsing into a document, a map that has the same keys as an earlier
+	 * map gets the same shape.
+	 *
+	 * The yajl parser and its buffers are allocated by the first parse,
+	 * from an arena of the Parser, and reset, not reallocated, for the
+	 * following ones. When parsing
+	 * many small documents, keep one Parser and call parse() for each,
+	 * moving it to the next document with setDocument().
+	 */
+	class Parser {
+	public:
+		/**
+		 * What a parse produces, see setMode().
+		 */
+		enum Mode {
+			/**
+			 * Only check that the text is valid Json and count the
+			 * values, see isValid() and getNodeCounts(). No tree is
+			 * built and finish() returns NULL.
+			 */
+			VALIDATE,
+
+			/**
+			 * Build the document tree. This is the default.
+			 */
+			BUILD_TREE,
+
+			/**
+			 * Build the tree and also write the document as compact
+			 * Json text, see getText().
+			 */
+			BUILD_TREE_AND_TEXT
+		};
+
+		/**
+		 * Create a parser that allocates the values on the heap.
+		 */
+		Parser();
+
+		/**
+		 * Create a parser that parses into a document. The values
+		 * are allocated in the document, which is cleared when a new
+		 * parse starts. The root is both returned and set as the root
+		 * of the document, and is deallocated with the document.
+		 */
+		Parser(Document& document);
+
+		~Parser();
+
+		/**
+		 * Parse into another document from now on. A document started
+		 * with feed() and not finished is discarded. The settings of
+		 * the parser are kept.
+		 */
+		void setDocument(Document& document);
+
+		/**
+		 * Parse Json string data and return the root node of
+		 * the document tree.
+		 * \param jsonText UTF8 or ASCII.
+		 * \param jsonTextLength Length of Json text.
+		 * \return The root node if successful, or NULL on error.
+		 * The returned node must be deallocated with deleteValue.
+		 */
+		Value* parse(const unsigned char* jsonText, size_t jsonTextLength);
+
+		/**
+		 * Let strings and keys without escapes refer to the text given
+		 * to parse() instead of copying them. Only used when parsing
+		 * into a Document, see Document::ZERO_COPY. Not used by feed(),
+		 * since the chunks do not outlive the call. Default is false.
+		 */
+		void setZeroCopy(bool zeroCopy);
+
+		/**
+		 * Parse the next piece of a document. The first call after
+		 * construction or finish() starts a new document.
+		 * \param chunk UTF8 or ASCII. Only used during the call.
+		 * \param chunkLength Length of the chunk.
+		 * \return true if the data so far is valid Json, false on
+		 * error. After an error, further calls to feed() are ignored
+		 * and finish() returns NULL.
+		 */
+		bool feed(const unsigned char* chunk, size_t chunkLength);
+
+		/**
+		 * Complete the document started with feed().
+		 * \return The root node if successful, or NULL on error or if
+		 * no document was started. The returned node must be
+		 * deallocated with deleteValue.
+		 */
+		Value* finish();
+
+		/**
+		 * Set what the following parses produce. Default is BUILD_TREE.
+		 */
+		void setMode(Mode mode);
+
+		/**
+		 * \return true if the last finished document was valid Json.
+		 * This is how the result of a VALIDATE parse is read.
+		 */
+		bool isValid() const;
+
+		/**
+		 * \return The number of values of each type in the last
+		 * document, or in the part of it parsed so far.
+		 */
+		const NodeCounts& getNodeCounts() const;
+
+		/**
+		 * \return The statistics of the last finished or failed
+		 * document. All zero unless built with YAJLDOM_STATS.
+		 */
+		const ParseStats& getStats() const;
+
+		/**
+		 * Get the compact Json text written by a BUILD_TREE_AND_TEXT
+		 * parse. The text is owned by the parser and is valid until the
+		 * next parse starts or the parser is deleted.
+		 * \param text Set to the text, which is not null terminated.
+		 * \param length Set to the length of the text.
+		 * \return false if the last parse did not write any text or
+		 * failed, or if the document nests maps and arrays deeper than
+		 * yajl_gen allows (YAJL_MAX_DEPTH, 128). The tree is still built
+		 * in that case.
+		 */
+		bool getText(const unsigned char** text, unsigned int* length) const;
+
+		/**
+		 * Only build the values that a projection leads to, and the
+		 * maps and arrays on the way to them. Everything else is
+		 * skipped without creating values or copying strings, and
+		 * strings inside skipped maps and arrays are not decoded.
+		 *
+		 * Maps only get the keys on the paths. Arrays keep the order
+		 * of their elements, and skipped elements in front of an index
+		 * on a path are replaced by null, so the index still finds its
+		 * element. The root is always built. The counts and the text
+		 * of the parse only include the values that are built.
+		 *
+		 * \param projection The paths, or NULL to build everything,
+		 * which is the default. Not copied, it must outlive the parses.
+		 */
+		void setProjection(const Projection* projection);
+
+		/**
+		 * Called for each element of an array streamed with
+		 * streamRecords().
+		 * \param record The element. It is deleted, or its memory is
+		 * reused, when the callback returns.
+		 * \param index The position of the element in the array.
+		 * \return false to stop the parse, which then fails.
+		 */
+		typedef bool (*RecordCallback)(Value* record, int index,
+				void* userData);
+
+		/**
+		 * Pass the elements of an array to a callback one at a time as
+		 * they are parsed, instead of adding them to the array, which
+		 * is empty in the parsed tree. The memory used for the
+		 * elements is bounded by the largest one, not by the length of
+		 * the array. Combined with feed(), a long array can be
+		 * handled as it arrives.
+		 *
+		 * Elements of a document parse are allocated in an arena of
+		 * the parser that is reset after each callback. Map shapes are
+		 * kept in the document, so a CachedKey finds its slot in every
+		 * record.
+		 *
+		 * \param arrayPath The path to the array, see Path. A path
+		 * with wildcards streams every array it matches. Not copied,
+		 * it must outlive the parses. NULL to build the whole tree,
+		 * which is the default.
+		 * \param callback Receives the elements.
+		 * \param userData Passed to the callback.
+		 */
+		void streamRecords(const Path* arrayPath, RecordCallback callback,
+				void* userData);
+
+	private:
+		friend struct ParserCallbacks;
+
+		/**
+		 * A value waiting for its container to be closed.
+		 * The key is NULL for array values.
+		 */
+		struct Pending {
+			Pending() {}
+			Pending(const char* key, int keyLength, Value* value) :
+				key(key), keyLength(keyLength), value(value) {
+			}
+			const char* key;
+			int keyLength;
+			Value* value;
+		};
+
+		/**
+		 * An open container and the index of its first value in
+		 * mPending.
+		 */
+		struct Container {
+			Container() {}
+			Container(Value* value, int first, int node, int step) :
+				value(value), first(first), node(node), position(0),
+				step(step), records(false), record(false) {
+			}
+			Value* value;
+			int first;
+
+			/**
+			 * The projection node of the container, and the number of
+			 * array elements seen so far.
+			 */
+			int node;
+			int position;
+
+			/**
+			 * The number of segments of the record path that lead to
+			 * the container, -1 if it is not on the path. records is
+			 * set for the arrays that are streamed, record for their
+			 * elements.
+			 */
+			int step;
+			bool records;
+			bool record;
+
+			/**
+			 * mKeyArena when the container was opened. The keys of
+			 * its maps are copied when it is closed, and the arena is
+			 * rewound to here.
+			 */
+			Arena::Mark keys;
+		};
+
+		void begin();
+		void end();
+		void reset();
+		void freeText();
+		void pushValue(Value* value);
+		void pushContainer(Value* value);
+		void popValue();
+		void pushKey(const char* str, int length);
+		void pushString(const char* str, int length);
+		void pushNumber(const char* str, int length);
+		bool isInText(const unsigned char* str, int length) const;
+		const char* keepKey(Arena* arena, const char* key, int keyLength);
+		Shape* findShape(const Pending* pending, int count);
+		bool acceptKey(const char* str, int length);
+		bool beginValue(bool isContainer);
+		void skipContainer();
+		int nextRecordStep(const Container& container, int position) const;
+		void endRecord(Value* record);
+
+		Value* mRoot;
+		MAUtil::Stack<Container> mValueStack;
+		MAUtil::Vector<Pending> mPending;
+
+		/**
+		 * The key for the next value in the current map.
+		 */
+		const char* mKey;
+		int mKeyLength;
+
+		/**
+		 * Holds key text until the map is closed when parsing to the
+		 * heap. Document parses store the keys in the document.
+		 */
+		Arena mKeyArena;
+
+		/**
+		 * Where values are allocated, NULL for the heap.
+		 */
+		Arena* mArena;
+		Document* mDocument;
+
+		/**
+		 * The key table of the document, NULL if keys are not interned.
+		 */
+		KeyTable* mKeys;
+
+		/**
+		 * The text given to parse() when strings may refer to it,
+		 * NULL otherwise.
+		 */
+		const unsigned char* mText;
+		const unsigned char* mTextEnd;
+		bool mZeroCopy;
+
+		/**
+		 * Hash table of the shapes of the maps in the document.
+		 */
+		MAUtil::Vector<Shape*> mShapes;
+		int mShapeCount;
+
+		Mode mMode;
+		NodeCounts mCounts;
+
+		/**
+		 * Writes the text of a BUILD_TREE_AND_TEXT parse. mSpareGen
+		 * keeps the generator of an earlier parse for reuse.
+		 * The generator is put aside when it refuses a value, since the
+		 * text is then incomplete and yajl_gen must not be called again.
+		 */
+		struct yajl_gen_t* mGen;
+		struct yajl_gen_t* mSpareGen;
+
+		/**
+		 * Kept between documents, mStarted is set while one is parsed.
+		 */
+		struct yajl_handle_t* mHandle;
+		bool mStarted;
+		bool mFailed;
+		bool mValid;
+
+		/**
+		 * See setProjection(). mNode is the projection node for the
+		 * value of the current key, mNextNode the node of the value
+		 * being added. mSkipDepth counts the open maps and arrays of
+		 * a skipped value.
+		 */
+		const Projection* mProjection;
+		int mNode;
+		int mNextNode;
+		int mSkipDepth;
+
+		/**
+		 * See streamRecords(). mNextStep is the record path step of
+		 * the value being added. mRecordArena holds the current record
+		 * of a document parse, and the keys of the current record.
+		 */
+		const Path* mRecordPath;
+		RecordCallback mRecordCallback;
+		void* mRecordUserData;
+		int mNextStep;
+		int mRecordIndex;
+		bool mInRecord;
+		bool mStopped;
+		Arena mRecordArena;
+
+		/**
+		 * Holds the yajl parser, the generator and their buffers, which
+		 * live as long as the Parser. mSizeHint is the length of the
+		 * text given to parse(), which sizes the arena when they are
+		 * first allocated.
+		 */
+		Arena mYajlArena;
+		int mSizeHint;
+
+#ifdef YAJLDOM_STATS
+		friend struct StatsCallbacks;
+
+		void beginStats();
+		void endStats();
+		void countAllocations(int& count, int& bytes) const;
+
+		/**
+		 * mParseTime is the time spent in yajl, the callbacks
+		 * included. The bases are the allocation counts when the
+		 * document started. The rest choose the callbacks that are
+		 * timed, see StatsCallbacks.
+		 */
+		ParseStats mStats;
+		int mParseTime;
+		int mAllocationBase;
+		int mBytesBase;
+		unsigned int mStatsRandom;
+		int mStatsCountdown;
+		int mStatsGap;
+#endif
 	};
 
 	/**
@@ -142,12 +1051,79 @@ class Value {
 	 * \param jsonText UTF8 or ASCII.
 	 * \param jsonTextLength Length of Json text.
 	 * \return The root node if successful, or NULL on error.
-	 * The returned node must be deallocated with delete.
+	 * The returned node must be deallocated with deleteValue.
+	 * Uses a temporary Parser, so it is safe to call from several
+	 * threads at the same time.
+	 * \param stats If not NULL, set to the statistics of the parse,
+	 * see ParseStats.
+	 */
+	Value* parse(const unsigned char* jsonText, size_t jsonTextLength,
+			ParseStats* stats = NULL);
+
+	/**
+	 * Check that Json string data is valid, without building a tree.
+	 * \param jsonText UTF8 or ASCII.
+	 * \param jsonTextLength Length of Json text.
+	 * \param counts If not NULL, set to the number of values of each
+	 * type in the document.
+	 * \return true if the text is valid Json.
+	 */
+	bool validate(const unsigned char* jsonText, size_t jsonTextLength,
+			NodeCounts* counts = NULL);
+
+	/**
+	 * Flags for serialize().
+	 */
+	enum SerializeFlags {
+		/**
+		 * No white space.
+		 */
+		COMPACT = 0,
+
+		/**
+		 * One value per line, indented by two spaces per level.
+		 */
+		PRETTY = 1
+	};
+
+	/**
+	 * Write a value as Json text, in one pass over the tree. Strings
+	 * and keys are escaped. Numbers parsed from text are written as
+	 * they were in the text.
+	 * \param value The value, NULL is written as null.
+	 * \param writer Receives the text. Flushed when done.
+	 * \param flags COMPACT or PRETTY.
+	 */
+	void serialize(const Value* value, Writer& writer, int flags = COMPACT);
+
+	/**
+	 * Write a value as Json text into a new data object.
+	 * \param value The value, NULL is written as null.
+	 * \param placeholder Where the data object is created, it has
+	 * the size of the text.
+	 * \param flags COMPACT or PRETTY.
+	 * \return RES_OK, or RES_OUT_OF_MEMORY if the data object could not
+	 * be created.
+	 */
+	int serializeToData(const Value* value, MAHandle placeholder,
+			int flags = COMPACT);
+
+	/**
+	 * Write a string as a quoted Json string, escaped like the strings
+	 * written by serialize().
+	 * \param writer Receives the text. Not flushed.
+	 */
+	void serializeString(const char* str, int length, Writer& writer);
+
+	/**
+	 * \return A deep copy of value on the heap, to be deleted with
+	 * deleteValue, NULL if value is NULL. value can be in a document or
+	 * on the heap.
 	 */
-	Value* parse(const unsigned char* jsonText, size_t jsonTextLength);
+	Value* copyValue(const Value* value);
 
 	/**
-	 * Use this function to safely delete a value (won't do anything if the value is NULL or equal to sNullValue).
+	 * Use this function to safely delete a value (won't do anything if the value is NULL, equal to sNullValue or owned by a Document).
 	 * sNullValue might be returned if you do getValueByIndex or getValueForKey and the key or element doesn't exist.
 	 */
 	void deleteValue(Value* value);
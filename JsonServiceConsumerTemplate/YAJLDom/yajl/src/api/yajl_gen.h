@@ -152,6 +152,10 @@ extern "C" {
      *  intended to enable incremental JSON outputing. */
     YAJL_API void yajl_gen_clear(yajl_gen hand);
 
+    /** clear the output buffer and the generation state, so that the
+     *  generator can write a new document.  Keeps the buffer memory. */
+    YAJL_API void yajl_gen_reset(yajl_gen hand);
+
 #ifdef __cplusplus
 }
 #endif    
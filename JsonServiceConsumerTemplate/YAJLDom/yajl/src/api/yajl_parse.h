@@ -135,6 +135,48 @@ extern "C" {
     /** free a parser handle */    
     YAJL_API void yajl_free(yajl_handle handle);
 
+    /** prepare a parser for a new document, keeping its buffers.  Any
+     *  text of an unfinished or failed document is discarded.  This is
+     *  much cheaper than freeing the handle and allocating a new one.
+     *  \param hand a parser handle
+     */
+    YAJL_API void yajl_reset(yajl_handle hand);
+
+    /** replace the callbacks of a parser.  May be called from within a
+     *  callback, the new callbacks receive the events from the next
+     *  token on.  Strings and map keys are only decoded when there is a
+     *  callback for them, so a set of callbacks without them skips over
+     *  text cheaply.
+     *  \param hand a parser handle
+     *  \param callbacks  the new callbacks, the context is unchanged
+     */
+    YAJL_API void yajl_set_callbacks(yajl_handle hand,
+                                     const yajl_callbacks * callbacks);
+
+#ifdef YAJLDOM_STATS
+    /** counts of the tokens of a document, kept when built with
+     *  YAJLDOM_STATS */
+    typedef struct {
+        unsigned int nulls;
+        unsigned int booleans;
+        unsigned int numbers;
+        unsigned int strings;
+        unsigned int keys;
+        unsigned int maps;
+        unsigned int arrays;
+        /** strings and keys with escapes */
+        unsigned int escapedStrings;
+        /** the most maps and arrays open at once */
+        unsigned int maxDepth;
+    } yajl_stats;
+
+    /** get the token counts of the document being parsed.  They are
+     *  cleared by yajl_reset.
+     *  \param hand a parser handle
+     */
+    YAJL_API const yajl_stats * yajl_get_stats(yajl_handle hand);
+#endif
+
     /** Parse some json!
      *  \param hand - a handle to the json parser allocated with yajl_alloc
      *  \param jsonText - a pointer to the UTF8 json text to be parsed
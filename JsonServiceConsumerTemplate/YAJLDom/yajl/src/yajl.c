@@ -98,6 +98,9 @@ yajl_alloc(const yajl_callbacks * callbacks,
     hand->bytesConsumed = 0;
     hand->decodeBuf = yajl_buf_alloc(&(hand->alloc));
     yajl_bs_init(hand->stateStack, &(hand->alloc));
+#ifdef YAJLDOM_STATS
+    memset((void *) &(hand->stats), 0, sizeof(yajl_stats));
+#endif
 
     yajl_bs_push(hand->stateStack, yajl_state_start);    
 
@@ -113,6 +116,33 @@ yajl_free(yajl_handle handle)
     YA_FREE(&(handle->alloc), handle);
 }
 
+void
+yajl_reset(yajl_handle hand)
+{
+    yajl_lex_reset(hand->lexer);
+    hand->bytesConsumed = 0;
+    yajl_buf_clear(hand->decodeBuf);
+    hand->stateStack.used = 0;
+    yajl_bs_push(hand->stateStack, yajl_state_start);
+#ifdef YAJLDOM_STATS
+    memset((void *) &(hand->stats), 0, sizeof(yajl_stats));
+#endif
+}
+
+#ifdef YAJLDOM_STATS
+const yajl_stats *
+yajl_get_stats(yajl_handle hand)
+{
+    return &(hand->stats);
+}
+#endif
+
+void
+yajl_set_callbacks(yajl_handle hand, const yajl_callbacks * callbacks)
+{
+    hand->callbacks = callbacks;
+}
+
 yajl_status
 yajl_parse(yajl_handle hand, const unsigned char * jsonText,
            unsigned int jsonTextLen)
@@ -68,7 +68,8 @@ typedef struct yajl_bytestack_t
 
 #define yajl_bs_push(obs, byte) {                       \
     if (((obs).size - (obs).used) == 0) {               \
-        (obs).size += YAJL_BS_INC;                      \
+        (obs).size = (obs).size ? (obs).size * 2        \
+                                : YAJL_BS_INC;          \
         (obs).stack = (obs).yaf->realloc((obs).yaf->ctx,\
                                          (void *) (obs).stack, (obs).size);\
     }                                                   \
@@ -137,6 +137,17 @@ yajl_lex_free(yajl_lexer lxr)
     return;
 }
 
+void
+yajl_lex_reset(yajl_lexer lxr)
+{
+    lxr->lineOff = 0;
+    lxr->charOff = 0;
+    lxr->error = yajl_lex_e_ok;
+    yajl_buf_clear(lxr->buf);
+    lxr->bufOff = 0;
+    lxr->bufInUse = 0;
+}
+
 /* a lookup table which lets us quickly determine three things:
  * VEC - valid escaped conrol char
  * IJC - invalid json char
@@ -135,6 +135,13 @@ yajl_render_error_string(yajl_handle hand, const unsigned char * jsonText,
     }
 
 
+/* count a token when built with YAJLDOM_STATS */
+#ifdef YAJLDOM_STATS
+#define _STAT(field) ((hand->stats.field)++)
+#else
+#define _STAT(field)
+#endif
+
 yajl_status
 yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
               unsigned int jsonTextLen)
@@ -176,12 +183,15 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
                     goto around_again;
                 case yajl_tok_string:
+                    _STAT(strings);
                     if (hand->callbacks && hand->callbacks->yajl_string) {
                         _CC_CHK(hand->callbacks->yajl_string(hand->ctx,
                                                              buf, bufLen));
                     }
                     break;
                 case yajl_tok_string_with_escapes:
+                    _STAT(strings);
+                    _STAT(escapedStrings);
                     if (hand->callbacks && hand->callbacks->yajl_string) {
                         yajl_buf_clear(hand->decodeBuf);
                         yajl_string_decode(hand->decodeBuf, buf, bufLen);
@@ -191,29 +201,34 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     }
                     break;
                 case yajl_tok_bool: 
+                    _STAT(booleans);
                     if (hand->callbacks && hand->callbacks->yajl_boolean) {
                         _CC_CHK(hand->callbacks->yajl_boolean(hand->ctx,
                                                               *buf == 't'));
                     }
                     break;
                 case yajl_tok_null: 
+                    _STAT(nulls);
                     if (hand->callbacks && hand->callbacks->yajl_null) {
                         _CC_CHK(hand->callbacks->yajl_null(hand->ctx));
                     }
                     break;
                 case yajl_tok_left_bracket:
+                    _STAT(maps);
                     if (hand->callbacks && hand->callbacks->yajl_start_map) {
                         _CC_CHK(hand->callbacks->yajl_start_map(hand->ctx));
                     }
                     stateToPush = yajl_state_map_start;
                     break;
                 case yajl_tok_left_brace:
+                    _STAT(arrays);
                     if (hand->callbacks && hand->callbacks->yajl_start_array) {
                         _CC_CHK(hand->callbacks->yajl_start_array(hand->ctx));
                     }
                     stateToPush = yajl_state_array_start;
                     break;
                 case yajl_tok_integer:
+                    _STAT(numbers);
                     /*
                      * note.  strtol does not respect the length of
                      * the lexical token.  in a corner case where the
@@ -253,6 +268,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     }
                     break;
                 case yajl_tok_double:
+                    _STAT(numbers);
                     if (hand->callbacks) {
                         if (hand->callbacks->yajl_number) {
                             _CC_CHK(hand->callbacks->yajl_number(
@@ -319,6 +335,11 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
             }
             if (stateToPush != yajl_state_start) {
                 yajl_bs_push(hand->stateStack, stateToPush);
+#ifdef YAJLDOM_STATS
+                /* the bottom of the stack is the document itself */
+                if (hand->stateStack.used - 1 > hand->stats.maxDepth)
+                    hand->stats.maxDepth = hand->stateStack.used - 1;
+#endif
             }
 
             goto around_again;
@@ -337,6 +358,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     yajl_bs_set(hand->stateStack, yajl_state_lexical_error);
                     goto around_again;
                 case yajl_tok_string_with_escapes:
+                    _STAT(escapedStrings);
                     if (hand->callbacks && hand->callbacks->yajl_map_key) {
                         yajl_buf_clear(hand->decodeBuf);
                         yajl_string_decode(hand->decodeBuf, buf, bufLen);
@@ -345,6 +367,7 @@ yajl_do_parse(yajl_handle hand, const unsigned char * jsonText,
                     }
                     /* intentional fall-through */
                 case yajl_tok_string:
+                    _STAT(keys);
                     if (hand->callbacks && hand->callbacks->yajl_map_key) {
                         _CC_CHK(hand->callbacks->yajl_map_key(hand->ctx, buf,
                                                               bufLen));
@@ -68,6 +68,9 @@ struct yajl_handle_t {
     yajl_bytestack stateStack;
     /* memory allocation routines */
     yajl_alloc_funcs alloc;
+#ifdef YAJLDOM_STATS
+    yajl_stats stats;
+#endif
 };
 
 yajl_status
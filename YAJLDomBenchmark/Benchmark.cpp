@@ -0,0 +1,1013 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Benchmark.cpp
+ *
+ *  Measures the throughput of YAJLDom on the host machine.
+ *  Usage: benchmark [file.json]
+ *  Without a file, a corpus is generated: a document like sample.json
+ *  with many people, also minified and pretty printed, arrays of
+ *  records and of numbers, long strings with escapes, deeply nested
+ *  maps, and a batch of small documents with one person each.
+ */
+
+#include <ma.h>
+#include <mastring.h>
+#include <measure.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <MAUtil/String.h>
+#include <YAJLDom/YAJLDom.h>
+#include <YAJLDom/Path.h>
+#include <YAJLDom/Binding.h>
+#include <YAJLDom/Snapshot.h>
+#include <YAJLDom/ParallelParser.h>
+#include <YAJLDom/BatchParser.h>
+#include <YAJLDom/Patch.h>
+#include <YAJLDom/SharedDocument.h>
+
+using namespace MAUtil;
+using namespace MAUtil::YAJLDom;
+
+/**
+ * Each benchmark is repeated for at least this many milliseconds.
+ */
+static const int MIN_TIME = 500;
+
+/**
+ * Create an array of count people.
+ */
+static String generateRecords(int count) {
+	String json = "[";
+	char buf[256];
+	for (int i = 0; i < count; i++) {
+		sprintf(buf,
+			"%s{ \"name\": \"Person %d\", \"company\": \"MoSync\", "
+			"\"age\": %d, \"score\": %d.%d, \"active\": %s, "
+			"\"tags\": [\"mobile\", \"json\"], \"manager\": null }",
+			i ? ", " : "", i, 20 + i % 50, i % 1000, i % 10,
+			i % 3 ? "true" : "false");
+		json += buf;
+	}
+	json += "]";
+	return json;
+}
+
+/**
+ * Create a document with an array of count people.
+ */
+static String generatePeople(int count) {
+	return "{ \"people\" : " + generateRecords(count) + " }";
+}
+
+/**
+ * Create count small documents with one person each.
+ */
+static void generateSmallDocuments(int count, Vector<String>& texts) {
+	char buf[256];
+	for (int i = 0; i < count; i++) {
+		sprintf(buf,
+			"{ \"name\": \"Person %d\", \"age\": %d, \"active\": %s, "
+			"\"tags\": [\"mobile\", \"json\"] }",
+			i, 20 + i % 50, i % 3 ? "true" : "false");
+		texts.add(buf);
+	}
+}
+
+/**
+ * Create a document with count rows of numbers.
+ */
+static String generateNumbers(int count) {
+	String json = "[";
+	char buf[256];
+	for (int i = 0; i < count; i++) {
+		sprintf(buf, "%s[%d, %d.%02d, -%d.5e%d, %d%09d, 0.%03d]",
+			i ? ", " : "", i, i % 1000, i % 100, i % 77, i % 12,
+			i + 1, i * 7, i % 1000);
+		json += buf;
+	}
+	json += "]";
+	return json;
+}
+
+/**
+ * Create an array of count long strings, with escaped quotes, control
+ * characters and Unicode.
+ */
+static String generateStrings(int count) {
+	String json = "[";
+	char buf[1024];
+	for (int i = 0; i < count; i++) {
+		sprintf(buf,
+			"%s\"Line %d of a \\\"quoted\\\" text,\\n\\tindented with a tab "
+			"and a path C:\\\\temp\\\\%d.json, in caf\\u00e9s and "
+			"\\ud83d\\ude00 emoji. Lorem ipsum dolor sit amet, consectetur "
+			"adipiscing elit, sed do eiusmod tempor incididunt ut labore et "
+			"dolore magna aliqua.\\r\\n\"",
+			i ? ", " : "", i, i);
+		json += buf;
+	}
+	json += "]";
+	return json;
+}
+
+/**
+ * Create an array of count maps that are nested depth levels deep.
+ */
+static String generateNested(int count, int depth) {
+	String json = "[";
+	char buf[256];
+	for (int i = 0; i < count; i++) {
+		if (i)
+			json += ", ";
+		for (int k = 0; k < depth; k++) {
+			sprintf(buf, "{ \"level\": %d, \"child\": ", k);
+			json += buf;
+		}
+		sprintf(buf, "[%d, \"leaf\", true]", i);
+		json += buf;
+		for (int k = 0; k < depth; k++)
+			json += " }";
+	}
+	json += "]";
+	return json;
+}
+
+/**
+ * \return The Json text formatted by serialize(), with the given
+ * flags.
+ */
+static String reformat(const String& json, int flags) {
+	Document document;
+	document.parse((const unsigned char*) json.c_str(), json.length());
+	BufferWriter writer;
+	serialize(document.getRoot(), writer, flags);
+	return String(writer.getData(), writer.getLength());
+}
+
+static bool readFile(const char* path, String& json) {
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+	char buf[4096];
+	size_t size;
+	while ((size = fread(buf, 1, sizeof(buf), file)) > 0)
+		json += String(buf, size);
+	fclose(file);
+	return true;
+}
+
+/**
+ * A benchmark parses the text, or writes the parsed document, once
+ * per call.
+ * \return false on failure.
+ */
+typedef bool (*BenchmarkFunction)(const String& json, const Document& parsed);
+
+/**
+ * Set during the first call of each benchmark, which is not timed.
+ * Benchmarks that build a tree or change one check it then.
+ */
+static bool sChecking = false;
+
+/**
+ * \return true if two trees serialize to the same text, which is the
+ * case if they have the same values in the same order.
+ */
+static bool sameTree(const Value* a, const Value* b) {
+	static BufferWriter writerA, writerB;
+	writerA.clear();
+	writerB.clear();
+	serialize(a, writerA);
+	serialize(b, writerB);
+	return writerA.getLength() == writerB.getLength()
+			&& memcmp(writerA.getData(), writerB.getData(),
+					writerA.getLength()) == 0;
+}
+
+/**
+ * \return false if a benchmark does not apply to the parsed document.
+ */
+typedef bool (*Precondition)(const Document& parsed);
+
+/**
+ * \return The array of people of a document like generatePeople(), or
+ * NULL if it has none.
+ */
+static const Value* getPeople(const Document& parsed) {
+	const Value* root = parsed.getRoot();
+	if (root->getType() != Value::MAP)
+		return NULL;
+	const Value* people = root->getValueForKey("people");
+	return people->getType() == Value::ARRAY ? people : NULL;
+}
+
+static bool hasPeople(const Document& parsed) {
+	return getPeople(parsed) != NULL;
+}
+
+static bool hasContainerRoot(const Document& parsed) {
+	Value::Type type = parsed.getRoot()->getType();
+	return type == Value::MAP || type == Value::ARRAY;
+}
+
+static bool validateOnly(const String& json, const Document& parsed) {
+	return validate((const unsigned char*) json.c_str(), json.length());
+}
+
+static bool heapTree(const String& json, const Document& parsed) {
+	Value* root = parse((const unsigned char*) json.c_str(), json.length());
+	deleteValue(root);
+	return root != NULL;
+}
+
+static bool documentTree(const String& json, const Document& parsed) {
+	static Document document;
+	return document.parse((const unsigned char*) json.c_str(), json.length());
+}
+
+/**
+ * Runs the tasks on a pool of threads, which are started the first time
+ * they are needed and then wait for the next run, so that a parse does
+ * not include starting threads. The calling thread runs tasks as well.
+ */
+class ThreadRunner : public TaskRunner {
+public:
+	ThreadRunner() :
+		mThreadCount(0), mTask(NULL), mData(NULL), mCount(0), mNext(0),
+		mDone(0), mStopping(false) {
+		pthread_mutex_init(&mLock, NULL);
+		pthread_cond_init(&mWork, NULL);
+		pthread_cond_init(&mFinished, NULL);
+	}
+
+	~ThreadRunner() {
+		pthread_mutex_lock(&mLock);
+		mStopping = true;
+		pthread_cond_broadcast(&mWork);
+		pthread_mutex_unlock(&mLock);
+		for (int i = 0; i < mThreadCount; i++)
+			pthread_join(mThreads[i], NULL);
+		pthread_cond_destroy(&mFinished);
+		pthread_cond_destroy(&mWork);
+		pthread_mutex_destroy(&mLock);
+	}
+
+	void run(Task task, void* const* data, int count) {
+		while (mThreadCount < count - 1 && mThreadCount < MAX_THREADS - 1)
+			pthread_create(&mThreads[mThreadCount++], NULL, work, this);
+
+		pthread_mutex_lock(&mLock);
+		mTask = task;
+		mData = data;
+		mCount = count;
+		mNext = 0;
+		mDone = 0;
+		pthread_cond_broadcast(&mWork);
+		runTasks();
+		while (mDone < mCount)
+			pthread_cond_wait(&mFinished, &mLock);
+		mCount = 0;
+		pthread_mutex_unlock(&mLock);
+	}
+
+	enum { MAX_THREADS = 8 };
+
+private:
+	// Never copied.
+	ThreadRunner(const ThreadRunner&);
+	ThreadRunner& operator=(const ThreadRunner&);
+
+	/**
+	 * Run the tasks no thread has taken yet. Called with mLock held.
+	 */
+	void runTasks() {
+		while (mNext < mCount) {
+			Task task = mTask;
+			void* data = mData[mNext++];
+			pthread_mutex_unlock(&mLock);
+			task(data);
+			pthread_mutex_lock(&mLock);
+			if (++mDone == mCount)
+				pthread_cond_signal(&mFinished);
+		}
+	}
+
+	static void* work(void* runner) {
+		ThreadRunner* r = (ThreadRunner*) runner;
+		pthread_mutex_lock(&r->mLock);
+		while (!r->mStopping) {
+			r->runTasks();
+			pthread_cond_wait(&r->mWork, &r->mLock);
+		}
+		pthread_mutex_unlock(&r->mLock);
+		return NULL;
+	}
+
+	pthread_t mThreads[MAX_THREADS - 1];
+	int mThreadCount;
+
+	/**
+	 * The run in progress, guarded by mLock. mNext is the next task
+	 * to take and mDone the number of tasks that have returned.
+	 */
+	pthread_mutex_t mLock;
+	pthread_cond_t mWork;
+	pthread_cond_t mFinished;
+	Task mTask;
+	void* const* mData;
+	int mCount;
+	int mNext;
+	int mDone;
+	bool mStopping;
+};
+
+/**
+ * Text that is not an array, such as the people documents, is parsed
+ * serially, and must give the same tree as well.
+ */
+template<int THREADS>
+static bool parallelTree(const String& json, const Document& parsed) {
+	static Document document;
+	static ThreadRunner runner;
+	ParallelParser parser(document);
+	parser.setTaskRunner(&runner, THREADS);
+	Value* root = parser.parse((const unsigned char*) json.c_str(),
+			json.length());
+	return root && (!sChecking || sameTree(root, parsed.getRoot()));
+}
+
+static bool documentTreeAndText(const String& json,
+		const Document& parsed) {
+	static Document document;
+	Parser parser(document);
+	parser.setMode(Parser::BUILD_TREE_AND_TEXT);
+	return parser.parse((const unsigned char*) json.c_str(), json.length())
+			!= NULL;
+}
+
+static bool projectedTree(const String& json, const Document& parsed) {
+	static Document document;
+	static Projection projection;
+	static bool compiled = projection.add("people[*].name");
+	Parser parser(document);
+	parser.setProjection(&projection);
+	return compiled && parser.parse((const unsigned char*) json.c_str(),
+			json.length()) != NULL;
+}
+
+static bool countRecord(Value* record, int index, void* userData) {
+	(*(int*) userData)++;
+	return true;
+}
+
+static bool streamedPeople(const String& json, const Document& parsed) {
+	static Document document;
+	static Path people("people");
+	int count = 0;
+	Parser parser(document);
+	parser.streamRecords(&people, countRecord, &count);
+	return parser.parse((const unsigned char*) json.c_str(),
+			json.length()) != NULL;
+}
+
+/**
+ * The records of generatePeople(), for the binding benchmarks.
+ */
+struct Person {
+	Person() : age(0), score(0), active(false) {}
+	String name;
+	String company;
+	int age;
+	double score;
+	bool active;
+	Vector<String> tags;
+};
+
+struct People {
+	Vector<Person> people;
+};
+
+static const FieldBinding sPersonFields[] = {
+	bindField("name", &Person::name),
+	bindField("company", &Person::company),
+	bindField("age", &Person::age),
+	bindField("score", &Person::score),
+	bindField("active", &Person::active),
+	bindField("tags", &Person::tags)
+};
+static const StructBinding<Person> sPersonBinding(sPersonFields);
+
+static const FieldBinding sPeopleFields[] = {
+	bindField("people", &People::people, sPersonBinding)
+};
+static const StructBinding<People> sPeopleBinding(sPeopleFields);
+
+static bool bindPeople(const String& json, const Document& parsed) {
+	static BindingParser parser;
+	People result;
+	return parser.parse(sPeopleBinding, (const unsigned char*) json.c_str(),
+			json.length(), result)
+			&& result.people.size() == getPeople(parsed)->getNumChildValues();
+}
+
+/**
+ * The same result as bindPeople(), by parsing a document and reading
+ * the values from it.
+ */
+static bool extractPeople(const String& json, const Document& parsed) {
+	static Document document;
+	if (!document.parse((const unsigned char*) json.c_str(), json.length()))
+		return false;
+
+	static const CachedKey name("name"), company("company"), age("age"),
+			score("score"), active("active"), tags("tags");
+	People result;
+	const Value* people = document.getRoot()->getValueForKey("people");
+	for (int i = 0; i < people->getNumChildValues(); i++) {
+		const Value* value = people->getValueByIndex(i);
+		result.people.add(Person());
+		Person& person = result.people[result.people.size() - 1];
+		const Value* field = value->getValueForKey(name);
+		person.name = String(field->getString(), field->getStringLength());
+		field = value->getValueForKey(company);
+		person.company = String(field->getString(), field->getStringLength());
+		value->getValueForKey(age)->tryGetInt(person.age);
+		value->getValueForKey(score)->tryGetDouble(person.score);
+		value->getValueForKey(active)->tryGetBool(person.active);
+		const Value* list = value->getValueForKey(tags);
+		for (int j = 0; j < list->getNumChildValues(); j++) {
+			field = list->getValueByIndex(j);
+			person.tags.add(String(field->getString(),
+					field->getStringLength()));
+		}
+	}
+	return result.people.size() == getPeople(parsed)->getNumChildValues();
+}
+
+static bool serializeCompact(const String& json, const Document& parsed) {
+	static BufferWriter writer;
+	writer.clear();
+	serialize(parsed.getRoot(), writer);
+	return writer.getLength() > 0;
+}
+
+static bool serializePretty(const String& json, const Document& parsed) {
+	static BufferWriter writer;
+	writer.clear();
+	serialize(parsed.getRoot(), writer, PRETTY);
+	return writer.getLength() > 0;
+}
+
+static bool countMatch(const Value* value, void* userData) {
+	(*(int*) userData)++;
+	return true;
+}
+
+static bool pathQuery(const String& json, const Document& parsed) {
+	static Path path("people[*].name");
+	int count = 0;
+	path.forEachMatch(parsed.getRoot(), countMatch, &count);
+	// Every person has a name.
+	return count == getPeople(parsed)->getNumChildValues();
+}
+
+/**
+ * The snapshot of the current data, written by the first snapshot
+ * benchmark and loaded by the second.
+ */
+static BufferWriter sSnapshot;
+
+static bool writeSnapshotOnly(const String& json, const Document& parsed) {
+	sSnapshot.clear();
+	writeSnapshot(parsed.getRoot(), sSnapshot);
+	return sSnapshot.getLength() > 0;
+}
+
+static bool loadSnapshotOnly(const String& json, const Document& parsed) {
+	static Document document;
+	return document.loadSnapshot((const unsigned char*) sSnapshot.getData(),
+			sSnapshot.getLength());
+}
+
+static bool rootToString(const String& json, const Document& parsed) {
+	return parsed.getRoot()->toString().length() > 0;
+}
+
+/**
+ * toString() of maps and arrays as it was before serialize(): the
+ * strings of the values concatenated, without escapes. The baseline
+ * for "toString".
+ */
+static String concatenate(const Value* value) {
+	if (value->getType() == Value::MAP) {
+		String ret = "{";
+		for (int i = 0; i < value->getNumEntries(); i++) {
+			int keyLength;
+			const char* key = value->getKeyByIndex(i, &keyLength);
+			ret += "\"";
+			ret += String(key, keyLength);
+			ret += "\": ";
+
+			const Value* item = value->getEntryValue(i);
+			bool isString = item->getType() == Value::STRING;
+			if (isString)
+				ret += "\"";
+			if (item->getType() == Value::NUL)
+				ret += "null";
+			else
+				ret += concatenate(item);
+			if (isString)
+				ret += "\"";
+
+			if (i != value->getNumEntries() - 1)
+				ret += ", ";
+		}
+		ret += "}";
+		return ret;
+	}
+
+	if (value->getType() == Value::ARRAY) {
+		String ret = "[";
+		for (int i = 0; i < value->getNumChildValues(); i++) {
+			const Value* item = value->getValueByIndex(i);
+			bool isString = item->getType() == Value::STRING;
+			if (isString)
+				ret += "\"";
+			ret += concatenate(item);
+			if (isString)
+				ret += "\"";
+
+			if (i != value->getNumChildValues() - 1)
+				ret += ", ";
+		}
+		ret += "]";
+		return ret;
+	}
+
+	return value->toString();
+}
+
+static bool concatenatedToString(const String& json,
+		const Document& parsed) {
+	return concatenate(parsed.getRoot()).length() > 0;
+}
+
+/**
+ * A second parse of the text, like the next answer of a polled service
+ * that has not changed.
+ */
+static Document sLatest;
+
+static bool diffUnchanged(const String& json, const Document& parsed) {
+	static Patch patch;
+	patch.diff(parsed.getRoot(), sLatest.getRoot());
+	return patch.getOperationCount() == 0;
+}
+
+/**
+ * The document as a shared version, and a patch that adds one value
+ * to its root.
+ */
+static SharedDocument sShared;
+static Patch sSharedPatch;
+static StringValue sAdded("added", 5);
+
+static int getChildCount(const Value* value) {
+	return value->getType() == Value::MAP ? value->getNumEntries()
+			: value->getNumChildValues();
+}
+
+static bool updateShared(const String& json, const Document& parsed) {
+	SharedDocument version;
+	bool applied = sShared.apply(sSharedPatch, version);
+	if (!sChecking)
+		return applied;
+
+	// The version the update was made from is left as it was.
+	const Value* root = sShared.getRoot();
+	return applied && sameTree(root, parsed.getRoot())
+			&& getChildCount(version.getRoot()) == getChildCount(root) + 1;
+}
+
+/**
+ * A batch benchmark parses each of the texts once per call.
+ * \return false on failure.
+ */
+typedef bool (*BatchFunction)(const unsigned char* const* texts,
+		const size_t* lengths, int count);
+
+static bool newParserEach(const unsigned char* const* texts,
+		const size_t* lengths, int count) {
+	static Document document;
+	for (int i = 0; i < count; i++)
+		if (!document.parse(texts[i], lengths[i]))
+			return false;
+	return true;
+}
+
+static bool reusedParser(const unsigned char* const* texts,
+		const size_t* lengths, int count) {
+	static Document document;
+	static Parser parser(document);
+	for (int i = 0; i < count; i++)
+		if (!parser.parse(texts[i], lengths[i]))
+			return false;
+	return true;
+}
+
+template<int THREADS>
+static bool batchParse(const unsigned char* const* texts,
+		const size_t* lengths, int count) {
+	static BatchParser batch;
+	static ThreadRunner runner;
+	batch.setTaskRunner(&runner, THREADS);
+	return batch.parse(texts, lengths, count) == count;
+}
+
+struct Benchmark {
+	const char* name;
+	BenchmarkFunction function;
+
+	/**
+	 * Print the speedup over "tree, document".
+	 */
+	bool showSpeedup;
+
+	/**
+	 * NULL if the benchmark applies to every document.
+	 */
+	Precondition precondition;
+
+	/**
+	 * Print calls per second instead of MB/s, for work that does not
+	 * grow with the document.
+	 */
+	bool perCall;
+};
+
+static const Benchmark sBenchmarks[] = {
+	{ "validate", validateOnly, false, NULL, false },
+	{ "tree, heap", heapTree, false, NULL, false },
+	{ "tree, document", documentTree, false, NULL, false },
+	{ "tree and text, document", documentTreeAndText, false, NULL, false },
+	{ "tree, 1 thread", parallelTree<1>, true, NULL, false },
+	{ "tree, 2 threads", parallelTree<2>, true, NULL, false },
+	{ "tree, 4 threads", parallelTree<4>, true, NULL, false },
+	{ "tree, 8 threads", parallelTree<8>, true, NULL, false },
+	{ "tree, people[*].name only", projectedTree, false, NULL, false },
+	{ "stream people records", streamedPeople, false, NULL, false },
+	{ "bind people to structs", bindPeople, false, hasPeople, false },
+	{ "tree, then extract people", extractPeople, false, hasPeople, false },
+	{ "serialize, compact", serializeCompact, false, NULL, false },
+	{ "serialize, pretty", serializePretty, false, NULL, false },
+	{ "toString, concatenated", concatenatedToString, false, NULL, false },
+	{ "toString", rootToString, false, NULL, false },
+	{ "diff, unchanged", diffUnchanged, false, NULL, false },
+	{ "update shared version", updateShared, false, hasContainerRoot, true },
+	{ "write snapshot", writeSnapshotOnly, false, NULL, false },
+	{ "load snapshot", loadSnapshotOnly, false, NULL, false },
+	{ "path people[*].name", pathQuery, false, hasPeople, false },
+};
+
+struct BatchBenchmark {
+	const char* name;
+	BatchFunction function;
+};
+
+static const BatchBenchmark sBatchBenchmarks[] = {
+	{ "new parser per document", newParserEach },
+	{ "reused parser", reusedParser },
+	{ "batch, 1 thread", batchParse<1> },
+	{ "batch, 2 threads", batchParse<2> },
+	{ "batch, 4 threads", batchParse<4> },
+	{ "batch, 8 threads", batchParse<8> },
+};
+
+/**
+ * \return The time of one run in milliseconds, or 0 if it failed or
+ * does not apply.
+ */
+static double run(const Benchmark& benchmark, const String& json,
+		const Document& parsed, double serialTime) {
+	if (benchmark.precondition && !benchmark.precondition(parsed)) {
+		printf("%-28s %8s\n", benchmark.name, "n/a");
+		return 0;
+	}
+
+	sChecking = true;
+	bool checked = benchmark.function(json, parsed);
+	sChecking = false;
+	if (!checked) {
+		printf("%-28s failed\n", benchmark.name);
+		return 0;
+	}
+
+	int count = 0;
+	int start = maGetMilliSecondCount();
+	int time;
+	do {
+		if (!benchmark.function(json, parsed)) {
+			printf("%-28s failed\n", benchmark.name);
+			return 0;
+		}
+		count++;
+		time = maGetMilliSecondCount() - start;
+	} while (time < MIN_TIME);
+
+	double megabytes = (double) json.length() * count / (1024 * 1024);
+	double runTime = (double) time / count;
+	if (benchmark.perCall)
+		printf("%-28s %8.0f /s   %10.3f us/run", benchmark.name,
+				count * 1000.0 / time, runTime * 1000);
+	else
+		printf("%-28s %8.1f MB/s %10.3f ms/run", benchmark.name,
+				megabytes * 1000 / time, runTime);
+	if (benchmark.showSpeedup && serialTime > 0)
+		printf(" %6.2fx", serialTime / runTime);
+	printf("\n");
+	return runTime;
+}
+
+/**
+ * Read every value of a tree, as a consumer of the tree would.
+ * \param sum Receives the numbers and the lengths of strings and keys,
+ * so that the reads are not optimized away.
+ * \return The number of values.
+ */
+static int traverse(const Value* value, double& sum) {
+	int nodes = 1;
+	switch (value->getType()) {
+		case Value::BOOLEAN:
+			sum += value->toBoolean();
+			break;
+		case Value::NUMBER:
+			sum += value->toDouble();
+			break;
+		case Value::STRING:
+			sum += value->getStringLength();
+			break;
+		case Value::ARRAY:
+			for (int i = 0; i < value->getNumChildValues(); i++)
+				nodes += traverse(value->getValueByIndex(i), sum);
+			break;
+		case Value::MAP:
+			for (int i = 0; i < value->getNumEntries(); i++) {
+				int keyLength;
+				value->getKeyByIndex(i, &keyLength);
+				sum += keyLength;
+				nodes += traverse(value->getEntryValue(i), sum);
+			}
+			break;
+		default:
+			break;
+	}
+	return nodes;
+}
+
+/**
+ * The measurements of one phase of the life of a tree, summed over the
+ * runs.
+ */
+struct Phase {
+	const char* name;
+	double time;
+	long long allocations;
+	long long allocatedBytes;
+	int peakMemory;
+
+	/**
+	 * How much the resident set grew during the phase, at most.
+	 */
+	int memoryGrowth;
+
+	Phase(const char* name) :
+		name(name), time(0), allocations(0), allocatedBytes(0),
+		peakMemory(0), memoryGrowth(0) {
+	}
+
+	void start() {
+		resetPeakMemory();
+		mMemory = getMemory();
+		mAllocations = getAllocationCount();
+		mAllocatedBytes = getAllocatedBytes();
+		mStart = getTime();
+	}
+
+	void stop() {
+		time += getTime() - mStart;
+		allocations += getAllocationCount() - mAllocations;
+		allocatedBytes += getAllocatedBytes() - mAllocatedBytes;
+		int peak = getPeakMemory();
+		if (peak > peakMemory)
+			peakMemory = peak;
+		if (peak - mMemory > memoryGrowth)
+			memoryGrowth = peak - mMemory;
+	}
+
+	void print(int bytes, int nodes, int runs) const {
+		double seconds = time / 1000;
+		printf("%-28s %8.1f MB/s %8.2f M nodes/s %9.1f allocs %8.1f kB "
+				"%7d kB RSS %+7d kB\n", name,
+				(double) bytes * runs / (1024 * 1024) / seconds,
+				(double) nodes * runs / 1000000 / seconds,
+				(double) allocations / runs,
+				(double) allocatedBytes / runs / 1024, peakMemory,
+				memoryGrowth);
+	}
+
+private:
+	double mStart;
+	int mMemory;
+	long long mAllocations;
+	long long mAllocatedBytes;
+};
+
+/**
+ * Measure parsing, traversing and deleting a tree separately, for a
+ * tree in a new Document and for a tree of heap values. Allocations are
+ * per run. The peak resident set size, and how much it grew in the
+ * phase, are the highest of any run. Memory that the C library keeps
+ * after a free is part of the resident set, so the growth is mostly
+ * seen in the first run.
+ */
+static bool runPhases(const String& json, int nodes) {
+	const unsigned char* text = (const unsigned char*) json.c_str();
+	Phase phases[] = {
+		Phase("document, parse"), Phase("document, traverse"),
+		Phase("document, delete"), Phase("heap, parse"),
+		Phase("heap, traverse"), Phase("heap, delete")
+	};
+	const int PHASES = sizeof(phases) / sizeof(phases[0]);
+
+	double sum = 0;
+	int runs = 0;
+	double start = getTime();
+	do {
+		phases[0].start();
+		Document* document = new Document();
+		bool parsed = document->parse(text, json.length());
+		phases[0].stop();
+		phases[1].start();
+		int documentNodes = traverse(document->getRoot(), sum);
+		phases[1].stop();
+		phases[2].start();
+		delete document;
+		phases[2].stop();
+
+		phases[3].start();
+		Value* root = parse(text, json.length());
+		phases[3].stop();
+		phases[4].start();
+		int heapNodes = root ? traverse(root, sum) : 0;
+		phases[4].stop();
+		phases[5].start();
+		deleteValue(root);
+		phases[5].stop();
+
+		if (!parsed || !root || documentNodes != nodes || heapNodes != nodes) {
+			printf("phases failed\n");
+			return false;
+		}
+		runs++;
+	} while (getTime() - start < MIN_TIME);
+
+	for (int i = 0; i < PHASES; i++)
+		phases[i].print(json.length(), nodes, runs);
+	return sum != 0;
+}
+
+static bool runAll(const char* name, const String& json) {
+	NodeCounts counts;
+	if (!validate((const unsigned char*) json.c_str(), json.length(), &counts)) {
+		printf("%s: invalid Json text\n", name);
+		return false;
+	}
+	printf("\n%s: %d bytes, %d values\n", name, json.length(),
+			counts.getTotal());
+
+	Document parsed;
+	parsed.parse((const unsigned char*) json.c_str(), json.length());
+	sLatest.parse((const unsigned char*) json.c_str(), json.length());
+	sShared.parse((const unsigned char*) json.c_str(), json.length());
+	{
+		Patch::Operation add;
+		add.type = Patch::Operation::ADD;
+		add.path = sShared.getRoot()->getType() == Value::ARRAY ? "/-"
+				: "/added";
+		add.value = &sAdded;
+		sSharedPatch.clear();
+		sSharedPatch.addOperation(add);
+	}
+
+#ifdef YAJLDOM_STATS
+	{
+		Document document;
+		Parser parser(document);
+		parser.parse((const unsigned char*) json.c_str(), json.length());
+		const ParseStats& stats = parser.getStats();
+		printf("tokens: %d null, %d boolean, %d number, %d string, "
+				"%d key, %d map, %d array\n", stats.nullTokens,
+				stats.booleanTokens, stats.numberTokens, stats.stringTokens,
+				stats.keyTokens, stats.mapTokens, stats.arrayTokens);
+		printf("%d nodes, %d escaped strings, depth %d, %d allocations "
+				"of %d bytes\n", stats.nodes.getTotal(), stats.escapedStrings,
+				stats.maxDepth, stats.allocations, stats.bytesAllocated);
+		printf("lex %d ms, build %d ms, teardown %d ms\n", stats.lexTime,
+				stats.buildTime, stats.teardownTime);
+	}
+#endif
+
+	bool success = runPhases(json, counts.getTotal());
+
+	double serialTime = 0;
+	for (size_t i = 0; i < sizeof(sBenchmarks) / sizeof(sBenchmarks[0]); i++) {
+		double time = run(sBenchmarks[i], json, parsed, serialTime);
+		if (sBenchmarks[i].function == documentTree)
+			serialTime = time;
+	}
+	return success;
+}
+
+/**
+ * Measure the throughput of parsing many small documents, in
+ * documents per second.
+ */
+static bool runBatches(const char* name, const Vector<String>& texts) {
+	Vector<const unsigned char*> pointers;
+	Vector<size_t> lengths;
+	int bytes = 0;
+	for (int i = 0; i < texts.size(); i++) {
+		pointers.add((const unsigned char*) texts[i].c_str());
+		lengths.add(texts[i].length());
+		bytes += texts[i].length();
+	}
+	printf("\n%s: %d documents, %d bytes\n", name, texts.size(), bytes);
+
+	bool success = true;
+	for (size_t i = 0; i < sizeof(sBatchBenchmarks) / sizeof(sBatchBenchmarks[0]);
+			i++) {
+		const BatchBenchmark& benchmark = sBatchBenchmarks[i];
+		int count = 0;
+		int start = maGetMilliSecondCount();
+		int time = 0;
+		do {
+			if (!benchmark.function(pointers.pointer(), lengths.pointer(),
+					texts.size())) {
+				printf("%-28s failed\n", benchmark.name);
+				success = false;
+				break;
+			}
+			count++;
+			time = maGetMilliSecondCount() - start;
+		} while (time < MIN_TIME);
+
+		if (count > 0 && time > 0) {
+			double documents = (double) texts.size() * count;
+			printf("%-28s %10.0f docs/s %7.3f us/doc\n", benchmark.name,
+					documents * 1000 / time, time * 1000 / documents);
+		}
+	}
+	return success;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1) {
+		String json;
+		if (!readFile(argv[1], json)) {
+			printf("Could not read %s\n", argv[1]);
+			return 1;
+		}
+		return runAll(argv[1], json) ? 0 : 1;
+	}
+
+	String people = generatePeople(10000);
+	bool success = runAll("people", people);
+	success = runAll("people, minified", reformat(people, COMPACT))
+			&& success;
+	success = runAll("people, pretty", reformat(people, PRETTY)) && success;
+	success = runAll("records", generateRecords(10000)) && success;
+	success = runAll("numbers", generateNumbers(20000)) && success;
+	success = runAll("escaped strings", generateStrings(5000)) && success;
+	success = runAll("nested maps", generateNested(1000, 100)) && success;
+
+	Vector<String> small;
+	generateSmallDocuments(1000, small);
+	success = runBatches("small documents", small) && success;
+	return success ? 0 : 1;
+}
@@ -0,0 +1,839 @@
+/* Copyright (C) 2011 Mobile Sorcery AB
+
+This program is free software; you can redistribute it and/or modify it under
+the terms of the GNU General Public License, version 2, as published by
+the Free Software Foundation.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; see the file COPYING.  If not, write to the Free
+Software Foundation, 59 Temple Place - Suite 330, Boston, MA
+02111-1307, USA.
+*/
+
+/*
+ * Tests.cpp
+ *
+ *  Checks the behavior of YAJLDom on the host machine. Prints the
+ *  checks that fail, and exits with 1 if any did.
+ */
+
+#include <ma.h>
+#include <mastring.h>
+#include <stdio.h>
+#include <MAUtil/String.h>
+#include <YAJLDom/YAJLDom.h>
+#include <YAJLDom/Path.h>
+#include <YAJLDom/Binding.h>
+#include <YAJLDom/Snapshot.h>
+#include <YAJLDom/ParallelParser.h>
+#include <YAJLDom/Patch.h>
+#include <YAJLDom/SharedDocument.h>
+
+using namespace MAUtil;
+using namespace MAUtil::YAJLDom;
+
+static int sChecks = 0;
+static int sFailures = 0;
+
+#define CHECK(condition) check((condition), #condition, __LINE__)
+
+static void check(bool passed, const char* condition, int line) {
+	sChecks++;
+	if (!passed) {
+		sFailures++;
+		printf("Tests.cpp:%d: %s failed\n", line, condition);
+	}
+}
+
+/**
+ * Every kind of value: escapes, Unicode, integers, doubles and
+ * exponents, maps with the same keys, and a map with more than eight
+ * keys, which gets a hash index.
+ */
+static const char* const SAMPLE =
+	"{\"people\": [{\"name\": \"Ann \\\"A\\\"\", \"age\": 31, \"tags\": "
+	"[\"a\", \"b\"]}, {\"name\": \"Bo\\u00e9\", \"age\": 42, \"tags\": []}, "
+	"{\"name\": \"Cy\\n\", \"age\": -7, \"tags\": [null]}], "
+	"\"numbers\": [0, -1, 2.5, 1e10, -3.25E-3, 9007199254740993], "
+	"\"flags\": {\"on\": true, \"off\": false, \"none\": null}, "
+	"\"wide\": {\"k1\": 1, \"k2\": 2, \"k3\": 3, \"k4\": 4, \"k5\": 5, "
+	"\"k6\": 6, \"k7\": 7, \"k8\": 8, \"k9\": 9, \"k10\": 10}, "
+	"\"empty\": {}, \"a/b~c\": \"escaped key\"}";
+
+static String toText(const Value* value) {
+	BufferWriter writer;
+	serialize(value, writer);
+	return String(writer.getData(), writer.getLength());
+}
+
+static bool parseText(Document& document, const char* text) {
+	return document.parse((const unsigned char*) text, strlen(text));
+}
+
+/**
+ * \return true if the values are equal, maps in any order of their
+ * keys, numbers by value.
+ */
+static bool equalTrees(const Value* a, const Value* b) {
+	if (!a || !b)
+		return a == b;
+	if (a->getType() != b->getType())
+		return false;
+	switch (a->getType()) {
+		case Value::BOOLEAN:
+			return a->toBoolean() == b->toBoolean();
+		case Value::NUMBER:
+			return a->toDouble() == b->toDouble();
+		case Value::STRING:
+			return a->getStringLength() == b->getStringLength()
+					&& memcmp(a->getString(), b->getString(),
+							a->getStringLength()) == 0;
+		case Value::MAP:
+			if (a->getNumEntries() != b->getNumEntries())
+				return false;
+			for (int i = 0; i < a->getNumEntries(); i++) {
+				int keyLength;
+				const char* key = a->getKeyByIndex(i, &keyLength);
+				const Value* value = NULL;
+				for (int k = 0; k < b->getNumEntries() && !value; k++) {
+					int otherLength;
+					const char* other = b->getKeyByIndex(k, &otherLength);
+					if (otherLength == keyLength
+							&& memcmp(key, other, keyLength) == 0)
+						value = b->getEntryValue(k);
+				}
+				if (!equalTrees(a->getEntryValue(i), value))
+					return false;
+			}
+			return true;
+		case Value::ARRAY:
+			if (a->getNumChildValues() != b->getNumChildValues())
+				return false;
+			for (int i = 0; i < a->getNumChildValues(); i++)
+				if (!equalTrees(a->getValueByIndex(i), b->getValueByIndex(i)))
+					return false;
+			return true;
+		default:
+			return true;
+	}
+}
+
+/**
+ * An array of count people, about 100 bytes each.
+ */
+static String generatePeople(int count) {
+	String json = "[";
+	char buf[256];
+	for (int i = 0; i < count; i++) {
+		sprintf(buf, "%s{\"name\": \"Person %d\", \"age\": %d, "
+				"\"key %d\": [%d.5, \"caf\\u00e9\", {\"deep\": null}]}",
+				i ? ", " : "", i, i % 90, i % 7, i);
+		json += buf;
+	}
+	json += "]";
+	return json;
+}
+
+/**
+ * A document holds the same tree as heap values, and keeps its memory
+ * for the next parse.
+ */
+static void testDocument() {
+	Value* heap = parse((const unsigned char*) SAMPLE, strlen(SAMPLE));
+	Document document;
+	CHECK(parseText(document, SAMPLE));
+	CHECK(equalTrees(document.getRoot(), heap));
+
+	// Parsing again reuses the blocks of the arena.
+	int reserved = document.getArena().getBytesReserved();
+	for (int i = 0; i < 10; i++)
+		CHECK(parseText(document, SAMPLE));
+	CHECK(document.getArena().getBytesReserved() == reserved);
+	CHECK(equalTrees(document.getRoot(), heap));
+	document.clear();
+	CHECK(document.getRoot() == NULL);
+	CHECK(document.getArena().getBytesUsed() == 0);
+	CHECK(document.getArena().getBytesReserved() == reserved);
+
+	// A failed parse leaves the document empty.
+	CHECK(!parseText(document, "{\"a\": [1,"));
+	CHECK(document.getRoot() == NULL);
+
+	// Values created by the document, and copies into it.
+	MapValue* map = document.createMap();
+	ArrayValue* array = document.createArray();
+	array->addValue(document.createNumber(1));
+	array->addValue(document.createString("two", 3));
+	array->addValue(document.createNull());
+	map->setValueForKey("list", 4, array);
+	map->setValueForKey("flag", 4, document.createBoolean(true));
+	map->setValueForKey("copy", 4, document.copyValue(heap));
+	document.setRoot(map);
+	deleteValue(heap);
+	CHECK(toText(map->getValueForKey("list")) == "[1,\"two\",null]");
+	CHECK(map->getValueForKey("flag")->toBoolean());
+	CHECK(parseText(document, SAMPLE));
+	Document copy;
+	copy.setRoot(copy.copyValue(document.getRoot()));
+	CHECK(toText(copy.getRoot()) == toText(document.getRoot()));
+
+	// An arena hands out aligned memory and keeps its blocks on reset.
+	Arena arena(64);
+	for (int round = 0; round < 2; round++) {
+		for (int i = 1; i < 200; i++) {
+			char* p = (char*) arena.allocate(i);
+			CHECK(((size_t) p & 7) == 0);
+			memset(p, i, i);
+		}
+		if (round == 0)
+			reserved = arena.getBytesReserved();
+		CHECK(arena.getBytesReserved() == reserved);
+		arena.reset();
+		CHECK(arena.getBytesUsed() == 0);
+	}
+}
+
+/**
+ * Feeding the text in chunks of any size builds the same tree as
+ * parsing it at once.
+ */
+static void testFeed() {
+	String people = generatePeople(2000);
+	const char* texts[] = { SAMPLE, people.c_str() };
+	for (int t = 0; t < 2; t++) {
+		const unsigned char* text = (const unsigned char*) texts[t];
+		int length = strlen(texts[t]);
+		Document whole;
+		CHECK(whole.parse(text, length));
+		String expected = toText(whole.getRoot());
+
+		Document document;
+		Parser parser(document);
+		bool fed = true;
+		for (int i = 0; i < length; i++)
+			fed = parser.feed(text + i, 1) && fed;
+		CHECK(fed);
+		CHECK(toText(parser.finish()) == expected);
+
+		Parser heapParser;
+		for (int i = 0; i < length; i += 7)
+			heapParser.feed(text + i, length - i < 7 ? length - i : 7);
+		// Heap trees keep numbers as values rather than as their text.
+		Value* root = heapParser.finish();
+		CHECK(equalTrees(root, whole.getRoot()));
+		deleteValue(root);
+	}
+
+	// Truncated and invalid text.
+	Parser parser;
+	CHECK(parser.feed((const unsigned char*) "{\"a\": [1, 2", 11));
+	CHECK(parser.finish() == NULL);
+	CHECK(!parser.feed((const unsigned char*) "{\"a\" 1}", 7));
+	CHECK(parser.finish() == NULL);
+
+	// The parser rewinds the arena of its keys when a map is closed,
+	// which also gives back blocks of large keys.
+	Arena arena(64);
+	arena.allocate(16);
+	Arena::Mark mark = arena.getMark();
+	int reserved = 0;
+	for (int i = 0; i < 10; i++) {
+		arena.allocate(16);
+		arena.allocate(100000);
+		arena.allocate(16);
+		arena.rewind(mark);
+		if (i == 0)
+			reserved = arena.getBytesReserved();
+		CHECK(arena.getBytesUsed() == mark.bytesUsed);
+		CHECK(arena.getBytesReserved() == reserved);
+	}
+}
+
+/**
+ * \return count maps nested in each other, with a number inside.
+ */
+static String nest(int count) {
+	String json;
+	for (int i = 0; i < count; i++)
+		json += "{\"a\":";
+	json += "1";
+	for (int i = 0; i < count; i++)
+		json += "}";
+	return json;
+}
+
+/**
+ * A validating parse only counts the values, and the text of a tree
+ * and text parse is the document, or missing if yajl_gen could not
+ * write it.
+ */
+static void testModes() {
+	const unsigned char* text = (const unsigned char*) SAMPLE;
+	int length = strlen(SAMPLE);
+	Document expected;
+	CHECK(expected.parse(text, length));
+
+	NodeCounts counts;
+	CHECK(validate(text, length, &counts));
+	CHECK(counts.maps == 7 && counts.arrays == 5 && counts.strings == 6);
+	CHECK(counts.getTotal() == 41);
+	CHECK(!validate((const unsigned char*) "[1, 2", 5));
+
+	Document document;
+	Parser parser(document);
+	parser.setMode(Parser::VALIDATE);
+	CHECK(parser.parse(text, length) == NULL);
+	CHECK(parser.isValid());
+	CHECK(parser.getNodeCounts().getTotal() == counts.getTotal());
+	const unsigned char* written;
+	unsigned int writtenLength;
+	CHECK(!parser.getText(&written, &writtenLength));
+
+	parser.setMode(Parser::BUILD_TREE_AND_TEXT);
+	CHECK(equalTrees(parser.parse(text, length), expected.getRoot()));
+	CHECK(parser.getText(&written, &writtenLength));
+	Document reparsed;
+	CHECK(reparsed.parse(written, writtenLength));
+	CHECK(equalTrees(reparsed.getRoot(), expected.getRoot()));
+
+	// yajl_gen stops at 128 levels, the tree does not.
+	String deep = nest(200);
+	Value* root = parser.parse((const unsigned char*) deep.c_str(),
+			deep.length());
+	CHECK(root != NULL);
+	CHECK(parser.isValid());
+	CHECK(!parser.getText(&written, &writtenLength));
+	int depth = 0;
+	for (; root && root->getType() == Value::MAP; depth++)
+		root = root->getValueForKey("a");
+	CHECK(depth == 200 && root && root->toInt() == 1);
+
+	// The generator is used again for the next document.
+	String shallow = nest(100);
+	CHECK(parser.parse((const unsigned char*) shallow.c_str(),
+			shallow.length()) != NULL);
+	CHECK(parser.getText(&written, &writtenLength));
+	CHECK(String((const char*) written, writtenLength) == shallow);
+}
+
+/**
+ * The typed accessors read values without converting or copying them,
+ * and report values of other types.
+ */
+static void testAccessors() {
+	const char* text = "{\"int\": 42, \"big\": 9007199254740993, "
+			"\"double\": 2.5, \"bool\": true, \"string\": \"text\", "
+			"\"digits\": \"12\", \"null\": null}";
+	Document document;
+	CHECK(document.parse((const unsigned char*) text, strlen(text),
+			Document::ZERO_COPY));
+	const Value* root = document.getRoot();
+
+	int i = 0;
+	long long ll = 0;
+	double d = 0;
+	bool b = false;
+	CHECK(root->getValueForKey("int")->tryGetInt(i) && i == 42);
+	CHECK(!root->getValueForKey("big")->tryGetInt(i));
+	CHECK(root->getValueForKey("big")->tryGetInt64(ll)
+			&& ll == 9007199254740993LL);
+	CHECK(!root->getValueForKey("double")->tryGetInt64(ll));
+	CHECK(root->getValueForKey("double")->tryGetDouble(d) && d == 2.5);
+	CHECK(root->getValueForKey("bool")->tryGetBool(b) && b);
+	CHECK(!root->getValueForKey("int")->tryGetBool(b));
+	CHECK(!root->getValueForKey("string")->tryGetInt(i));
+
+	const Value* string = root->getValueForKey("string");
+	CHECK(string->getStringLength() == 4
+			&& memcmp(string->getString(), "text", 4) == 0);
+	CHECK(root->getValueForKey("int")->getStringLength() == 0);
+	CHECK(root->getValueForKey("digits")->toInt() == 12);
+	CHECK(root->getValueForKey("stringy", 6) == string);
+	CHECK(root->getValueForKey("missing")->getType() == Value::NUL);
+	CHECK(root->getValueForKey("null")->getType() == Value::NUL);
+}
+
+static String parseProjected(const char* text, const char* path1,
+		const char* path2) {
+	Projection projection;
+	CHECK(projection.add(path1));
+	if (path2)
+		CHECK(projection.add(path2));
+	Document document;
+	Parser parser(document);
+	parser.setProjection(&projection);
+	return toText(parser.parse((const unsigned char*) text, strlen(text)));
+}
+
+/**
+ * A projected parse only builds the values on its paths, and the maps
+ * and arrays on the way to them.
+ */
+static void testProjection() {
+	CHECK(parseProjected(SAMPLE, "people[*].name", NULL)
+			== "{\"people\":[{\"name\":\"Ann \\\"A\\\"\"},"
+			"{\"name\":\"Bo\xc3\xa9\"},{\"name\":\"Cy\\n\"}]}");
+	CHECK(parseProjected(SAMPLE, "numbers[2]", "flags.on")
+			== "{\"numbers\":[null,null,2.5],\"flags\":{\"on\":true}}");
+	CHECK(parseProjected(SAMPLE, "/people/1/tags", "wide")
+			== "{\"people\":[null,{\"tags\":[]}],\"wide\":{\"k1\":1,"
+			"\"k2\":2,\"k3\":3,\"k4\":4,\"k5\":5,\"k6\":6,\"k7\":7,\"k8\":8,"
+			"\"k9\":9,\"k10\":10}}");
+	CHECK(parseProjected(SAMPLE, "missing", NULL) == "{}");
+}
+
+struct Address {
+	String city;
+	Vector<int> codes;
+};
+
+/**
+ * Not a POD, the members are found through their member pointers.
+ */
+struct Contact {
+	Contact() : age(-1), score(0), active(false), id(0) {}
+
+	String name;
+	int age;
+	double score;
+	bool active;
+	long long id;
+	Vector<String> tags;
+	Address address;
+	Vector<Address> history;
+};
+
+static const FieldBinding sAddressFields[] = {
+	bindField("city", &Address::city),
+	bindField("codes", &Address::codes)
+};
+static const StructBinding<Address> sAddressBinding(sAddressFields);
+
+static const FieldBinding sContactFields[] = {
+	bindField("name", &Contact::name),
+	bindField("age", &Contact::age),
+	bindField("score", &Contact::score),
+	bindField("active", &Contact::active),
+	bindField("id", &Contact::id),
+	bindField("tags", &Contact::tags),
+	bindField("address", &Contact::address, sAddressBinding),
+	bindField("history", &Contact::history, sAddressBinding)
+};
+static const StructBinding<Contact> sContactBinding(sContactFields);
+
+static bool bind(BindingParser& parser, const char* text, Contact& contact) {
+	return parser.parse(sContactBinding, (const unsigned char*) text,
+			strlen(text), contact);
+}
+
+/**
+ * Bindings set the members of structs from the keys of maps, and skip
+ * the rest.
+ */
+static void testBinding() {
+	BindingParser parser;
+	Contact contact;
+	CHECK(bind(parser, "{\"name\": \"Ann \\u00e9\", \"age\": 31, "
+			"\"score\": 2.5, \"active\": true, \"id\": 9007199254740993, "
+			"\"tags\": [\"a\", 1, \"b\"], \"unknown\": {\"name\": \"x\"}, "
+			"\"address\": {\"city\": \"Lund\", \"codes\": [1, 2.0, 3]}, "
+			"\"history\": [{\"city\": \"Malmo\"}, 7, {\"codes\": [4]}]}",
+			contact));
+	CHECK(contact.name == "Ann \xc3\xa9");
+	CHECK(contact.age == 31 && contact.score == 2.5 && contact.active);
+	CHECK(contact.id == 9007199254740993LL);
+	CHECK(contact.tags.size() == 2 && contact.tags[1] == "b");
+	CHECK(contact.address.city == "Lund");
+	CHECK(contact.address.codes.size() == 3
+			&& contact.address.codes[1] == 2);
+	CHECK(contact.history.size() == 2
+			&& contact.history[0].city == "Malmo"
+			&& contact.history[1].codes.size() == 1);
+
+	// Nulls and values of the wrong type leave the members unchanged.
+	Contact other;
+	CHECK(bind(parser, "{\"name\": null, \"age\": \"31\", "
+			"\"address\": [1], \"tags\": {}}", other));
+	CHECK(other.name == "" && other.age == -1 && other.tags.size() == 0);
+
+	// The parser is used again after a failed parse.
+	CHECK(!bind(parser, "{\"name\": ", other));
+	CHECK(!bind(parser, "[{\"name\": \"x\"}]", other));
+	CHECK(bind(parser, "{\"name\": \"Bo\"}", other) && other.name == "Bo");
+
+	Vector<Contact> contacts;
+	const char* array = "[{\"name\": \"A\"}, null, {\"age\": 7}]";
+	CHECK(parser.parse(sContactBinding, (const unsigned char*) array,
+			strlen(array), contacts));
+	CHECK(contacts.size() == 2 && contacts[0].name == "A"
+			&& contacts[1].age == 7);
+	CHECK(sContactBinding.parse((const unsigned char*) array, strlen(array),
+			contacts) && contacts.size() == 4);
+}
+
+/**
+ * The records of a streamed array and what the callback compares them
+ * with.
+ */
+struct Records {
+	const Value* expected;
+	int count;
+	int stopAt;
+	bool equal;
+};
+
+static bool checkRecord(Value* record, int index, void* userData) {
+	Records* records = (Records*) userData;
+	if (index != records->count
+			|| toText(record) != toText(records->expected->getValueByIndex(
+					index)))
+		records->equal = false;
+	records->count++;
+	return records->count != records->stopAt;
+}
+
+/**
+ * Streamed records are the elements of the array, which is left empty
+ * in the tree.
+ */
+static void testRecords() {
+	Document whole;
+	CHECK(parseText(whole, SAMPLE));
+	Records records = { whole.getRoot()->getValueForKey("people"), 0, -1,
+			true };
+	Path path("people");
+	Document document;
+	Parser parser(document);
+	parser.streamRecords(&path, checkRecord, &records);
+	const Value* root = parser.parse((const unsigned char*) SAMPLE,
+			strlen(SAMPLE));
+	CHECK(records.equal && records.count == 3);
+	CHECK(root && root->getValueForKey("people")->getNumChildValues() == 0);
+	CHECK(toText(root->getValueForKey("wide"))
+			== toText(whole.getRoot()->getValueForKey("wide")));
+
+	// A top level array fed a byte at a time, stopped by the callback.
+	String people = generatePeople(500);
+	Document peopleDocument;
+	CHECK(parseText(peopleDocument, people.c_str()));
+	Path rootPath("");
+	for (int stopAt = -1; stopAt <= 100; stopAt += 101) {
+		Records peopleRecords = { peopleDocument.getRoot(), 0, stopAt, true };
+		parser.streamRecords(&rootPath, checkRecord, &peopleRecords);
+		bool fed = true;
+		for (int i = 0; i < people.length(); i++)
+			fed = parser.feed((const unsigned char*) people.c_str() + i, 1)
+					&& fed;
+		Value* streamed = parser.finish();
+		CHECK(peopleRecords.equal);
+		if (stopAt < 0) {
+			CHECK(fed && streamed && peopleRecords.count == 500);
+		} else {
+			CHECK(!fed && !streamed && peopleRecords.count == stopAt);
+		}
+	}
+}
+
+/**
+ * Loading a snapshot gives the tree it was written from.
+ */
+static void testSnapshots() {
+	Document document;
+	CHECK(parseText(document, SAMPLE));
+	String expected = toText(document.getRoot());
+
+	BufferWriter snapshot;
+	writeSnapshot(document.getRoot(), snapshot);
+	const unsigned char* data = (const unsigned char*) snapshot.getData();
+	Document loaded;
+	CHECK(loaded.loadSnapshot(data, snapshot.getLength()));
+	CHECK(toText(loaded.getRoot()) == expected);
+	Document zeroCopy;
+	CHECK(zeroCopy.loadSnapshot(data, snapshot.getLength(),
+			Document::ZERO_COPY));
+	CHECK(toText(zeroCopy.getRoot()) == expected);
+
+	// Keys are found in maps with a hash index.
+	CHECK(loaded.getRoot()->getValueForKey("wide")->getValueForKey("k9")
+			->toInt() == 9);
+
+	// A snapshot of a heap tree, and a damaged snapshot.
+	Value* heap = parse((const unsigned char*) SAMPLE, strlen(SAMPLE));
+	BufferWriter heapSnapshot;
+	writeSnapshot(heap, heapSnapshot);
+	deleteValue(heap);
+	CHECK(loaded.loadSnapshot((const unsigned char*) heapSnapshot.getData(),
+			heapSnapshot.getLength()));
+	CHECK(equalTrees(loaded.getRoot(), document.getRoot()));
+	CHECK(!loaded.loadSnapshot(data, snapshot.getLength() / 2));
+}
+
+/**
+ * A parallel parse builds the same tree as a serial one, and neither
+ * interns keys.
+ */
+static void testParallelParser() {
+	String people = generatePeople(2000);
+	const char* texts[] = { people.c_str(), SAMPLE };
+	for (int t = 0; t < 2; t++) {
+		Document serial;
+		CHECK(parseText(serial, texts[t]));
+		String expected = toText(serial.getRoot());
+		for (int parts = 1; parts <= 8; parts *= 2) {
+			KeyTable keys;
+			Document document;
+			document.setKeyTable(&keys);
+			ParallelParser parser(document);
+			parser.setTaskRunner(NULL, parts);
+			CHECK(toText(parser.parse((const unsigned char*) texts[t],
+					strlen(texts[t]))) == expected);
+			CHECK(keys.size() == 0);
+			CHECK(document.getKeyTable() == &keys);
+		}
+	}
+
+	// A comma too many in one of the parts.
+	String invalid = people.substr(0, people.length() / 2);
+	invalid += ",,";
+	invalid += people.substr(people.length() / 2);
+	Document document;
+	ParallelParser parser(document);
+	parser.setTaskRunner(NULL, 4);
+	CHECK(parser.parse((const unsigned char*) invalid.c_str(),
+			invalid.length()) == NULL);
+}
+
+/**
+ * Random Json text for the patch tests, from a fixed seed.
+ */
+static unsigned int sSeed = 1;
+
+static int random(int n) {
+	sSeed = sSeed * 1103515245 + 12345;
+	return (sSeed >> 16) % n;
+}
+
+static void generate(String& json, int depth) {
+	static const char* const keys[] = {
+		"a", "b", "c/d", "e~f", "g", "h", "i", "j", "k", "l", "m", "n"
+	};
+	char buf[32];
+	switch (depth > 3 ? random(4) : random(6)) {
+		case 0:
+			json += random(2) ? "null" : "true";
+			break;
+		case 1:
+			sprintf(buf, "%d", random(4));
+			json += buf;
+			break;
+		case 2:
+			json += random(2) ? "\"x\"" : "1.0";
+			break;
+		case 3:
+			json += random(2) ? "\"y\"" : "2.5";
+			break;
+		case 4: {
+			json += "[";
+			int count = random(5);
+			for (int i = 0; i < count; i++) {
+				if (i)
+					json += ",";
+				generate(json, depth + 1);
+			}
+			json += "]";
+		}
+		break;
+		default: {
+			json += "{";
+			int count = random(12);
+			for (int i = 0; i < count; i++) {
+				if (i)
+					json += ",";
+				json += "\"";
+				json += keys[(i + depth) % 12];
+				json += "\":";
+				generate(json, depth + 1);
+			}
+			json += "}";
+		}
+		break;
+	}
+}
+
+/**
+ * \return true if applying the patch to a copy of from gives to.
+ */
+static bool patchGives(const Patch& patch, const Value* from,
+		const Value* to) {
+	Value* copy = from ? copyValue(from) : NULL;
+	bool applied = patch.apply(copy);
+	bool equal = equalTrees(copy, to);
+	deleteValue(copy);
+	return applied && equal;
+}
+
+/**
+ * Applying the diff of two trees to the first gives the second, and a
+ * patch written as text reads back the same.
+ */
+static void testPatch() {
+	for (int i = 0; i < 500; i++) {
+		String fromText, toText;
+		generate(fromText, 0);
+		generate(toText, 0);
+		Document from, to;
+		CHECK(parseText(from, fromText.c_str()));
+		CHECK(parseText(to, toText.c_str()));
+
+		Patch patch;
+		patch.diff(from.getRoot(), to.getRoot());
+		CHECK(patchGives(patch, from.getRoot(), to.getRoot()));
+		CHECK(patch.apply(from));
+		CHECK(equalTrees(from.getRoot(), to.getRoot()));
+
+		BufferWriter writer;
+		patch.write(writer);
+		Document patchDocument;
+		Patch reread;
+		CHECK(patchDocument.parse((const unsigned char*) writer.getData(),
+				writer.getLength()));
+		CHECK(reread.read(patchDocument.getRoot()));
+		CHECK(reread.getOperationCount() == patch.getOperationCount());
+	}
+
+	// Scalars that differ are always replaced.
+	Document a, b;
+	parseText(a, "[\"x\", 1, 2.5]");
+	parseText(b, "[\"y\", 1, 2.50001]");
+	Patch patch;
+	patch.diff(a.getRoot(), b.getRoot());
+	CHECK(patch.getOperationCount() == 2);
+
+	// Move, copy and test, from RFC 6902.
+	Document document, patchDocument;
+	parseText(document, "{\"foo\": {\"bar\": \"baz\", \"waldo\": \"fred\"}, "
+			"\"qux\": {\"corge\": \"grault\"}}");
+	parseText(patchDocument, "[{\"op\": \"move\", \"from\": \"/foo/waldo\", "
+			"\"path\": \"/qux/thud\"}, {\"op\": \"copy\", \"from\": \"/qux\", "
+			"\"path\": \"/copy\"}, {\"op\": \"test\", \"path\": "
+			"\"/copy/thud\", \"value\": \"fred\"}]");
+	CHECK(patch.read(patchDocument.getRoot()));
+	CHECK(patch.apply(document));
+	Document expected;
+	parseText(expected, "{\"foo\": {\"bar\": \"baz\"}, \"qux\": {\"corge\": "
+			"\"grault\", \"thud\": \"fred\"}, \"copy\": {\"corge\": "
+			"\"grault\", \"thud\": \"fred\"}}");
+	CHECK(equalTrees(document.getRoot(), expected.getRoot()));
+
+	parseText(patchDocument, "[{\"op\": \"test\", \"path\": \"/foo/bar\", "
+			"\"value\": \"other\"}]");
+	CHECK(patch.read(patchDocument.getRoot()));
+	CHECK(!patch.apply(document));
+	parseText(patchDocument, "[{\"op\": \"remove\", \"path\": \"/nothing\"}]");
+	CHECK(patch.read(patchDocument.getRoot()));
+	CHECK(!patch.apply(document));
+}
+
+/**
+ * Updating a shared document makes a new version and leaves the old
+ * ones as they were.
+ */
+static void testSharedDocument() {
+	SharedDocument original;
+	CHECK(original.parse((const unsigned char*) SAMPLE, strlen(SAMPLE)));
+	String originalText = toText(original.getRoot());
+
+	Document patchDocument;
+	Patch patch;
+	parseText(patchDocument, "[{\"op\": \"replace\", \"path\": "
+			"\"/people/1/age\", \"value\": 43}, {\"op\": \"add\", \"path\": "
+			"\"/people/-\", \"value\": {\"name\": \"Di\"}}, {\"op\": \"remove\", "
+			"\"path\": \"/wide/k3\"}, {\"op\": \"move\", \"from\": "
+			"\"/flags/on\", \"path\": \"/empty/on\"}]");
+	CHECK(patch.read(patchDocument.getRoot()));
+
+	SharedDocument copy = original;
+	CHECK(copy.getRoot() == original.getRoot());
+	SharedDocument updated;
+	CHECK(original.apply(patch, updated));
+	CHECK(toText(original.getRoot()) == originalText);
+	CHECK(toText(copy.getRoot()) == originalText);
+	CHECK(updated.getSegmentCount() == 2);
+
+	// The same result as patching a copy of the tree in place.
+	Document expected;
+	parseText(expected, SAMPLE);
+	CHECK(patch.apply(expected));
+	CHECK(equalTrees(updated.getRoot(), expected.getRoot()));
+
+	// Only the maps and arrays on the paths were copied.
+	const Value* before = original.getRoot();
+	const Value* after = updated.getRoot();
+	CHECK(after != before);
+	CHECK(after->getValueForKey("numbers") == before->getValueForKey("numbers"));
+	CHECK(after->getValueForKey("people")->getValueByIndex(0)
+			== before->getValueForKey("people")->getValueByIndex(0));
+	CHECK(after->getValueForKey("people")->getValueByIndex(1)
+			!= before->getValueForKey("people")->getValueByIndex(1));
+
+	// A failed patch changes nothing, even when applied in place.
+	String updatedText = toText(updated.getRoot());
+	parseText(patchDocument, "[{\"op\": \"add\", \"path\": \"/people/0/x\", "
+			"\"value\": 1}, {\"op\": \"remove\", \"path\": \"/nothing\"}]");
+	CHECK(patch.read(patchDocument.getRoot()));
+	CHECK(!updated.apply(patch, updated));
+	CHECK(toText(updated.getRoot()) == updatedText);
+	CHECK(toText(original.getRoot()) == originalText);
+
+	// Versions outlive the ones they were made from, also compacted.
+	original.clear();
+	copy.clear();
+	CHECK(toText(updated.getRoot()) == updatedText);
+	updated.compact();
+	CHECK(updated.getSegmentCount() == 1);
+	CHECK(toText(updated.getRoot()) == updatedText);
+
+	// A long chain of versions is released without recursion.
+	SharedDocument chain;
+	CHECK(chain.parse((const unsigned char*) "[0]", 3));
+	parseText(patchDocument, "[{\"op\": \"replace\", \"path\": \"/0\", "
+			"\"value\": 1}]");
+	CHECK(patch.read(patchDocument.getRoot()));
+	for (int i = 0; i < 100000; i++)
+		chain.apply(patch, chain);
+	CHECK(chain.getSegmentCount() == 100001);
+	CHECK(toText(chain.getRoot()) == "[1]");
+
+	// Removing the root leaves a version without one, also compacted.
+	parseText(patchDocument, "[{\"op\": \"remove\", \"path\": \"\"}]");
+	CHECK(patch.read(patchDocument.getRoot()));
+	SharedDocument empty;
+	CHECK(chain.apply(patch, empty));
+	CHECK(empty.getRoot() == NULL);
+	empty.compact();
+	CHECK(empty.getRoot() == NULL && empty.getSegmentCount() == 1);
+	CHECK(toText(chain.getRoot()) == "[1]");
+	Document document;
+	CHECK(document.copyValue(NULL) == NULL && copyValue(NULL) == NULL);
+}
+
+int main(int argc, char** argv) {
+	testDocument();
+	testFeed();
+	testModes();
+	testAccessors();
+	testProjection();
+	testBinding();
+	testRecords();
+	testSnapshots();
+	testParallelParser();
+	testPatch();
+	testSharedDocument();
+	printf("%d checks, %d failed\n", sChecks, sFailures);
+	return sFailures ? 1 : 0;
+}
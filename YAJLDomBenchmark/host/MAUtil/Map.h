@@ -0,0 +1,63 @@
+/*
+ * Host shim for MAUtil::Map, a sorted (not balanced) map sufficient
+ * for YAJLDom's use.
+ */
+#ifndef _SHIM_MAUTIL_MAP_H_
+#define _SHIM_MAUTIL_MAP_H_
+
+#include "Vector.h"
+
+namespace MAUtil {
+
+template<class F, class S>
+struct Pair {
+	F first;
+	S second;
+};
+
+template<class Key, class Value>
+class Map {
+public:
+	typedef Pair<Key, Value> PairKV;
+	typedef PairKV* Iterator;
+	typedef const PairKV* ConstIterator;
+
+	Iterator begin() { return mItems.begin(); }
+	Iterator end() { return mItems.end(); }
+	ConstIterator begin() const { return mItems.begin(); }
+	ConstIterator end() const { return mItems.end(); }
+
+	ConstIterator find(const Key& key) const {
+		int i = lowerBound(key);
+		if (i < mItems.size() && !(key < mItems[i].first) && !(mItems[i].first < key))
+			return mItems.begin() + i;
+		return end();
+	}
+	Value& operator[](const Key& key) {
+		int i = lowerBound(key);
+		if (i < mItems.size() && !(key < mItems[i].first) && !(mItems[i].first < key))
+			return mItems[i].second;
+		PairKV p;
+		p.first = key;
+		p.second = Value();
+		mItems.insert(i, p);
+		return mItems[i].second;
+	}
+	int size() const { return mItems.size(); }
+	void clear() { mItems.clear(); }
+
+private:
+	int lowerBound(const Key& key) const {
+		int lo = 0, hi = mItems.size();
+		while (lo < hi) {
+			int mid = (lo + hi) / 2;
+			if (mItems[mid].first < key) lo = mid + 1; else hi = mid;
+		}
+		return lo;
+	}
+	Vector<PairKV> mItems;
+};
+
+} // namespace MAUtil
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Host shim for MAUtil::Stack.
+ */
+#ifndef _SHIM_MAUTIL_STACK_H_
+#define _SHIM_MAUTIL_STACK_H_
+
+#include "Vector.h"
+
+namespace MAUtil {
+
+template<class T>
+class Stack {
+public:
+	void push(const T& v) { mVector.add(v); }
+	void pop() { mVector.remove(mVector.size() - 1); }
+	T& peek() { return mVector[mVector.size() - 1]; }
+	const T& peek() const { return mVector[mVector.size() - 1]; }
+	int size() const { return mVector.size(); }
+	bool empty() const { return mVector.empty(); }
+	void clear() { mVector.clear(); }
+
+private:
+	Vector<T> mVector;
+};
+
+} // namespace MAUtil
+
+#endif
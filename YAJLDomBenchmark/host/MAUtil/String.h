@@ -0,0 +1,97 @@
+/*
+ * Host shim for MAUtil::String. Deep-copying, not reference counted.
+ */
+#ifndef _SHIM_MAUTIL_STRING_H_
+#define _SHIM_MAUTIL_STRING_H_
+
+#include <string.h>
+#include <stdlib.h>
+
+namespace MAUtil {
+
+class String {
+public:
+	static const int npos = -1;
+
+	String() { init("", 0); }
+	String(const char* s) { init(s, (int)strlen(s)); }
+	String(const char* s, int len) { init(s, len); }
+	String(const String& s) { init(s.mData, s.mSize); }
+	~String() { free(mData); }
+
+	String& operator=(const String& s) {
+		if (this != &s) { free(mData); init(s.mData, s.mSize); }
+		return *this;
+	}
+	String& operator=(const char* s) { String t(s); return *this = t; }
+
+	const char* c_str() const { return mData; }
+	char* pointer() { return mData; }
+	int size() const { return mSize; }
+	int length() const { return mSize; }
+	int capacity() const { return mCapacity; }
+
+	void reserve(int cap) {
+		if (cap <= mCapacity) return;
+		mData = (char*)realloc(mData, cap + 1);
+		mCapacity = cap;
+	}
+	void resize(int n) { reserve(n); mSize = n; mData[n] = 0; }
+	void clear() { resize(0); }
+
+	String& append(const char* s, int len) {
+		if (mSize + len > mCapacity)
+			reserve((mSize + len) * 2);
+		memcpy(mData + mSize, s, len);
+		mSize += len;
+		mData[mSize] = 0;
+		return *this;
+	}
+	String& operator+=(const String& s) { return append(s.mData, s.mSize); }
+	String& operator+=(const char* s) { return append(s, (int)strlen(s)); }
+	String& operator+=(char c) { return append(&c, 1); }
+	String operator+(const String& s) const { String r(*this); r += s; return r; }
+	String operator+(const char* s) const { String r(*this); r += s; return r; }
+
+	char& operator[](int i) { return mData[i]; }
+	const char& operator[](int i) const { return mData[i]; }
+
+	bool operator==(const String& s) const {
+		return mSize == s.mSize && memcmp(mData, s.mData, mSize) == 0;
+	}
+	bool operator==(const char* s) const { return strcmp(mData, s) == 0; }
+	bool operator!=(const String& s) const { return !(*this == s); }
+	bool operator<(const String& s) const { return strcmp(mData, s.mData) < 0; }
+	bool operator>(const String& s) const { return strcmp(mData, s.mData) > 0; }
+
+	int find(const String& s, int offset = 0) const {
+		const char* p = strstr(mData + offset, s.mData);
+		return p ? (int)(p - mData) : npos;
+	}
+	int findFirstOf(char c, int offset = 0) const {
+		const char* p = strchr(mData + offset, c);
+		return p ? (int)(p - mData) : npos;
+	}
+	String substr(int start, int len = npos) const {
+		if (len == npos || start + len > mSize) len = mSize - start;
+		return String(mData + start, len);
+	}
+
+private:
+	void init(const char* s, int len) {
+		mData = (char*)malloc(len + 1);
+		memcpy(mData, s, len);
+		mData[len] = 0;
+		mSize = mCapacity = len;
+	}
+
+	char* mData;
+	int mSize;
+	int mCapacity;
+};
+
+inline String operator+(const char* a, const String& b) { return String(a) + b; }
+
+} // namespace MAUtil
+
+#endif
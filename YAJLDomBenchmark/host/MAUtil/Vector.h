@@ -0,0 +1,93 @@
+/*
+ * Host shim for MAUtil::Vector.
+ */
+#ifndef _SHIM_MAUTIL_VECTOR_H_
+#define _SHIM_MAUTIL_VECTOR_H_
+
+#include <new>
+#include <stdlib.h>
+
+namespace MAUtil {
+
+template<class T>
+class Vector {
+public:
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	Vector(int initialCapacity = 4) : mData(NULL), mSize(0), mCapacity(0) {
+		reserve(initialCapacity);
+	}
+	Vector(const Vector& o) : mData(NULL), mSize(0), mCapacity(0) {
+		*this = o;
+	}
+	~Vector() { clear(); free(mData); }
+
+	Vector& operator=(const Vector& o) {
+		if (this == &o) return *this;
+		clear();
+		reserve(o.mSize);
+		for (int i = 0; i < o.mSize; i++) new (&mData[i]) T(o.mData[i]);
+		mSize = o.mSize;
+		return *this;
+	}
+
+	void reserve(int cap) {
+		if (cap <= mCapacity) return;
+		T* data = (T*)malloc(sizeof(T) * cap);
+		for (int i = 0; i < mSize; i++) {
+			new (&data[i]) T(mData[i]);
+			mData[i].~T();
+		}
+		free(mData);
+		mData = data;
+		mCapacity = cap;
+	}
+	void resize(int n) {
+		reserve(n);
+		for (int i = mSize; i < n; i++) new (&mData[i]) T();
+		for (int i = n; i < mSize; i++) mData[i].~T();
+		mSize = n;
+	}
+	void add(const T& v) {
+		if (mSize == mCapacity) {
+			T copy(v);
+			reserve(mCapacity ? mCapacity * 2 : 4);
+			new (&mData[mSize++]) T(copy);
+			return;
+		}
+		new (&mData[mSize++]) T(v);
+	}
+	void add(const T* v, int count) { for (int i = 0; i < count; i++) add(v[i]); }
+	void insert(int index, const T& v) {
+		add(v);
+		for (int i = mSize - 1; i > index; i--) mData[i] = mData[i - 1];
+		mData[index] = v;
+	}
+	void remove(int index) {
+		for (int i = index; i < mSize - 1; i++) mData[i] = mData[i + 1];
+		mData[--mSize].~T();
+	}
+	void clear() { for (int i = 0; i < mSize; i++) mData[i].~T(); mSize = 0; }
+
+	int size() const { return mSize; }
+	int capacity() const { return mCapacity; }
+	bool empty() const { return mSize == 0; }
+	T* pointer() { return mData; }
+	const T* pointer() const { return mData; }
+	T* begin() { return mData; }
+	T* end() { return mData + mSize; }
+	const T* begin() const { return mData; }
+	const T* end() const { return mData + mSize; }
+	T& operator[](int i) { return mData[i]; }
+	const T& operator[](int i) const { return mData[i]; }
+
+private:
+	T* mData;
+	int mSize;
+	int mCapacity;
+};
+
+} // namespace MAUtil
+
+#endif
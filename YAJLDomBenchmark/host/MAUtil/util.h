@@ -0,0 +1,32 @@
+/*
+ * Host shim for MAUtil/util.h.
+ */
+#ifndef _SHIM_MAUTIL_UTIL_H_
+#define _SHIM_MAUTIL_UTIL_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "String.h"
+
+namespace MAUtil {
+
+inline int stringToInteger(const String& s, int base = 10) {
+	return (int)strtol(s.c_str(), NULL, base);
+}
+inline double stringToDouble(const String& s) {
+	return strtod(s.c_str(), NULL);
+}
+inline String integerToString(int i, int base = 10) {
+	char buf[32];
+	sprintf(buf, base == 16 ? "%x" : "%d", i);
+	return buf;
+}
+inline String doubleToString(double d, int precision = 6) {
+	char buf[512];
+	snprintf(buf, sizeof(buf), "%.*f", precision, d);
+	return buf;
+}
+
+} // namespace MAUtil
+
+#endif
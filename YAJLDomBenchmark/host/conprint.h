@@ -0,0 +1,9 @@
+/*
+ * Host shim for conprint.h.
+ */
+#ifndef _SHIM_CONPRINT_H_
+#define _SHIM_CONPRINT_H_
+
+#include <stdio.h>
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Host implementation of the MoSync syscalls declared in the shim ma.h.
+ * Data objects are plain heap buffers indexed by handle.
+ */
+#include "ma.h"
+#include <time.h>
+
+#define MAX_OBJECTS 1024
+
+static struct { char* data; int size; } sObjects[MAX_OBJECTS];
+static int sNextHandle = 1;
+
+void maPanic(int result, const char* message) {
+	fprintf(stderr, "maPanic(%d): %s\n", result, message);
+	abort();
+}
+
+int maGetMilliSecondCount(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+MAHandle maCreatePlaceholder(void) {
+	if (sNextHandle >= MAX_OBJECTS)
+		maPanic(1, "maCreatePlaceholder: out of handles");
+	return sNextHandle++;
+}
+
+int maCreateData(MAHandle placeholder, int size) {
+	sObjects[placeholder].data = (char*)malloc(size > 0 ? size : 1);
+	if (!sObjects[placeholder].data)
+		return RES_OUT_OF_MEMORY;
+	sObjects[placeholder].size = size;
+	return RES_OK;
+}
+
+int maGetDataSize(MAHandle data) {
+	return sObjects[data].size;
+}
+
+void maReadData(MAHandle data, void* dst, int offset, int size) {
+	if (offset < 0 || offset + size > sObjects[data].size)
+		maPanic(1, "maReadData: out of bounds");
+	memcpy(dst, sObjects[data].data + offset, size);
+}
+
+void maWriteData(MAHandle data, const void* src, int offset, int size) {
+	if (offset < 0 || offset + size > sObjects[data].size)
+		maPanic(1, "maWriteData: out of bounds");
+	memcpy(sObjects[data].data + offset, src, size);
+}
+
+void maDestroyObject(MAHandle handle) {
+	free(sObjects[handle].data);
+	sObjects[handle].data = NULL;
+	sObjects[handle].size = 0;
+}
@@ -0,0 +1,33 @@
+/*
+ * Host shim for the subset of the MoSync syscall API used by YAJLDom.
+ */
+#ifndef _SHIM_MA_H_
+#define _SHIM_MA_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef int MAHandle;
+
+#define RES_OK 1
+#define RES_OUT_OF_MEMORY -1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void maPanic(int result, const char* message);
+int maGetMilliSecondCount(void);
+MAHandle maCreatePlaceholder(void);
+int maCreateData(MAHandle placeholder, int size);
+int maGetDataSize(MAHandle data);
+void maReadData(MAHandle data, void* dst, int offset, int size);
+void maWriteData(MAHandle data, const void* src, int offset, int size);
+void maDestroyObject(MAHandle handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,9 @@
+/*
+ * Host shim for maheap.h.
+ */
+#ifndef _SHIM_MAHEAP_H_
+#define _SHIM_MAHEAP_H_
+
+#include <stdlib.h>
+
+#endif
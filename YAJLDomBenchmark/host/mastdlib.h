@@ -0,0 +1,9 @@
+/*
+ * Host shim for mastdlib.h.
+ */
+#ifndef _SHIM_MASTDLIB_H_
+#define _SHIM_MASTDLIB_H_
+
+#include <stdlib.h>
+
+#endif
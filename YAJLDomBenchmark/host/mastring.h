@@ -0,0 +1,9 @@
+/*
+ * Host shim for mastring.h.
+ */
+#ifndef _SHIM_MASTRING_H_
+#define _SHIM_MASTRING_H_
+
+#include <string.h>
+
+#endif
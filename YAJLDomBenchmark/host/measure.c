@@ -0,0 +1,94 @@
+/*
+ * Host measurements for the benchmark. Allocations are counted by
+ * replacing malloc, calloc, realloc and free with wrappers around the
+ * glibc functions, which also catches the allocations of libstdc++.
+ */
+#include "measure.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* p, size_t size);
+extern void __libc_free(void* p);
+
+static long long sAllocations;
+static long long sAllocatedBytes;
+
+static void countAllocation(size_t size) {
+	__sync_fetch_and_add(&sAllocations, 1);
+	__sync_fetch_and_add(&sAllocatedBytes, (long long) size);
+}
+
+void* malloc(size_t size) {
+	countAllocation(size);
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	countAllocation(count * size);
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* p, size_t size) {
+	countAllocation(size);
+	return __libc_realloc(p, size);
+}
+
+void free(void* p) {
+	__libc_free(p);
+}
+
+double getTime(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+long long getAllocationCount(void) {
+	return __sync_fetch_and_add(&sAllocations, 0);
+}
+
+long long getAllocatedBytes(void) {
+	return __sync_fetch_and_add(&sAllocatedBytes, 0);
+}
+
+void resetPeakMemory(void) {
+	FILE* file = fopen("/proc/self/clear_refs", "w");
+	if (!file)
+		return;
+	fputs("5", file);
+	fclose(file);
+}
+
+/**
+ * \return A field of /proc/self/status in kilobytes, or -1.
+ */
+static int readStatus(const char* format) {
+	char line[256];
+	int value = -1;
+	FILE* file = fopen("/proc/self/status", "r");
+	if (file) {
+		while (fgets(line, sizeof(line), file))
+			if (sscanf(line, format, &value) == 1)
+				break;
+		fclose(file);
+	}
+	return value;
+}
+
+int getPeakMemory(void) {
+	int peak = readStatus("VmHWM: %d");
+	if (peak < 0) {
+		struct rusage usage;
+		getrusage(RUSAGE_SELF, &usage);
+		peak = (int) usage.ru_maxrss;
+	}
+	return peak;
+}
+
+int getMemory(void) {
+	return readStatus("VmRSS: %d");
+}
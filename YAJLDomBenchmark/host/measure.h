@@ -0,0 +1,46 @@
+/*
+ * Host measurements for the benchmark: a fine clock, counts of heap
+ * allocations and the peak resident set size.
+ */
+#ifndef _SHIM_MEASURE_H_
+#define _SHIM_MEASURE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Milliseconds from an arbitrary start, with sub-microsecond resolution.
+ */
+double getTime(void);
+
+/**
+ * Number of malloc, calloc and realloc calls, and the bytes they
+ * requested, since the program started. new is counted too, since it
+ * allocates with malloc.
+ */
+long long getAllocationCount(void);
+long long getAllocatedBytes(void);
+
+/**
+ * Reset the peak resident set size to the current one. Needs Linux 4.0
+ * or later, on older kernels the peak is that of the whole run.
+ */
+void resetPeakMemory(void);
+
+/**
+ * \return The peak resident set size in kilobytes since the last
+ * resetPeakMemory().
+ */
+int getPeakMemory(void);
+
+/**
+ * \return The resident set size in kilobytes.
+ */
+int getMemory(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif